@@ -1,17 +1,55 @@
 #include "mbed.h"
 #include "L2_FSMevent.h"
 
-static uint32_t eventFlag;
+//raised from the PHY callbacks and the timer interrupt as well as from the FSM :
+//read-modify-writes go through compare-and-swap so that no event is lost
+static volatile uint32_t eventFlag;
+static volatile uint32_t postCnt = 0;     //flags set and frames queued, for the main loop to tell if it may sleep
+
+//event-to-handling latency, in L2_FSMrun passes from the set to the clear of a flag
+//(not for dataToSend : it stays up for as long as SDUs are being segmented)
+static uint32_t passCnt = 0;
+static uint32_t eventPass[32];
+static L2_eventStats_t eventStats;
 
 
 void L2_event_setEventFlag(L2_event_e event)
 {
-    eventFlag |= (0x01 << event);
+    uint32_t flag = eventFlag;
+
+    while (!core_util_atomic_cas_u32(&eventFlag, &flag, flag | (0x01 << event)));
+
+    if ((flag & (0x01 << event)) == 0)
+        eventPass[event] = passCnt;
+    L2_event_post();
+}
+
+//something for the FSM arrived without a flag of its own (RX queue)
+void L2_event_post(void)
+{
+    core_util_atomic_incr_u32(&postCnt, 1);
+}
+
+uint32_t L2_event_getPostCount(void)
+{
+    return postCnt;
 }
 
 void L2_event_clearEventFlag(L2_event_e event)
 {
-    eventFlag &= ~(0x01 << event);
+    uint32_t flag = eventFlag;
+
+    while (!core_util_atomic_cas_u32(&eventFlag, &flag, flag & ~(0x01 << event)));
+
+    if ((flag & (0x01 << event)) && event != L2_event_dataToSend)
+    {
+        uint32_t latency = passCnt - eventPass[event];
+
+        eventStats.handled++;
+        eventStats.totalPasses += latency;
+        if (latency > eventStats.maxPasses)
+            eventStats.maxPasses = latency;
+    }
 }
 void L2_event_clearAllEventFlag(void)
 {
@@ -21,4 +59,26 @@ void L2_event_clearAllEventFlag(void)
 int L2_event_checkEventFlag(L2_event_e event)
 {
     return (eventFlag & (0x01 << event));
+}
+
+//highest priority event pending among mask, L2_EVENT_NONE if none : one CLZ instead of a test per event
+int L2_event_getEvent(uint32_t mask)
+{
+    uint32_t pending = eventFlag & mask;
+
+    if (pending == 0)
+        return L2_EVENT_NONE;
+
+    return 31 - __CLZ(pending);
+}
+
+//start of an L2_FSMrun pass
+void L2_event_countPass(void)
+{
+    passCnt++;
+}
+
+const L2_eventStats_t* L2_event_getStats(void)
+{
+    return &eventStats;
 }
\ No newline at end of file
@@ -1,18 +1,34 @@
+//the value is the priority : L2_event_getEvent returns the highest pending one
 typedef enum L2_event
 {
-    L2_event_dataTxDone = 0,
-    L2_event_ackTxDone = 1,
-    L2_event_ackRcvd = 2,
-    L2_event_dataRcvd = 3,
-    L2_event_dataToSend = 4,
+    L2_event_reconfigSrcId = 0,
+    L2_event_dataToSend = 1,
+    L2_event_dataTxDone = 2,
+    L2_event_ackTxDone = 3,
+    L2_event_ackTimeout = 4,
     L2_event_arqTimeout = 5,
-    L2_event_reconfigSrcId = 6,
-    L2_event_dataToSendBuffer = 7
+    L2_event_dataRcvd = 6,
+    L2_event_ackRcvd = 7
 } L2_event_e;
 
+#define L2_EVENT_NONE           (-1)
+#define L2_EVENT_MASK(event)    (0x01 << (event))
+
+
+typedef struct {
+    uint32_t handled;       //flags cleared after being set
+    uint32_t totalPasses;   //sum of their set-to-clear latencies
+    uint32_t maxPasses;
+} L2_eventStats_t;
+
 
 void L2_event_setEventFlag(L2_event_e event);
 void L2_event_clearEventFlag(L2_event_e event);
 void L2_event_clearAllEventFlag(void);
 int L2_event_checkEventFlag(L2_event_e event);
+int L2_event_getEvent(uint32_t mask);
+void L2_event_post(void);
+uint32_t L2_event_getPostCount(void);
+void L2_event_countPass(void);
+const L2_eventStats_t* L2_event_getStats(void);
 
@@ -2,6 +2,10 @@
 #include "L2_msg.h"
 #include "L2_timer.h"
 #include "L2_LLinterface.h"
+#include "L2_peer.h"
+#include "L2_reasm.h"
+#include "L2_txq.h"
+#include "L2_mcast.h"
 #include "L3_LLinterface.h"
 #include "protocol_parameters.h"
 
@@ -12,41 +16,59 @@
 #define L2STATE_ACK               2
 #endif
 
-#define SDUBUFFER_SIZE              1024
+#define L2_BROADCAST_ID             255
 
 //state variables
 static uint8_t main_state = L2STATE_IDLE; //protocol state
 static uint8_t prev_state = main_state;
 
-//source/destination ID
+//source ID
 static uint8_t myL2ID=1;
-static uint8_t destL2ID=0;
-
-//L2 PDU context/size
-static uint8_t sduBuffer[SDUBUFFER_SIZE];
-static uint8_t sduBufferSize;
 
-static uint8_t arqPdu[200];
-static uint8_t sduIn[200];
+//L2 PDU context/size : DATA PDU being transmitted, built from a segment of the SDU
+static uint8_t txPdu[L2_MSG_MAXPDUSIZE];
 static uint8_t pduSize;
-static uint8_t sduLen;
+static uint32_t txCopiedBytes = 0;         //SDU bytes copied from DATA_REQ to the PHY
 
-static uint8_t pduBuffer[SDUBUFFER_SIZE];
-static uint8_t pduBufferSize;
+//neighbor holding the channel : its PDUs go out back to back until one of them polls for an ACK
+static L2_peer_t* burstPeer = NULL;
+static uint8_t burstPolled = 0;
+static uint8_t nextPeerIdx = 0;             //round robin among neighbors
 //ARQ parameters -------------------------------------------------------------
-static uint8_t seqNum = 0;     //ARQ sequence number
 #ifndef DISABLE_ARQ
-static uint8_t retxCnt = 0;    //ARQ retransmission counter
-static uint8_t arqAck[5];      //ARQ ACK PDU
-#define L2_BROADCAST_ID             255
+#if L2_ARQ_WINDOWSIZE < 1 || L2_ARQ_WINDOWSIZE > L2_ARQ_MAXWINDOW
+#error "L2_ARQ_WINDOWSIZE must be between 1 and 16"
+#endif
+
+#define L2_arq_slot(seq)            ((seq) % L2_ARQ_MAXWINDOW)
+
+#if L2_MSS < L2_MSG_MAXDATASIZE || L2_MSS > L2_MSG_MAXMSS
+#error "L2_MSS must be between L2_MSG_MAXDATASIZE and L2_MSG_MAXMSS"
+#endif
+
+//a held ACK must reach the sender well before its RTO (L2_ARQ_MINRTO at least) fires
+#define L2_ARQ_MAXACKDELAY          (L2_ARQ_MINRTO/2)
+#if L2_ARQ_ACKDELAY > L2_ARQ_MAXACKDELAY
+#error "L2_ARQ_ACKDELAY must not exceed L2_ARQ_MINRTO/2"
+#endif
+
+static uint8_t arqWindow = L2_ARQ_WINDOWSIZE;
+static uint8_t arqMss = L2_MSS;         //advertised to neighbors
+static uint16_t arqAckDelay = L2_ARQ_ACKDELAY;  //ms an ACK may wait for a DATA PDU to ride on
+static uint8_t arqAck[L2_MSG_BLOCKACKSIZE]; //ARQ ACK PDU
 #endif
+static uint8_t mcastNack[L2_MSG_NACKSIZE];   //NACK PDU for broadcast PDUs
+static uint8_t sduDelivered = 0;            //an SDU went to L3 in this pass : L3 holds one at a time
+static uint8_t ucastHeld = 0;               //unicast PDUs in sequence wait for the next pass
+static uint8_t bcastHeld = 0;               //broadcast PDUs in sequence wait for the next pass
 static uint8_t reqestedId=0;
+static uint8_t nextSduId = 0;               //ID of the next SDU accepted from L3 (wraps, far more than the queue holds)
 
-static uint8_t L2_validityCheck_ID(void)
+static uint8_t L2_validityCheck_ID(uint8_t destId)
 {
-    if (myL2ID == destL2ID)
+    if (myL2ID == destId)
     {
-        debug("[WARNING] myID and destination ID is the same! my:%i, dest:%i\n", myL2ID, destL2ID);
+        debug("[WARNING] myID and destination ID is the same! my:%i, dest:%i\n", myL2ID, destId);
         return 1;
     }
 
@@ -54,114 +76,789 @@ static uint8_t L2_validityCheck_ID(void)
 }
 
 
-uint8_t L2_configDestId(uint8_t destId)
+//hands queued SDUs to their neighbors in order, skipping those whose neighbor is still busy
+//SDUs to the same neighbor keep their order : the older one holds it or is taken first
+static void L2_drainTxQueue(void)
 {
-    destL2ID = destId;
-    
-    if (L2_validityCheck_ID() == 1)
+    L2_txqEntry_t* entry = NULL;
+    L2_peer_t* peer;
+
+    while ((entry = L2_txq_getWaiting(entry)) != NULL)
     {
-        debug("[L2] Failed to config dest to ID %i\n", destId);
-        return 1;
+        peer = L2_peer_get(entry->destId);
+        if (peer == NULL || peer->sduPending)
+            continue;
+
+        peer->sduEntry = entry;
+        peer->sdu = L2_txq_getSdu(entry);
+        peer->sduLen = entry->len;
+        peer->sduOffset = 0;
+        peer->sduPending = 1;
+        L2_txq_take(entry);
+
+        L2_event_setEventFlag(L2_event_dataToSend);
     }
+}
 
-    return 0;
+static int L2_acceptSdu(uint8_t* sdu, uint8_t len, uint8_t destId, uint8_t unordered)
+{
+    if (len == 0 || L2_validityCheck_ID(destId) == 1)
+    {
+        debug("[L2] Failed to handle DATA_REQ (invalid dest ID %i or empty SDU)\n", destId);
+        return L3_LLI_REQ_INVALID;
+    }
+
+    if (L2_txq_push(sdu, len, destId, unordered, nextSduId) != 0)
+    {
+        debug_if(DBGMSG_L2, "[L2] Failed to handle DATA_REQ to %i (transmit queue is full)\n", destId);
+        return L3_LLI_REQ_QUEUEFULL;
+    }
+    nextSduId++;
+    txCopiedBytes += len;
+
+    L2_drainTxQueue();
+
+    return L3_LLI_REQ_OK;
+}
+
+int L2_LLI_handleDataReq(uint8_t* sdu, uint8_t len, uint8_t destId)
+{
+    return L2_acceptSdu(sdu, len, destId, 0);
 }
 
+//broadcast whose receivers need not keep it in order with the others (beacons)
+int L2_LLI_handleUnorderedReq(uint8_t* sdu, uint8_t len, uint8_t destId)
+{
+    return L2_acceptSdu(sdu, len, destId, 1);
+}
+
+//ID of the SDU the last successful DATA_REQ queued, its DATA_CNF carries the same
+uint8_t L2_LLI_getLastSduId(void)
+{
+    return (uint8_t)(nextSduId - 1);
+}
+
+void L2_LLI_reconfigSrcId(uint8_t myId)
+{
+    reqestedId = myId;
+    L2_event_setEventFlag(L2_event_reconfigSrcId);
+}
 
-int L2_pullSduBuffer(uint8_t size)
+
+void L2_initFSM(uint8_t myId)
 {
-    int res;
+    myL2ID = myId;
 
-    if (size > sduBufferSize)
+    L2_event_clearAllEventFlag();
+    L2_peer_init();
+    L2_reasm_init();
+    L2_txq_init();
+    L2_mcast_init();
+    ucastHeld = 0;
+    bcastHeld = 0;
+    L2_timer_init();
+
+    L2_LLI_initLowLayer(myL2ID);
+    L3_LLI_setDataReqFunc(L2_LLI_handleDataReq);
+    L3_LLI_setUnorderedReqFunc(L2_LLI_handleUnorderedReq);
+    L3_LLI_setReconfigSrcIdReqFunc(L2_LLI_reconfigSrcId);
+    L3_LLI_setSduIdFunc(L2_LLI_getLastSduId);
+}
+
+
+
+int L2_aggregateData(uint8_t* dataPtr, uint8_t srcId, uint8_t size, uint8_t brflag, uint8_t flag_end)
+{
+    uint8_t sduLen;
+    uint8_t* sdu = L2_reasm_addSegment(srcId, brflag, L2_msg_getWord(dataPtr), size-L2_msg_getHeaderSize(dataPtr), flag_end, &sduLen);
+
+    if (sdu != NULL)
     {
-        debug_if(DBGMSG_L2, "[L2][WARNING] sdu buffer size (%i) is less than request size (%i), truncating the requested size...\n", sduBufferSize, size);
-        size = sduBufferSize;
+        L3_LLI_dataInd(sdu, srcId, sduLen, L2_LLI_getSnr(), L2_LLI_getRssi());
+        sduDelivered = 1;
+        return 0;
     }
 
-    memcpy(sduIn, sduBuffer, size);
-    sduLen = size;
+    return 1;
+}
+
+
+uint32_t L2_getTxCopiedBytes(void)
+{
+    return txCopiedBytes;
+}
+
 
+//largest DATA payload advertised to neighbors
+void L2_configMss(uint8_t mss)
+{
+#ifndef DISABLE_ARQ
+    if (mss < L2_MSG_MAXDATASIZE)
+        mss = L2_MSG_MAXDATASIZE;
+    else if (mss > L2_MSG_MAXMSS)
+        mss = L2_MSG_MAXMSS;
+
+    arqMss = mss;
+#endif
+}
+
+//how long an ACK may wait for a DATA PDU to piggyback on (0 : ACK right away)
+void L2_configAckDelay(uint16_t delay)
+{
+#ifndef DISABLE_ARQ
+    if (delay > L2_ARQ_MAXACKDELAY)
+        delay = L2_ARQ_MAXACKDELAY;
+
+    arqAckDelay = delay;
+#endif
+}
+
+void L2_configArqWindow(uint8_t size)
+{
+#ifndef DISABLE_ARQ
+    if (size < 1)
+        size = 1;
+    else if (size > L2_ARQ_MAXWINDOW)
+        size = L2_ARQ_MAXWINDOW;
+
+    arqWindow = size;
+#endif
+}
+
+
+//SDU to the neighbor is done : confirm it to L3
+static void L2_completeSdu(L2_peer_t* peer, uint8_t res)
+{
+    uint8_t sduId = peer->sduEntry->sduId;
 
-    sduBufferSize -= size;
-    if (sduBufferSize > 0)
+    peer->sduPending = 0;
+    L2_txq_release(peer->sduEntry);
+    L2_drainTxQueue();
+    L3_LLI_dataCnf(res, peer->id, sduId);
+}
+
+
+#ifndef DISABLE_ARQ
+//ARQ functions (selective repeat, one context per neighbor) ---------------------
+static uint8_t L2_arq_getInFlight(L2_peer_t* peer)
+{
+    return (uint8_t)(peer->txSeq - peer->txBase);
+}
+
+//1 if any neighbor has unacknowledged segments
+static uint8_t L2_arq_checkInFlight(void)
+{
+    for (uint8_t i = 0; i < L2_MAXPEERS; i++)
+    {
+        L2_peer_t* peer = L2_peer_getByIndex(i);
+
+        if (peer != NULL && L2_arq_getInFlight(peer) > 0)
+            return 1;
+    }
+
+    return 0;
+}
+
+//arms the retransmission timer of the neighbor
+//up to RTO/4 of jitter keeps senders that collided from retrying in lockstep
+static void L2_arq_startTimer(L2_peer_t* peer)
+{
+    L2_timer_startTimer(L2_TIMER_ARQ(L2_peer_getIndex(peer)), peer->rto + rand()%(peer->rto/4 + 1));
+}
+
+//ACK map for a received sequence number : bit i is set if seq-i was received
+static uint16_t L2_arq_getAckMap(L2_peer_t* peer, uint8_t seq)
+{
+    uint16_t ackMap = 0;
+
+    for (uint8_t i = 0; i < arqWindow; i++)
     {
-        memcpy(sduBuffer, sduBuffer+size, sduBufferSize);
-        res = 1;
-    }  
+        uint8_t s = seq - i;
+
+        if ((uint8_t)(peer->rxSeq - s - 1) < L2_MSSG_MAX_SEQNUM/2 ||                                    //already delivered
+            ((uint8_t)(s - peer->rxSeq) < arqWindow && (peer->rxBuffered & (1 << L2_arq_slot(s)))))    //buffered
+            ackMap |= (1 << i);
+    }
+
+    return ackMap;
+}
+
+//the ACK owed to the neighbor is sent (standalone or piggybacked)
+static void L2_arq_clearAck(L2_peer_t* peer)
+{
+    peer->ackPending = 0;
+    peer->ackDue = 0;
+    L2_timer_stopTimer(L2_TIMER_ACK(L2_peer_getIndex(peer)));
+}
+
+//standalone ACK, reporting the segments before ackSeq as well
+//a window wider than the 8 bit map is acknowledged as a block, with one BLOCKACK
+static void L2_arq_sendAck(L2_peer_t* peer)
+{
+    uint16_t ackMap = L2_arq_getAckMap(peer, peer->ackSeq);
+    uint8_t size;
+
+    if (arqWindow > 8)
+        size = L2_msg_encodeBlockAck(arqAck, peer->ackSeq, ackMap, arqMss);
     else
-        res = 0;
+        size = L2_msg_encodeAck(arqAck, peer->ackSeq, ackMap, arqMss);
+    L2_LLI_sendData(arqAck, size, peer->id);
+    L2_arq_clearAck(peer);
+}
+
+//delayed ACKs whose time is up
+static void L2_arq_markAckDue(void)
+{
+    for (uint8_t i = 0; i < L2_MAXPEERS; i++)
+    {
+        L2_peer_t* peer = L2_peer_getByIndex(i);
 
-    return res;
+        if (L2_timer_checkExpired(L2_TIMER_ACK(i)) && peer != NULL && peer->ackPending)
+            peer->ackDue = 1;
+    }
 }
 
-void L2_LLI_handleDataReq(uint8_t* sdu, uint8_t len, uint8_t destId)
+static L2_peer_t* L2_arq_getAckDue(void)
 {
-    if (L2_configDestId(destId) == 1 || L2_event_checkEventFlag(L2_event_dataToSendBuffer))
+    for (uint8_t i = 0; i < L2_MAXPEERS; i++)
     {
-        debug_if(DBGMSG_L2, "[L2] Failed to handle DATA_REQ (dest ID is invalid or data TX is in progress...(SDU flag : %i)\n", L2_event_checkEventFlag(L2_event_dataToSendBuffer));
-        return;
+        L2_peer_t* peer = L2_peer_getByIndex(i);
+
+        if (peer != NULL && peer->ackDue)
+            return peer;
     }
 
-    if (len < L2_MSG_MAXDATASIZE)
+    return NULL;
+}
+#endif
+
+//1 if the neighbor has a PDU that may go out now
+static uint8_t L2_checkSendable(L2_peer_t* peer)
+{
+    if (peer->id == L2_BROADCAST_ID && L2_mcast_checkRepair())
+        return 1;
+#ifndef DISABLE_ARQ
+    if (peer->txRetxReq != 0)
+        return 1;
+    if (peer->id != L2_BROADCAST_ID && L2_arq_getInFlight(peer) >= arqWindow)
+        return 0;
+#endif
+    return peer->sduPending && peer->sduOffset < peer->sduLen;
+}
+
+//writes the DATA PDU of a span of the SDU straight into txPdu, with the ACK owed to the neighbor if any
+static void L2_buildPdu(L2_peer_t* peer, uint8_t offset, uint8_t len, uint8_t seq)
+{
+    uint8_t flag_end = (offset + len == peer->sduLen);
+
+#ifndef DISABLE_ARQ
+    if (peer->ackPending)
     {
-        memcpy(sduIn, sdu, len);
-        sduLen = len;
+        pduSize = L2_msg_encodeDataAck(txPdu, peer->sdu + offset, seq, len, flag_end, peer->ackSeq, L2_arq_getAckMap(peer, peer->ackSeq) & 0xFF); //8 bit map only
+        L2_arq_clearAck(peer);
     }
     else
+#endif
+    pduSize = L2_msg_encodeData(txPdu, peer->sdu + offset, seq, len, flag_end);
+    txCopiedBytes += len;
+}
+
+#ifndef DISABLE_ARQ
+//builds and sends the PDU of an in-flight segment, returns 1 if the receiver is polled for an ACK
+static uint8_t L2_arq_sendPdu(L2_peer_t* peer, uint8_t seq)
+{
+    uint8_t slot = L2_arq_slot(seq);
+    uint8_t more;
+
+    L2_buildPdu(peer, peer->segOffset[slot], peer->segLen[slot], seq);
+    if (peer->txSyncMap & (1 << slot))
+        L2_msg_setSync(txPdu);
+
+    //a PDU following right away would collide with the ACK, so the receiver holds it
+    more = L2_checkSendable(peer);
+    L2_msg_setAckDefer(txPdu, more);
+    peer->txTime[slot] = us_ticker_read();
+
+    L2_LLI_sendData(txPdu, pduSize, peer->id);
+
+    return (more == 0);
+}
+
+//sends the next segment of the SDU as a new PDU, returns 1 if the receiver is polled for an ACK
+static uint8_t L2_arq_sendSegment(L2_peer_t* peer, uint8_t len)
+{
+    uint8_t seq = peer->txSeq;
+    uint8_t slot = L2_arq_slot(seq);
+
+    peer->segOffset[slot] = peer->sduOffset;
+    peer->segLen[slot] = len;
+    peer->sduOffset += len;
+    peer->retxCnt[slot] = 0;
+    peer->txAcked &= ~(1 << slot);
+    peer->txRetxReq &= ~(1 << slot);
+    peer->txSyncMap &= ~(1 << slot);
+    peer->txSeq++;
+
+    if (peer->txSync)
     {
-        memcpy(sduBuffer, sdu, len);
-        sduBufferSize = len;
+        peer->txSyncMap |= (1 << slot);
+        peer->txSync = 0;
+    }
+
+    debug_if(DBGMSG_L2, "[L2] sending to %i (seq:%i)\n", peer->id, seq);
 
-        L2_pullSduBuffer(L2_MSG_MAXDATASIZE);
-        L2_event_setEventFlag(L2_event_dataToSendBuffer);
+    return L2_arq_sendPdu(peer, seq);
+}
+
+//retransmits the oldest segment marked for it, returns 1 if the receiver is polled for an ACK
+static uint8_t L2_arq_retransmit(L2_peer_t* peer)
+{
+    for (uint8_t seq = peer->txBase; seq != peer->txSeq; seq++)
+    {
+        uint8_t slot = L2_arq_slot(seq);
+
+        if ((peer->txRetxReq & (1 << slot)) == 0)
+            continue;
+
+        peer->txRetxReq &= ~(1 << slot);
+        peer->retxCnt[slot] += 1;
+
+        debug_if(DBGMSG_L2, "[L2] retransmit to %i (seq:%i)\n", peer->id, seq);
+
+        return L2_arq_sendPdu(peer, seq);
     }
 
-    L2_event_setEventFlag(L2_event_dataToSend);
+    return 0;
 }
 
-void L2_LLI_reconfigSrcId(uint8_t myId)
+//the poll or its ACK was lost : the newest unacknowledged segment polls again, the ACK map
+//then tells which older ones are missing (SYNC segments go too, nothing is ACKed before them)
+//returns 1 if a segment is out of retries
+static uint8_t L2_arq_handleTimeout(L2_peer_t* peer)
 {
-    reqestedId = myId;
-    L2_event_setEventFlag(L2_event_reconfigSrcId);
+    uint8_t last = peer->txSeq;
+
+    for (uint8_t seq = peer->txBase; seq != peer->txSeq; seq++)
+    {
+        uint8_t slot = L2_arq_slot(seq);
+
+        if (peer->txAcked & (1 << slot))
+            continue;
+        if (peer->retxCnt[slot] >= L2_ARQ_MAXRETRANSMISSION)
+        {
+            debug("[L2][WARNING] Failed to send data %i to %i, max retx cnt reached! \n", seq, peer->id);
+            return 1;
+        }
+
+        if (peer->txSyncMap & (1 << slot))
+            peer->txRetxReq |= (1 << slot);
+        last = seq;
+    }
+
+    if (last != peer->txSeq)
+        peer->txRetxReq |= (1 << L2_arq_slot(last));
+
+    return 0;
 }
 
+//gives up the current SDU of the neighbor : remaining segments are dropped
+static void L2_arq_abortSdu(L2_peer_t* peer)
+{
+    L2_timer_stopTimer(L2_TIMER_ARQ(L2_peer_getIndex(peer)));
 
-void L2_initFSM(uint8_t myId)
+    peer->txBase = peer->txSeq;
+    peer->txAcked = 0;
+    peer->txRetxReq = 0;
+    peer->sduOffset = peer->sduLen;
+    peer->txSync = 1;   //the receiver may be waiting for the dropped segments
+}
+
+//applies an ACK (bit i of ackMap acknowledges seq-i, for i < mapBits) and slides the window
+static void L2_arq_handleAck(L2_peer_t* peer, uint8_t seq, uint16_t ackMap, uint8_t mapBits)
 {
-    myL2ID = myId;
-    destL2ID = 0; 
+    uint8_t prevBase = peer->txBase;
+    uint8_t slot = L2_arq_slot(seq);
+    uint8_t fresh = (ackMap & 1) && (uint8_t)(seq - peer->txBase) < L2_arq_getInFlight(peer) && (peer->txAcked & (1 << slot)) == 0;
 
-    L2_event_clearAllEventFlag();
+    //RTT sample from the PDU that solicited this ACK, unless it was retransmitted (Karn)
+    if (fresh && peer->retxCnt[slot] == 0)
+        L2_peer_updateRtt(peer, (us_ticker_read() - peer->txTime[slot])/1000);
 
-    L2_validityCheck_ID();
+    for (uint8_t i = 0; i < L2_ARQ_MAXWINDOW; i++)
+    {
+        uint8_t acked = seq - i;
 
-    L2_LLI_initLowLayer(myL2ID);
-    L3_LLI_setDataReqFunc(L2_LLI_handleDataReq);
-    L3_LLI_setReconfigSrcIdReqFunc(L2_LLI_reconfigSrcId);
+        if ((ackMap & (1 << i)) && (uint8_t)(acked - peer->txBase) < L2_arq_getInFlight(peer))
+        {
+            peer->txAcked |= (1 << L2_arq_slot(acked));
+            peer->txRetxReq &= ~(1 << L2_arq_slot(acked));
+        }
+    }
+
+    //the channel does not reorder : holes before the solicited PDU are losses
+    //(as far as the map reaches : a short map says nothing about older segments)
+    if (fresh)
+    {
+        uint8_t hole = peer->txBase;
+
+        if ((uint8_t)(seq - hole) >= mapBits)
+            hole = seq - mapBits + 1;
+        for (; hole != seq; hole++)
+        {
+            if ((peer->txAcked & (1 << L2_arq_slot(hole))) == 0 && peer->retxCnt[L2_arq_slot(hole)] < L2_ARQ_MAXRETRANSMISSION)
+                peer->txRetxReq |= (1 << L2_arq_slot(hole));
+        }
+    }
+
+    while (peer->txBase != peer->txSeq && (peer->txAcked & (1 << L2_arq_slot(peer->txBase))))
+    {
+        peer->txAcked &= ~(1 << L2_arq_slot(peer->txBase));
+        peer->txBase++;
+    }
+
+    if (peer->txBase == prevBase)
+    {
+        debug_if(DBGMSG_L2, "[L2] ACK does not move the window of %i (base : %i, received : %i)\n", peer->id, peer->txBase, seq);
+    }
+    else if (peer->txBase == peer->txSeq)
+    {
+        debug_if(DBGMSG_L2, "[L2] ACK is correctly received from %i! \n", peer->id);
+        L2_timer_stopTimer(L2_TIMER_ARQ(L2_peer_getIndex(peer)));
+    }
+    else
+    {
+        L2_arq_startTimer(peer); //restart for the new window base
+    }
 }
 
+//ACK from the neighbor, standalone or piggybacked on its DATA PDU
+static void L2_arq_processAck(L2_peer_t* peer, uint8_t seq, uint16_t ackMap, uint8_t mapBits)
+{
+    L2_arq_handleAck(peer, seq, ackMap, mapBits);
 
+    if (peer == burstPeer && burstPolled)
+        burstPeer = NULL; //the polled neighbor answered, the channel is free again
+    if (peer->sduPending && peer->sduOffset == peer->sduLen && L2_arq_getInFlight(peer) == 0)
+        L2_completeSdu(peer, 1);
+}
 
-int L2_aggregateData(uint8_t* dataPtr, uint8_t srcId, uint8_t size, uint8_t brflag, uint8_t flag_end)
+//segment size advertised by the neighbor, it applies from the next new segment on
+static void L2_arq_updateMss(L2_peer_t* peer, uint8_t mss)
+{
+    if (mss < L2_MSG_MAXDATASIZE)
+        return; //none advertised (or bogus) : keep the default
+    if (mss > L2_MSG_MAXMSS)
+        mss = L2_MSG_MAXMSS;
+
+    if (mss != peer->mss)
+        debug_if(DBGMSG_L2, "[L2] MSS of %i : %i bytes\n", peer->id, mss);
+    peer->mss = mss;
+}
+
+//in-order delivery to the reassembly buffer, it stops once L3 has an SDU it did not take yet
+//the PDUs left stay buffered (and acknowledged) for the next pass
+static void L2_arq_deliver(L2_peer_t* peer)
+{
+    uint8_t slot;
+
+    while (peer->rxBuffered & (1 << (slot = L2_arq_slot(peer->rxSeq))))
+    {
+        if (sduDelivered || L3_LLI_checkMsgPending())
+        {
+            ucastHeld = 1;
+            return;
+        }
+
+        L2_aggregateData(peer->rxPdu[slot], peer->id, peer->rxPduSize[slot], 0, L2_msg_checkIfEndData(peer->rxPdu[slot]));
+        peer->rxBuffered &= ~(1 << slot);
+        peer->rxSeq++;
+    }
+}
+
+//held unicast PDUs of every neighbor go on
+static void L2_arq_resume(void)
+{
+    ucastHeld = 0;
+    for (uint8_t i = 0; i < L2_MAXPEERS; i++)
+    {
+        L2_peer_t* peer = L2_peer_getByIndex(i);
+
+        if (peer != NULL)
+            L2_arq_deliver(peer);
+    }
+}
+
+//buffers/delivers a unicast DATA PDU, returns 0 if it is out of sequence (not to be acknowledged)
+static uint8_t L2_arq_receive(L2_peer_t* peer, uint8_t* dataPtr, uint8_t size)
 {
-    memcpy(pduBuffer+pduBufferSize,L2_msg_getWord(dataPtr), size);
-    pduBufferSize+=size-L2_MSG_OFFSET_DATA;
+    uint8_t seq = L2_msg_getSeq(dataPtr);
 
-    debug_if(DBGMSG_L2, "[L2] Aggregation PDU : size : %i end : %i\n", pduBufferSize, flag_end);
-    if (brflag == 1 || flag_end == 1)
+    //a new SYNC PDU restarts the sequence : whatever was expected before it is dropped
+    if (L2_msg_checkIfSync(dataPtr) &&
+        (peer->rxSynced == 0 || (uint8_t)(peer->rxSeq - seq - 1) >= L2_ARQ_MAXWINDOW))
     {
-        L3_LLI_dataInd(pduBuffer, srcId, pduBufferSize, L2_LLI_getSnr(), L2_LLI_getRssi());
-        pduBufferSize = 0;
+        if (peer->rxSynced && seq != peer->rxSeq)
+            debug("[L2][WARNING] sequence of %i restarts at %i (%i was required)\n", peer->id, seq, peer->rxSeq);
 
+        if (peer->rxSynced == 0 || (uint8_t)(seq - peer->rxSeq) >= arqWindow)
+            peer->rxBuffered = 0;
+        for (; peer->rxSynced && peer->rxSeq != seq; peer->rxSeq++)
+            peer->rxBuffered &= ~(1 << L2_arq_slot(peer->rxSeq));
+
+        peer->rxSeq = seq;
+        peer->rxSynced = 1;
+        L2_reasm_drop(peer->id, 0);
+    }
+
+    //the start of the sequence was lost : nothing to ACK until the SYNC PDU is retransmitted
+    if (peer->rxSynced == 0 ||
+        ((uint8_t)(seq - peer->rxSeq) >= arqWindow && (uint8_t)(peer->rxSeq - seq) > arqWindow))
+    {
+        debug_if(DBGMSG_L2, "[L2] PDU SN (%i) from %i is out of sequence, waiting for SYNC\n", seq, peer->id);
         return 0;
     }
 
+    if ((uint8_t)(seq - peer->rxSeq) < arqWindow)
+    {
+        uint8_t slot = L2_arq_slot(seq);
+
+        if ((peer->rxBuffered & (1 << slot)) == 0)
+        {
+            memcpy(peer->rxPdu[slot], dataPtr, size);
+            peer->rxPduSize[slot] = size;
+            peer->rxBuffered |= (1 << slot);
+        }
+
+        L2_arq_deliver(peer);
+    }
+    else
+    {
+        debug_if(DBGMSG_L2, "[L2] duplicated PDU SN (%i) from %i, ACK again\n", seq, peer->id);
+    }
+
     return 1;
 }
+#endif
 
+//broadcast PDUs that are in sequence go to reassembly, unordered ones straight to L3
+//L3 takes one SDU at a time : once one is out, the rest waits for a later pass
+static void L2_deliverBroadcast(void)
+{
+    uint8_t* pdu;
+    uint8_t srcId;
+    uint8_t size;
+
+    bcastHeld = 1;
+    if (sduDelivered || L3_LLI_checkMsgPending())
+        return;
+
+    while ((pdu = L2_mcast_getDeliverable(&srcId, &size)) != NULL)
+    {
+        if (L2_msg_checkIfUnordered(pdu))
+        {
+            //may be ahead of a hole : the SDU being reassembled must not take it
+            L3_LLI_dataInd(L2_msg_getWord(pdu), srcId, size - L2_msg_getHeaderSize(pdu), L2_LLI_getSnr(), L2_LLI_getRssi());
+            sduDelivered = 1;
+            return;
+        }
+        if (L2_aggregateData(pdu, srcId, size, 1, L2_msg_checkIfEndData(pdu)) == 0)
+            return;
+    }
+
+    bcastHeld = 0;
+}
+
+//a NACK owed for broadcast PDUs goes out, returns 1 if there was one
+static uint8_t L2_sendNack(void)
+{
+    uint8_t size = L2_mcast_getNackDue(mcastNack);
+
+    if (size == 0)
+        return 0;
+
+    L2_LLI_sendData(mcastNack, size, L2_BROADCAST_ID);
+    return 1;
+}
 
-void L2_FSMrun(void)
+//handles the PDU of a dataRcvd event, returns 1 if an ACK is being sent
+static uint8_t L2_handleDataRcvd(void)
 {
+    uint8_t srcId = L2_LLI_getSrcId();
+    uint8_t* dataPtr = L2_LLI_getRcvdDataPtr();
+    uint8_t size = L2_LLI_getSize();
+    uint8_t brflag = L2_LLI_getIsBroadcasted();
+    uint8_t flag_end = L2_msg_checkIfEndData(dataPtr);
+
+    if (L2_msg_checkIfNack(dataPtr))
+    {
+        if (L2_msg_getNackSrc(dataPtr) != myL2ID)
+            L2_mcast_overhearNack(dataPtr);
+        else if (L2_mcast_handleNack(dataPtr))
+            L2_event_setEventFlag(L2_event_dataToSend);
+
+        return 0;
+    }
+
+#ifndef DISABLE_ARQ
+    if (brflag == 0)
+    {
+        L2_peer_t* peer = L2_peer_get(srcId);
+
+        if (peer == NULL)
+            return 0;
+
+        if (L2_msg_checkIfPiggyAck(dataPtr))
+            L2_arq_processAck(peer, L2_msg_getPiggyAckSeq(dataPtr), L2_msg_getPiggyAckMap(dataPtr), 8);
+
+        if (L2_arq_receive(peer, dataPtr, size) == 0 || L2_msg_checkIfAckDefer(dataPtr))
+            return 0;
+
+        peer->ackSeq = L2_msg_getSeq(dataPtr);
+        peer->ackPending = 1;
+
+        //mid-SDU the sender stalls on this ACK : hold it only if a DATA PDU to the neighbor is coming
+        //(pending SDU, or a reply from L3 to the SDU just completed)
+        if (arqAckDelay == 0 || (flag_end == 0 && peer->sduPending == 0))
+        {
+            L2_arq_sendAck(peer);
+            return 1;
+        }
+
+        //held for a DATA PDU to the neighbor, a standalone ACK goes out when the delay is over
+        if (L2_timer_getTimerStatus(L2_TIMER_ACK(L2_peer_getIndex(peer))) == 0)
+            L2_timer_startTimer(L2_TIMER_ACK(L2_peer_getIndex(peer)), arqAckDelay);
+
+        return 0;
+    }
+#endif
+    if (brflag)
+    {
+        L2_mcast_receive(srcId, dataPtr, size);
+        L2_deliverBroadcast();
+        return 0;
+    }
+
+    L2_aggregateData(dataPtr, srcId, size, brflag, flag_end);
+
+    return 0;
+}
+
+//neighbor allowed to send now, NULL if none
+//a burst keeps the channel until it polls, then the next neighbor with data gets it (round robin)
+static L2_peer_t* L2_selectPeer(void)
+{
+    if (burstPeer != NULL)
+    {
+        if (burstPolled)
+            return NULL;
+        if (L2_checkSendable(burstPeer))
+            return burstPeer;
+
+        burstPeer = NULL;
+    }
+
+    for (uint8_t i = 0; i < L2_MAXPEERS; i++)
+    {
+        uint8_t idx = (nextPeerIdx + i) % L2_MAXPEERS;
+        L2_peer_t* peer = L2_peer_getByIndex(idx);
+
+        if (peer != NULL && L2_checkSendable(peer))
+        {
+            nextPeerIdx = (idx + 1) % L2_MAXPEERS;
+            burstPeer = peer;
+            burstPolled = 0;
+
+            return peer;
+        }
+    }
+
+    return NULL;
+}
+
+//sends the next PDU of the neighbor : a pending retransmission first, otherwise a new segment
+static void L2_sendPdu(L2_peer_t* peer)
+{
+    uint8_t len = peer->sduLen - peer->sduOffset;
+    uint8_t mss = L2_MSG_MAXDATASIZE;
+
+#ifndef DISABLE_ARQ
+    if (peer->id != L2_BROADCAST_ID)
+        mss = peer->mss;
+#endif
+    if (len > mss)
+        len = mss;
+
+    if (peer->id == L2_BROADCAST_ID && L2_mcast_checkRepair())
+    {
+        uint8_t* pdu = L2_mcast_getRepair(&pduSize);
+
+        debug_if(DBGMSG_L2, "[L2] repeating broadcast PDU %i\n", L2_msg_getSeq(pdu));
+        L2_LLI_sendData(pdu, pduSize, peer->id);
+        return;
+    }
+
+#ifndef DISABLE_ARQ
+    if (peer->txRetxReq != 0)
+    {
+        burstPolled = L2_arq_retransmit(peer);
+        return;
+    }
+    if (peer->id != L2_BROADCAST_ID)
+    {
+        burstPolled = L2_arq_sendSegment(peer, len);
+        return;
+    }
+#endif
+
+    //msg header setting : broadcast PDUs are numbered and kept, receivers NACK the ones they miss
+    L2_buildPdu(peer, peer->sduOffset, len, peer->txSeq);
+    if (peer->sduEntry->unordered && peer->sduOffset == 0 && len == peer->sduLen)
+        L2_msg_setUnordered(txPdu);
+    peer->sduOffset += len;
+    L2_mcast_store(txPdu, pduSize);
+
+    L2_LLI_sendData(txPdu, pduSize, peer->id);
+    debug_if(DBGMSG_L2, "[L2] sending to %i (seq:%i)\n", peer->id, peer->txSeq);
+    peer->txSeq++;
+    peer->txBase = peer->txSeq;
+}
+
+//state to return to once the PHY is free
+static uint8_t L2_getRestState(void)
+{
+#ifndef DISABLE_ARQ
+    if (L2_arq_checkInFlight())
+        return L2STATE_ACK;
+#endif
+    return L2STATE_IDLE;
+}
+
+
+//events each state handles (the others stay pending until the state changes)
+#define L2_EVENTS_IDLE      (L2_EVENT_MASK(L2_event_reconfigSrcId) | L2_EVENT_MASK(L2_event_dataToSend) | \
+                             L2_EVENT_MASK(L2_event_dataTxDone) | L2_EVENT_MASK(L2_event_ackTxDone) | \
+                             L2_EVENT_MASK(L2_event_ackTimeout) | L2_EVENT_MASK(L2_event_arqTimeout) | \
+                             L2_EVENT_MASK(L2_event_dataRcvd) | L2_EVENT_MASK(L2_event_ackRcvd))
+#define L2_EVENTS_TX        (L2_EVENT_MASK(L2_event_dataTxDone) | L2_EVENT_MASK(L2_event_ackTxDone))
+#define L2_EVENTS_ACK       (L2_EVENT_MASK(L2_event_dataTxDone) | L2_EVENT_MASK(L2_event_ackTxDone) | \
+                             L2_EVENT_MASK(L2_event_ackTimeout) | L2_EVENT_MASK(L2_event_arqTimeout) | \
+                             L2_EVENT_MASK(L2_event_dataRcvd) | L2_EVENT_MASK(L2_event_ackRcvd))
+
+//a received DATA PDU waits while L3 has an SDU it did not take yet (the frame stays in the RX queue)
+static uint32_t L2_rxMask(uint32_t events)
+{
+    if (L3_LLI_checkMsgPending())
+        return events & ~L2_EVENT_MASK(L2_event_dataRcvd);
+
+    return events;
+}
+
+//handles the highest priority event of the current state, returns 0 if there was nothing to do
+static uint8_t L2_FSMstep(void)
+{
+    L2_peer_t* peer;
+    int event;
+
     //debug message
     if (prev_state != main_state)
     {
@@ -169,246 +866,244 @@ void L2_FSMrun(void)
         prev_state = main_state;
     }
 
+    L2_LLI_retrySend();
+    L2_LLI_fetchFrame();
+
     //FSM should be implemented here! ---->>>>
     switch (main_state)
     {
         case L2STATE_IDLE: //IDLE state description
-            
-            if (L2_event_checkEventFlag(L2_event_reconfigSrcId)) //if src id reconfiguration is requested
-            {
-                int res;
-                res = L2_LLI_configSrcId(reqestedId);
 
-                L3_LLI_reconfigSrcIdCnf(res==0);
-                main_state = L2STATE_IDLE; //goto TX state
-                L2_event_clearEventFlag(L2_event_reconfigSrcId);
-            }
-            else if (L2_event_checkEventFlag(L2_event_dataRcvd)) //if data reception event happens
-            {
-                //Retrieving data info.
+            event = L2_event_getEvent(L2_rxMask(L2_EVENTS_IDLE));
 #ifndef DISABLE_ARQ
-                uint8_t srcId = L2_LLI_getSrcId();
-#endif
-                uint8_t* dataPtr = L2_LLI_getRcvdDataPtr();
-                uint8_t size = L2_LLI_getSize();
-                uint8_t brflag = L2_LLI_getIsBroadcasted();
-                uint8_t flag_end = L2_msg_checkIfEndData(dataPtr);
-
-                //L3_LLI_dataInd(L2_msg_getWord(dataPtr), srcId, size-L2_MSG_OFFSET_DATA, L2_LLI_getSnr(), L2_LLI_getRssi());
-#ifndef DISABLE_ARQ                
-                if (brflag == 0 && seqNum != L2_msg_getSeq(dataPtr))
-                    debug("[L3][WARNING] Invalid PDU SN (%i) while (%i) is required! discarding it...\n", L2_msg_getSeq(dataPtr), seqNum);
-                else
+            //a delayed ACK whose time is up goes before new DATA
+            if (event < L2_event_dataTxDone && (peer = L2_arq_getAckDue()) != NULL)
+            {
+                L2_arq_sendAck(peer);
+                main_state = L2STATE_TX;
+                return 1;
+            }
 #endif
-                    L2_aggregateData(dataPtr, srcId, size, brflag, flag_end);
-
+            if (event < L2_event_dataTxDone && L2_sendNack())
+            {
+                main_state = L2STATE_TX;
+                return 1;
+            }
 
-#ifdef DISABLE_ARQ
-                main_state = L2STATE_IDLE;
-#else
-                if (brflag)
-                {
-                    main_state = L2STATE_IDLE;
-                }
-                else
+            switch (event)
+            {
+                case L2_event_reconfigSrcId: //if src id reconfiguration is requested
                 {
-                    //ACK transmission
-                    if (brflag == 0 && seqNum == L2_msg_getSeq(dataPtr))
-                        seqNum = (seqNum + 1)%L2_MSSG_MAX_SEQNUM;
-                    L2_msg_encodeAck(arqAck, L2_msg_getSeq(dataPtr));
-                    L2_LLI_sendData(arqAck, L2_MSG_ACKSIZE, srcId);
+                    int res;
+                    res = L2_LLI_configSrcId(reqestedId);
 
-                    main_state = L2STATE_TX; //goto TX state
+                    L3_LLI_reconfigSrcIdCnf(res==0);
+                    main_state = L2STATE_IDLE; //goto TX state
+                    L2_event_clearEventFlag(L2_event_reconfigSrcId);
+                    break;
                 }
-#endif
-                L2_event_clearEventFlag(L2_event_dataRcvd);
-            }
-            else if (L2_event_checkEventFlag(L2_event_dataToSend)) //if data needs to be sent (keyboard input)
-            {
-                //msg header setting
-                pduSize = L2_msg_encodeData(arqPdu, sduIn, seqNum, sduLen, L2_event_checkEventFlag(L2_event_dataToSendBuffer) == 0);
-                L2_LLI_sendData(arqPdu, pduSize, destL2ID);
 
+                case L2_event_dataRcvd: //if data reception event happens
+                    if (L2_handleDataRcvd())
+                        main_state = L2STATE_TX; //goto TX state
+
+                    L2_event_clearEventFlag(L2_event_dataRcvd);
+                    break;
+
+                case L2_event_ackTimeout: //a delayed ACK found no DATA PDU to ride on, or a NACK is due
 #ifndef DISABLE_ARQ
-                //Setting ARQ parameter 
-                if (destL2ID != L2_BROADCAST_ID)
-                    seqNum = (seqNum + 1)%L2_MSSG_MAX_SEQNUM;
-                retxCnt = 0;
+                    L2_arq_markAckDue();
 #endif
-                debug_if(DBGMSG_L2, "[L2] sending to %i (seq:%i)\n", destL2ID, (seqNum-1)%L2_MSSG_MAX_SEQNUM);
-
-                main_state = L2STATE_TX;
+                    L2_mcast_markNackDue();
+                    L2_deliverBroadcast();
+                    L2_event_clearEventFlag(L2_event_ackTimeout);
+                    break;
 
-                L2_event_clearEventFlag(L2_event_dataToSend);
-            }
-            else if (L2_event_checkEventFlag(L2_event_dataToSendBuffer))
-            {
-                L2_event_setEventFlag(L2_event_dataToSend);
+                case L2_event_dataToSend: //if data needs to be sent (keyboard input)
+                    if ((peer = L2_selectPeer()) != NULL)
+                    {
+                        L2_sendPdu(peer);
+                        main_state = L2STATE_TX;
+                    }
+                    else
+                    {
+                        //every accepted SDU is fully segmented
+                        L2_event_clearEventFlag(L2_event_dataToSend);
+                    }
+                    break;
 
-                if (L2_pullSduBuffer(L2_MSG_MAXDATASIZE) == 0)
-                    L2_event_clearEventFlag(L2_event_dataToSendBuffer);
-            }
 #ifndef DISABLE_ARQ
-            //ignore events (arqEvent_dataTxDone, arqEvent_ackTxDone, arqEvent_ackRcvd, arqEvent_arqTimeout)
-            else if (L2_event_checkEventFlag(L2_event_dataTxDone)) //if data needs to be sent (keyboard input)
-            {
-                debug_if(DBGMSG_L2, "[L2][WARNING] cannot happen in IDLE state (event %i)\n", L2_event_dataTxDone);
-                L2_event_clearEventFlag(L2_event_dataTxDone);
-            }
-            else if (L2_event_checkEventFlag(L2_event_ackTxDone)) //if data needs to be sent (keyboard input)
-            {
-                debug_if(DBGMSG_L2, "[L2][WARNING] cannot happen in IDLE state (event %i)\n", L2_event_ackTxDone);
-                L2_event_clearEventFlag(L2_event_ackTxDone);
-            }
-            else if (L2_event_checkEventFlag(L2_event_dataTxDone)) //if data needs to be sent (keyboard input)
-            {
-                debug_if(DBGMSG_L2, "[L2][WARNING] cannot happen in IDLE state (event %i)\n", L2_event_ackRcvd);
-                L2_event_clearEventFlag(L2_event_ackRcvd);
-            }
-            else if (L2_event_checkEventFlag(L2_event_arqTimeout)) //if data needs to be sent (keyboard input)
-            {
-                debug_if(DBGMSG_L2, "[WARNING] cannot happen in IDLE state (event %i)\n", L2_event_arqTimeout);
-                L2_event_clearEventFlag(L2_event_arqTimeout);
-            }   
+                //ignore events (arqEvent_dataTxDone, arqEvent_ackTxDone, arqEvent_ackRcvd, arqEvent_arqTimeout)
+                case L2_event_dataTxDone:
+                case L2_event_ackTxDone:
+                case L2_event_ackRcvd: //late/duplicated ACK
+                case L2_event_arqTimeout:
+                    debug_if(DBGMSG_L2, "[L2][WARNING] cannot happen in IDLE state (event %i)\n", event);
+                    L2_event_clearEventFlag((L2_event_e)event);
+                    break;
 #endif
+
+                default:
+                    return 0;
+            }
             break;
 
         case L2STATE_TX: //TX state description
 
-#ifndef DISABLE_ARQ
-            if (L2_event_checkEventFlag(L2_event_ackTxDone)) //data TX finished
+            switch (L2_event_getEvent(L2_EVENTS_TX))
             {
-                if (L2_timer_getTimerStatus() == 1 ||
-                    L2_event_checkEventFlag(L2_event_arqTimeout))
-                {
-                    main_state = L2STATE_ACK;
-                }
-                else
-                {
-                    main_state = L2STATE_IDLE;
-                }
-
-                L2_event_clearEventFlag(L2_event_ackTxDone);
-            }
-            else 
+#ifndef DISABLE_ARQ
+                case L2_event_ackTxDone: //ACK TX finished
+                    main_state = L2_getRestState();
+                    L2_event_clearEventFlag(L2_event_ackTxDone);
+                    break;
 #endif
-            {
-                if (L2_event_checkEventFlag(L2_event_dataTxDone)) //data TX finished
-                {
-#ifdef DISABLE_ARQ
-                    main_state = L2STATE_IDLE;
-                    L3_LLI_dataCnf(1);
-#else
-                    if (destL2ID == L2_BROADCAST_ID)
+
+                case L2_event_dataTxDone: //data TX finished
+#ifndef DISABLE_ARQ
+                    if (burstPeer->id != L2_BROADCAST_ID)
                     {
-                        main_state = L2STATE_IDLE;
-                         L3_LLI_dataCnf(1);
+                        L2_arq_startTimer(burstPeer); //start ARQ timer for retransmission
                     }
                     else
+#endif
+                    if (burstPeer->sduPending && burstPeer->sduOffset == burstPeer->sduLen)
                     {
-                        main_state = L2STATE_ACK;
-                        L2_timer_startTimer(); //start ARQ timer for retransmission
+                        L2_completeSdu(burstPeer, 1);
                     }
-#endif
+
+                    main_state = L2_getRestState();
                     L2_event_clearEventFlag(L2_event_dataTxDone);
-                }
-            }
+                    break;
 
+                default:
+                    return 0;
+            }
             break;
 
 #ifndef DISABLE_ARQ
-        case L2STATE_ACK: //ACK state description
+        case L2STATE_ACK: //ACK state description : segments in flight
 
-            if (L2_event_checkEventFlag(L2_event_ackRcvd)) //data TX finished
+            event = L2_event_getEvent(L2_rxMask(L2_EVENTS_ACK));
+            if (event == L2_EVENT_NONE)
             {
-                uint8_t* dataPtr = L2_LLI_getRcvdDataPtr();
-                if ( L2_msg_getSeq(arqPdu) == L2_msg_getSeq(dataPtr) )
-                {
-                    debug_if(DBGMSG_L2, "[L2] ACK is correctly received! \n");
-                    L2_timer_stopTimer();
-                    main_state = L2STATE_IDLE;
-                    L3_LLI_dataCnf(1);
-                }
-                else
+                if ((peer = L2_arq_getAckDue()) != NULL)
                 {
-                    debug_if(DBGMSG_L2, "[L2]ACK seq number is weird! (expected : %i, received : %i\n", L2_msg_getSeq(arqPdu),L2_msg_getSeq(dataPtr));
+                    L2_arq_sendAck(peer);
+                    main_state = L2STATE_TX;
                 }
-
-                L2_event_clearEventFlag(L2_event_ackRcvd);
-            }
-            else if (L2_event_checkEventFlag(L2_event_arqTimeout)) //data TX finished
-            {
-                if (retxCnt >= L2_ARQ_MAXRETRANSMISSION)
+                else if (L2_sendNack())
                 {
-                    debug("[L2][WARNING] Failed to send data %i, max retx cnt reached! \n", L2_msg_getSeq(arqPdu));
-                    main_state = L2STATE_IDLE;
-                    L3_LLI_dataCnf(0);
-                    //arqPdu clear
-                    //retxCnt clear
+                    main_state = L2STATE_TX;
                 }
-                else //retx < max, then goto TX for retransmission
+                else if ((peer = L2_selectPeer()) != NULL) //window is open or retransmission is due
                 {
-                    debug_if(DBGMSG_L2, "[L2] timeout! retransmit\n");
-                    L2_LLI_sendData(arqPdu, pduSize, destL2ID);
-                    //Setting ARQ parameter 
-                    retxCnt += 1;
+                    L2_sendPdu(peer);
                     main_state = L2STATE_TX;
                 }
-
-                L2_event_clearEventFlag(L2_event_arqTimeout);
-            }
-            else if (L2_event_checkEventFlag(L2_event_dataRcvd)) //data TX finished
-            {
-                //Retrieving data info.
-                uint8_t srcId = L2_LLI_getSrcId();
-                uint8_t* dataPtr = L2_LLI_getRcvdDataPtr();
-                uint8_t size = L2_LLI_getSize();
-                uint8_t brflag = L2_LLI_getIsBroadcasted();
-                uint8_t flag_end = L2_msg_checkIfEndData(dataPtr);
-
-                //L3_LLI_dataInd(L2_msg_getWord(dataPtr), srcId, size-L2_MSG_OFFSET_DATA, L2_LLI_getSnr(), L2_LLI_getRssi());
-#ifndef DISABLE_ARQ                
-                if (brflag == 0 && seqNum != L2_msg_getSeq(dataPtr))
-                    debug("[L3][WARNING] Invalid PDU SN (%i) while (%i) is required! discarding it...\n", L2_msg_getSeq(dataPtr), seqNum);
                 else
-#endif
-                    L2_aggregateData(dataPtr, srcId, size, brflag, flag_end);            
-
-#ifdef DISABLE_ARQ
-                main_state = L2STATE_IDLE;
-#else
-                if (brflag)
                 {
-                    main_state = L2STATE_IDLE;
+                    return 0;
                 }
-                else
+                break;
+            }
+
+            switch (event)
+            {
+                case L2_event_ackRcvd: //ACK from a neighbor
                 {
-                    //ACK transmission
-                    if (brflag == 0 && seqNum == L2_msg_getSeq(dataPtr))
-                        seqNum = (seqNum + 1)%L2_MSSG_MAX_SEQNUM;
-                    L2_msg_encodeAck(arqAck, L2_msg_getSeq(dataPtr));
-                    L2_LLI_sendData(arqAck, L2_MSG_ACKSIZE, srcId);
+                    uint8_t* dataPtr = L2_LLI_getRcvdDataPtr();
+
+                    if ((peer = L2_peer_find(L2_LLI_getSrcId())) != NULL)
+                    {
+                        L2_arq_updateMss(peer, L2_msg_getAckMss(dataPtr, L2_LLI_getSize()));
+                        L2_arq_processAck(peer, L2_msg_getSeq(dataPtr), L2_msg_getAckMap(dataPtr), L2_msg_getAckMapBits(dataPtr));
+                    }
 
-                    main_state = L2STATE_TX; //goto TX state
+                    main_state = L2_getRestState();
+                    L2_event_clearEventFlag(L2_event_ackRcvd);
+                    break;
                 }
-#endif
-                L2_event_clearEventFlag(L2_event_dataRcvd);
-            }
-            else if (L2_event_checkEventFlag(L2_event_dataTxDone)) //data TX finished
-            {
-                debug_if(DBGMSG_L2, "[L2][WARNING] cannot happen in ACK state (event %i)\n", L2_event_dataTxDone);
-                L2_event_clearEventFlag(L2_event_dataTxDone);
-            }
-            else if (L2_event_checkEventFlag(L2_event_ackTxDone)) //data TX finished
-            {
-                debug_if(DBGMSG_L2, "[L2][WARNING] cannot happen in ACK state (event %i)\n", L2_event_ackTxDone);
-                L2_event_clearEventFlag(L2_event_ackTxDone);
-            }
 
+                case L2_event_dataRcvd: //DATA from a neighbor while ours are in flight
+                    if (L2_handleDataRcvd())
+                        main_state = L2STATE_TX;
+                    else
+                        main_state = L2_getRestState(); //a piggybacked ACK may have emptied the window
+
+                    L2_event_clearEventFlag(L2_event_dataRcvd);
+                    break;
+
+                case L2_event_arqTimeout: //retransmission timer of one or more neighbors
+                    L2_event_clearEventFlag(L2_event_arqTimeout);
+
+                    for (uint8_t i = 0; i < L2_MAXPEERS; i++)
+                    {
+                        if ((peer = L2_peer_getByIndex(i)) == NULL || L2_timer_checkExpired(L2_TIMER_ARQ(i)) == 0)
+                            continue;
+
+                        debug_if(DBGMSG_L2, "[L2] timeout for %i (RTO %i ms)\n", peer->id, (int)peer->rto);
+                        L2_peer_backoffRto(peer);
+                        if (peer == burstPeer)
+                            burstPeer = NULL;
+
+                        if (L2_arq_handleTimeout(peer))
+                        {
+                            L2_arq_abortSdu(peer);
+                            L2_completeSdu(peer, 0);
+                        }
+                    }
+
+                    main_state = L2_getRestState();
+                    break;
+
+                case L2_event_ackTimeout: //a delayed ACK found no DATA PDU to ride on, or a NACK is due
+                    L2_arq_markAckDue();
+                    L2_mcast_markNackDue();
+                    L2_deliverBroadcast();
+                    L2_event_clearEventFlag(L2_event_ackTimeout);
+                    break;
+
+                case L2_event_dataTxDone:
+                case L2_event_ackTxDone:
+                    debug_if(DBGMSG_L2, "[L2][WARNING] cannot happen in ACK state (event %i)\n", event);
+                    L2_event_clearEventFlag((L2_event_e)event);
+                    break;
+
+                default:
+                    return 0;
+            }
             break;
 #endif
         default :
+            return 0;
+    }
+
+    return 1;
+}
+
+//handles pending events in priority order, up to L2_FSM_EVENTBUDGET of them per call
+//the pass ends with the first SDU given to L3, which has room for one until its FSM runs
+//returns the number handled, a held SDU given to L3 included (0 : nothing to do until the next event)
+uint8_t L2_FSMrun(void)
+{
+    uint8_t handled;
+
+    L2_event_countPass();
+
+    sduDelivered = 0;
+#ifndef DISABLE_ARQ
+    if (ucastHeld)
+        L2_arq_resume();
+#endif
+    if (bcastHeld)
+        L2_deliverBroadcast();
+
+    for (handled = 0; handled < L2_FSM_EVENTBUDGET && sduDelivered == 0; handled++)
+    {
+        if (L2_FSMstep() == 0)
             break;
     }
 
-}
\ No newline at end of file
+    return handled + sduDelivered;
+}
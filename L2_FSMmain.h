@@ -1,2 +1,6 @@
 void L2_initFSM(uint8_t myId);
-void L2_FSMrun(void);
\ No newline at end of file
+uint8_t L2_FSMrun(void);
+void L2_configArqWindow(uint8_t size);
+void L2_configMss(uint8_t mss);
+void L2_configAckDelay(uint16_t delay);
+uint32_t L2_getTxCopiedBytes(void);
\ No newline at end of file
@@ -5,25 +5,52 @@
 #include "protocol_parameters.h"
 #include "time.h"
 
-#define L2_LLI_MAX_PDUSIZE          50
+#define L2_LLI_MAX_PDUSIZE          L2_MSG_MAXPDUSIZE
 #define L2_LLI_PKT_LOSS             0
 
+#if (L2_LLI_RXQSIZE & (L2_LLI_RXQSIZE - 1)) != 0 || L2_LLI_RXQSIZE > 128
+#error "L2_LLI_RXQSIZE must be a power of 2, at most 128"
+#endif
+
 static uint8_t txType;
-static uint8_t rcvdData[L2_LLI_MAX_PDUSIZE];
-static uint8_t rcvdSrc;
-static uint8_t rcvdSize;
+
+//received frame with its reception metadata
+typedef struct {
+    uint8_t data[L2_LLI_MAX_PDUSIZE];
+    uint8_t src;
+    uint8_t size;
+    uint8_t br;
+    int16_t rssi;
+    int8_t snr;
+} L2_LLI_rxFrame_t;
+
+//frames from the PHY callback (producer) to the FSM (consumer), lock-free :
+//rxqHead is only written by L2_LLI_dataIndFunc, rxqTail only by L2_LLI_fetchFrame
+//both count up freely, a slot is (count % L2_LLI_RXQSIZE)
+static L2_LLI_rxFrame_t rxq[L2_LLI_RXQSIZE];
+static volatile uint8_t rxqHead = 0;
+static volatile uint8_t rxqTail = 0;
+static volatile uint32_t rxqOverflow = 0;   //frames dropped for a full queue
+
+//frame the FSM is handling (oldest of the queue), NULL if none
+static L2_LLI_rxFrame_t* rcvdFrame = NULL;
+static L2_event_e rcvdEvent;
 static int16_t rcvdRssi;
 static int8_t rcvdSnr;
-static uint8_t isBroadcasted;
+
+//PDU refused by a busy PHY, requested again by L2_LLI_retrySend
+static uint8_t* retryMsg = NULL;
+static uint8_t retrySize;
+static uint8_t retryDest;
 
 //interface event : DATA_CNF, TX done event
-void L2_LLI_dataCnfFunc(int err) 
+void L2_LLI_dataCnfFunc(int)
 {
     if (txType == L2_MSG_TYPE_DATA || txType == L2_MSG_TYPE_DATA_CONT)
     {
         L2_event_setEventFlag(L2_event_dataTxDone);
     }
-    else if (txType == L2_MSG_TYPE_ACK)
+    else if (txType == L2_MSG_TYPE_ACK || txType == L2_MSG_TYPE_BLOCKACK || txType == L2_MSG_TYPE_NACK)
     {
         L2_event_setEventFlag(L2_event_ackTxDone);
     }
@@ -32,26 +59,49 @@ void L2_LLI_dataCnfFunc(int err)
 //interface event : DATA_IND, RX data has arrived
 void L2_LLI_dataIndFunc(uint8_t srcId, uint8_t* dataPtr, uint8_t size, uint8_t BR)
 {
+    if (size == 0)
+        return;
+
     debug_if(DBGMSG_L2, "\n[L2]  --> DATA IND : src:%i, size:%i type : %i BR : %i\n", srcId, size, dataPtr[0], BR);
 
+    if (size > L2_LLI_MAX_PDUSIZE)
+    {
+        debug("[L2] PDU from %i is too large (%i bytes), dropped\n", srcId, size);
+        return;
+    }
+
+    if (L2_msg_checkIfData(dataPtr) == 0 && L2_msg_checkIfAck(dataPtr) == 0 && L2_msg_checkIfNack(dataPtr) == 0)
+        return;
+
+    //the FSM reads the header fields and subtracts the header size without checking again
+    if (size < L2_msg_getMinSize(dataPtr))
+    {
+        debug_if(DBGMSG_L2, "[L2] PDU from %i is shorter than its header (%i bytes), dropped\n", srcId, size);
+        return;
+    }
+
     if ((float)rand()/RAND_MAX > L2_LLI_PKT_LOSS)
     {
-        memcpy(rcvdData, dataPtr, size*sizeof(uint8_t));
-        rcvdSrc = srcId;
-        rcvdSize = size;
-        rcvdSnr = phymac_getDataSnr();
-        rcvdRssi = phymac_getDataRssi();
-        isBroadcasted = BR;
-
-        //ready for ACK TX
-        if (L2_msg_checkIfData(dataPtr))
-        {
-            L2_event_setEventFlag(L2_event_dataRcvd);
-        }
-        else if (L2_msg_checkIfAck(dataPtr))
+        L2_LLI_rxFrame_t* frame;
+
+        if ((uint8_t)(rxqHead - rxqTail) == L2_LLI_RXQSIZE)
         {
-            L2_event_setEventFlag(L2_event_ackRcvd);
+            core_util_atomic_incr_u32(&rxqOverflow, 1);
+            debug_if(DBGMSG_L2, "[L2] RX queue is full, PDU from %i dropped\n", srcId);
+            return;
         }
+
+        frame = &rxq[rxqHead % L2_LLI_RXQSIZE];
+        memcpy(frame->data, dataPtr, size*sizeof(uint8_t));
+        frame->src = srcId;
+        frame->size = size;
+        frame->snr = phymac_getDataSnr();
+        frame->rssi = phymac_getDataRssi();
+        frame->br = BR;
+
+        //published once filled : the FSM picks it up in L2_LLI_fetchFrame
+        core_util_atomic_incr_u8(&rxqHead, 1);
+        L2_event_post();
     }
     else
     {
@@ -72,8 +122,59 @@ void L2_LLI_initLowLayer(uint8_t srcId)
 //TX function
 void L2_LLI_sendData(uint8_t* msg, uint8_t size, uint8_t dest)
 {
-    phymac_dataReq(msg, size, dest);
-    txType = msg[L2_MSG_OFFSET_TYPE];
+    int res;
+
+    txType = msg[L2_MSG_OFFSET_TYPE] & L2_MSG_TYPE_MASK;
+    retryMsg = NULL;
+
+    if ((res = phymac_dataReq(msg, size, dest)) == PHYMAC_ERR_WRONGSTATE)
+    {
+        debug_if(DBGMSG_L2, "[L2] PHY is busy, PDU to %i will be retried\n", dest);
+        retryMsg = msg;
+        retrySize = size;
+        retryDest = dest;
+    }
+    else if (res != PHYMAC_ERR_NONE)
+    {
+        //the PDU is lost (ARQ recovers unicast ones), but the FSM must not wait for a TX done that never comes
+        debug("[L2] Failed to send PDU to %i (cause : %i)\n", dest, res);
+        L2_LLI_dataCnfFunc(res);
+    }
+}
+
+//the FSM is done with a frame once it clears the frame's event : the next queued frame
+//then becomes the current one and raises dataRcvd or ackRcvd
+void L2_LLI_fetchFrame(void)
+{
+    if (rcvdFrame != NULL)
+    {
+        if (L2_event_checkEventFlag(rcvdEvent))
+            return;
+
+        rcvdFrame = NULL;
+        core_util_atomic_incr_u8(&rxqTail, 1);
+    }
+
+    if (rxqTail == rxqHead)
+        return;
+
+    rcvdFrame = &rxq[rxqTail % L2_LLI_RXQSIZE];
+    rcvdRssi = rcvdFrame->rssi;
+    rcvdSnr = rcvdFrame->snr;
+    rcvdEvent = L2_msg_checkIfAck(rcvdFrame->data) ? L2_event_ackRcvd : L2_event_dataRcvd;  //NACKs are handled as DATA
+    L2_event_setEventFlag(rcvdEvent);
+}
+
+uint32_t L2_LLI_getRxOverflow(void)
+{
+    return rxqOverflow;
+}
+
+//requests again a PDU that the PHY refused for being busy
+void L2_LLI_retrySend(void)
+{
+    if (retryMsg != NULL)
+        L2_LLI_sendData(retryMsg, retrySize, retryDest);
 }
 
 
@@ -89,17 +190,17 @@ int L2_LLI_configSrcId(uint8_t srcId)
 //GET functions
 uint8_t L2_LLI_getSrcId()
 {
-    return rcvdSrc;
+    return rcvdFrame->src;
 }
 
 uint8_t* L2_LLI_getRcvdDataPtr()
 {
-    return rcvdData;
+    return rcvdFrame->data;
 }
 
 uint8_t L2_LLI_getSize()
 {
-    return rcvdSize;
+    return rcvdFrame->size;
 }
 
 
@@ -115,5 +216,5 @@ int8_t L2_LLI_getSnr(void)
 
 uint8_t L2_LLI_getIsBroadcasted(void)
 {
-    return isBroadcasted;
+    return rcvdFrame->br;
 }
\ No newline at end of file
@@ -1,5 +1,8 @@
 void L2_LLI_initLowLayer(uint8_t srcId);
 void L2_LLI_sendData(uint8_t* msg, uint8_t size, uint8_t dest);
+void L2_LLI_retrySend(void);
+void L2_LLI_fetchFrame(void);
+uint32_t L2_LLI_getRxOverflow(void);
 int L2_LLI_configSrcId(uint8_t);
 uint8_t L2_LLI_getSrcId();
 uint8_t* L2_LLI_getRcvdDataPtr();
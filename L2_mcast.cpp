@@ -0,0 +1,393 @@
+#include "mbed.h"
+#include "L2_mcast.h"
+#include "L2_msg.h"
+#include "L2_reasm.h"
+#include "L2_timer.h"
+#include "protocol_parameters.h"
+
+#if L2_MCAST_WINDOW < 1 || L2_MCAST_WINDOW > 8
+#error "L2_MCAST_WINDOW must be between 1 and 8 (one NACK map)"
+#endif
+#if L2_MCAST_HISTORY < L2_MCAST_WINDOW || (L2_MCAST_HISTORY & (L2_MCAST_HISTORY - 1)) != 0
+#error "L2_MCAST_HISTORY must be a power of 2, at least L2_MCAST_WINDOW"
+#endif
+
+//reliable broadcast : the sender numbers its broadcast PDUs and keeps the last ones,
+//receivers put them back in order and NACK the holes after a random backoff (a NACK overheard
+//for the same holes holds theirs back), and the sender repeats each NACKed PDU once for everyone
+//an unordered PDU (a whole SDU, such as a beacon) is handed out as soon as it arrives
+
+//sender : last broadcast PDUs, by slot (seq % L2_MCAST_HISTORY)
+static uint8_t histPdu[L2_MCAST_HISTORY][L2_MSG_MAXPDUSIZE];
+static uint8_t histSize[L2_MCAST_HISTORY];
+static uint32_t histTime[L2_MCAST_HISTORY];     //ms, last (re)transmission
+static uint16_t histCnt = 0;
+static uint8_t histNext;                        //sequence number of the next PDU
+static uint32_t repairReq[(L2_MCAST_HISTORY + 31)/32];
+
+//receiver : broadcast PDUs of one sender, [seq, top) received or missing
+typedef struct {
+    uint8_t used;
+    uint8_t srcId;
+    uint32_t lastUse;
+    uint8_t seq;            //next PDU for reassembly
+    uint8_t top;            //one past the newest PDU received
+    uint8_t buffered;       //by slot (seq % L2_MCAST_WINDOW)
+    uint8_t delivered;      //buffered slots already handed out ahead of a hole
+    uint8_t pdu[L2_MCAST_WINDOW][L2_MSG_MAXPDUSIZE];
+    uint8_t pduSize[L2_MCAST_WINDOW];
+    uint8_t nackCnt;        //NACKs sent for the hole at seq
+    uint8_t nackDue;
+    uint8_t giveUp;         //the hole at seq is skipped
+} L2_mcastRx_t;
+
+static L2_mcastRx_t rxTable[L2_MCAST_MAXSOURCES];
+static uint32_t useCnt = 0;
+static L2_mcastStats_t mcastStats;
+
+
+static uint32_t L2_mcast_now(void)
+{
+    return us_ticker_read()/1000;
+}
+
+void L2_mcast_init(void)
+{
+    histCnt = 0;
+    memset(repairReq, 0, sizeof(repairReq));
+    memset(rxTable, 0, sizeof(rxTable));
+    useCnt = 0;
+    memset(&mcastStats, 0, sizeof(mcastStats));
+}
+
+
+//sender functions ---------------------------
+//the broadcast PDU just sent is kept for NACKs (PDUs come with consecutive sequence numbers)
+void L2_mcast_store(uint8_t* pdu, uint8_t size)
+{
+    uint8_t seq = L2_msg_getSeq(pdu);
+    uint8_t slot = seq % L2_MCAST_HISTORY;
+
+    if (histCnt == 0 || seq != histNext)
+        histCnt = 0;    //new sequence : older PDUs cannot be asked for any more
+    if (histCnt < L2_MCAST_HISTORY)
+        histCnt++;
+
+    memcpy(histPdu[slot], pdu, size);
+    histSize[slot] = size;
+    histTime[slot] = L2_mcast_now();
+    repairReq[slot/32] &= ~(1UL << (slot%32));
+    histNext = seq + 1;
+}
+
+//NACK for our broadcast PDUs : those still kept and not repeated lately are scheduled
+//returns 1 if any was
+uint8_t L2_mcast_handleNack(uint8_t* nack)
+{
+    uint8_t seq = L2_msg_getNackSeq(nack);
+    uint8_t nackMap = L2_msg_getNackMap(nack);
+    uint8_t scheduled = 0;
+    uint32_t now = L2_mcast_now();
+
+    for (uint8_t i = 0; i < 8; i++, seq++)
+    {
+        uint8_t slot = seq % L2_MCAST_HISTORY;
+
+        if ((nackMap & (1 << i)) == 0 || (uint8_t)(histNext - seq - 1) >= histCnt)
+            continue;
+        if (now - histTime[slot] < L2_MCAST_REPAIRHOLDOFF)
+            continue;   //already repeated for another receiver, the repair is on its way
+
+        repairReq[slot/32] |= (1UL << (slot%32));
+        scheduled = 1;
+    }
+
+    return scheduled;
+}
+
+uint8_t L2_mcast_checkRepair(void)
+{
+    for (uint8_t i = 0; i < sizeof(repairReq)/sizeof(repairReq[0]); i++)
+    {
+        if (repairReq[i] != 0)
+            return 1;
+    }
+
+    return 0;
+}
+
+//oldest PDU to repeat, NULL if none : it stays valid until the next L2_mcast_store
+uint8_t* L2_mcast_getRepair(uint8_t* size)
+{
+    for (uint8_t seq = histNext - histCnt; seq != histNext; seq++)
+    {
+        uint8_t slot = seq % L2_MCAST_HISTORY;
+
+        if ((repairReq[slot/32] & (1UL << (slot%32))) == 0)
+            continue;
+
+        repairReq[slot/32] &= ~(1UL << (slot%32));
+        histTime[slot] = L2_mcast_now();
+        mcastStats.repaired++;
+
+        *size = histSize[slot];
+        return histPdu[slot];
+    }
+
+    return NULL;
+}
+
+
+//receiver functions ---------------------------
+static L2_mcastRx_t* L2_mcast_find(uint8_t srcId)
+{
+    for (int i = 0; i < L2_MCAST_MAXSOURCES; i++)
+    {
+        if (rxTable[i].used && rxTable[i].srcId == srcId)
+            return &rxTable[i];
+    }
+
+    return NULL;
+}
+
+static uint8_t L2_mcast_getIndex(L2_mcastRx_t* rx)
+{
+    return rx - rxTable;
+}
+
+//bit i : PDU (seq + i) is missing
+static uint8_t L2_mcast_getHoles(L2_mcastRx_t* rx)
+{
+    uint8_t holes = 0;
+
+    for (uint8_t i = 0; i < (uint8_t)(rx->top - rx->seq); i++)
+    {
+        if ((rx->buffered & (1 << ((rx->seq + i) % L2_MCAST_WINDOW))) == 0)
+            holes |= (1 << i);
+    }
+
+    return holes;
+}
+
+//the receiver starts over at seq : what it held is dropped
+static void L2_mcast_resync(L2_mcastRx_t* rx, uint8_t seq)
+{
+    if (rx->used)
+        L2_reasm_drop(rx->srcId, 1);
+
+    rx->seq = rx->top = seq;
+    rx->buffered = 0;
+    rx->delivered = 0;
+    rx->nackCnt = 0;
+    rx->nackDue = 0;
+    rx->giveUp = 0;
+    L2_timer_stopTimer(L2_TIMER_NACK(L2_mcast_getIndex(rx)));
+}
+
+//NACK timer : a hole stays, NACK it (or NACK it again)
+static void L2_mcast_startNackTimer(L2_mcastRx_t* rx, uint32_t wait)
+{
+    L2_timer_startTimer(L2_TIMER_NACK(L2_mcast_getIndex(rx)), wait + rand()%(L2_MCAST_NACKJITTER + 1));
+}
+
+//starts or stops the NACK timer after the holes changed
+static void L2_mcast_updateHoles(L2_mcastRx_t* rx)
+{
+    uint8_t idx = L2_TIMER_NACK(L2_mcast_getIndex(rx));
+
+    if (rx->top == rx->seq)
+    {
+        rx->nackCnt = 0;
+        rx->nackDue = 0;
+        rx->giveUp = 0;
+        L2_timer_stopTimer(idx);
+    }
+    else if (L2_timer_getTimerStatus(idx) == 0 && rx->nackDue == 0 && rx->giveUp == 0)
+    {
+        L2_mcast_startNackTimer(rx, L2_MCAST_NACKDELAY);
+    }
+}
+
+//receive context of the sender, replacing the least recently used one if the table is full
+static L2_mcastRx_t* L2_mcast_get(uint8_t srcId, uint8_t seq)
+{
+    L2_mcastRx_t* rx = L2_mcast_find(srcId);
+
+    if (rx == NULL)
+    {
+        rx = &rxTable[0];
+        for (int i = 0; i < L2_MCAST_MAXSOURCES; i++)
+        {
+            if (rxTable[i].used == 0)
+            {
+                rx = &rxTable[i];
+                break;
+            }
+            if (rxTable[i].lastUse < rx->lastUse)
+                rx = &rxTable[i];
+        }
+
+        L2_mcast_resync(rx, seq);
+        rx->used = 1;
+        rx->srcId = srcId;
+    }
+
+    rx->lastUse = ++useCnt;
+    return rx;
+}
+
+//buffers a broadcast DATA PDU, L2_mcast_getDeliverable then hands out what may go up
+void L2_mcast_receive(uint8_t srcId, uint8_t* pdu, uint8_t size)
+{
+    uint8_t seq = L2_msg_getSeq(pdu);
+    L2_mcastRx_t* rx = L2_mcast_get(srcId, seq);
+    uint8_t slot;
+
+    //beyond the window and not a late repeat : the sender restarted its sequence, or more was lost
+    //than the window holds, either way the receiver starts over from this PDU
+    if ((uint8_t)(seq - rx->seq) >= L2_MCAST_WINDOW && (uint8_t)(rx->seq - seq) > L2_MCAST_HISTORY)
+    {
+        debug_if(DBGMSG_L2, "[L2] broadcast sequence of %i restarts at %i (%i was required)\n", srcId, seq, rx->seq);
+        mcastStats.lost += (uint8_t)(seq - rx->seq);
+        L2_mcast_resync(rx, seq);
+    }
+
+    if ((uint8_t)(seq - rx->seq) >= L2_MCAST_WINDOW)
+        return;     //duplicate of a PDU already handed out
+
+    slot = seq % L2_MCAST_WINDOW;
+    if ((rx->buffered & (1 << slot)) == 0)
+    {
+        memcpy(rx->pdu[slot], pdu, size);
+        rx->pduSize[slot] = size;
+        rx->buffered |= (1 << slot);
+    }
+    if ((uint8_t)(seq - rx->seq) >= (uint8_t)(rx->top - rx->seq))
+        rx->top = seq + 1;
+}
+
+//next broadcast PDU of any sender that may go up : in sequence, or unordered past a hole
+//NULL once each sender is at a hole (or has none left), a hole given up on is skipped with the rest of its SDU
+uint8_t* L2_mcast_getDeliverable(uint8_t* srcId, uint8_t* size)
+{
+    for (uint8_t i = 0; i < L2_MCAST_MAXSOURCES; i++)
+    {
+        L2_mcastRx_t* rx = &rxTable[i];
+        uint8_t slot;
+
+        while (rx->used && rx->seq != rx->top)
+        {
+            slot = rx->seq % L2_MCAST_WINDOW;
+
+            if (rx->buffered & (1 << slot))
+            {
+                rx->buffered &= ~(1 << slot);
+                rx->seq++;
+                rx->nackCnt = 0;
+                rx->giveUp = 0;
+
+                //gone up already : a whole SDU, so whatever was dropped before it is over
+                if (rx->delivered & (1 << slot))
+                {
+                    rx->delivered &= ~(1 << slot);
+                    L2_reasm_drop(rx->srcId, 1);
+                    continue;
+                }
+
+                *srcId = rx->srcId;
+                *size = rx->pduSize[slot];
+                return rx->pdu[slot];
+            }
+            if (rx->giveUp == 0)
+                break;
+
+            debug("[L2][WARNING] broadcast PDU %i from %i is lost\n", rx->seq, rx->srcId);
+            L2_reasm_skip(rx->srcId, 1);
+            mcastStats.lost++;
+            rx->seq++;
+        }
+
+        if (rx->used == 0)
+            continue;
+
+        L2_mcast_updateHoles(rx);
+        for (uint8_t seq = rx->seq + 1; seq != rx->top; seq++)
+        {
+            slot = seq % L2_MCAST_WINDOW;
+
+            if ((rx->buffered & ~rx->delivered & (1 << slot)) && L2_msg_checkIfUnordered(rx->pdu[slot]))
+            {
+                rx->delivered |= (1 << slot);
+
+                *srcId = rx->srcId;
+                *size = rx->pduSize[slot];
+                return rx->pdu[slot];
+            }
+        }
+    }
+
+    return NULL;
+}
+
+//NACK of another receiver : if it covers our holes, ours waits for the repair it will bring
+void L2_mcast_overhearNack(uint8_t* nack)
+{
+    L2_mcastRx_t* rx = L2_mcast_find(L2_msg_getNackSrc(nack));
+    uint8_t holes;
+    uint8_t shift;
+
+    if (rx == NULL || (holes = L2_mcast_getHoles(rx)) == 0)
+        return;
+
+    shift = rx->seq - L2_msg_getNackSeq(nack);
+    if (shift >= 8 || (holes & ~(L2_msg_getNackMap(nack) >> shift)) != 0)
+        return;
+
+    if (rx->nackDue || L2_timer_getTimerStatus(L2_TIMER_NACK(L2_mcast_getIndex(rx))))
+        mcastStats.nacksSuppressed++;
+    rx->nackDue = 0;
+    L2_mcast_startNackTimer(rx, L2_MCAST_NACKRETRY);
+}
+
+//NACK timers that expired : the hole is NACKed, or given up after L2_MCAST_MAXNACKS
+void L2_mcast_markNackDue(void)
+{
+    for (uint8_t i = 0; i < L2_MCAST_MAXSOURCES; i++)
+    {
+        L2_mcastRx_t* rx = &rxTable[i];
+
+        if (L2_timer_checkExpired(L2_TIMER_NACK(i)) == 0 || rx->used == 0 || rx->top == rx->seq)
+            continue;
+
+        if (rx->nackCnt >= L2_MCAST_MAXNACKS)
+            rx->giveUp = 1;     //skipped by the next L2_mcast_getDeliverable
+        else
+            rx->nackDue = 1;
+    }
+}
+
+//builds the NACK of a receive context that owes one, returns its size (0 : none)
+uint8_t L2_mcast_getNackDue(uint8_t* nack)
+{
+    for (uint8_t i = 0; i < L2_MCAST_MAXSOURCES; i++)
+    {
+        L2_mcastRx_t* rx = &rxTable[i];
+
+        if (rx->used == 0 || rx->nackDue == 0)
+            continue;
+
+        rx->nackDue = 0;
+        rx->nackCnt++;
+        mcastStats.nacksSent++;
+        L2_mcast_startNackTimer(rx, L2_MCAST_NACKRETRY);
+
+        return L2_msg_encodeNack(nack, rx->srcId, rx->seq, L2_mcast_getHoles(rx));
+    }
+
+    return 0;
+}
+
+const L2_mcastStats_t* L2_mcast_getStats(void)
+{
+    return &mcastStats;
+}
@@ -0,0 +1,30 @@
+#ifndef L2_MCAST_H
+#define L2_MCAST_H
+
+#include "mbed.h"
+
+typedef struct {
+    uint32_t nacksSent;
+    uint32_t nacksSuppressed;   //NACKs not sent : another receiver asked for the same PDUs
+    uint32_t repaired;          //PDUs repeated for a NACK (sender)
+    uint32_t lost;              //PDUs given up (receiver)
+} L2_mcastStats_t;
+
+void L2_mcast_init(void);
+
+//sender
+void L2_mcast_store(uint8_t* pdu, uint8_t size);
+uint8_t L2_mcast_handleNack(uint8_t* nack);
+uint8_t L2_mcast_checkRepair(void);
+uint8_t* L2_mcast_getRepair(uint8_t* size);
+
+//receivers
+void L2_mcast_receive(uint8_t srcId, uint8_t* pdu, uint8_t size);
+uint8_t* L2_mcast_getDeliverable(uint8_t* srcId, uint8_t* size);
+void L2_mcast_overhearNack(uint8_t* nack);
+void L2_mcast_markNackDue(void);
+uint8_t L2_mcast_getNackDue(uint8_t* nack);
+
+const L2_mcastStats_t* L2_mcast_getStats(void);
+
+#endif
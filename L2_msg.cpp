@@ -3,29 +3,83 @@
 
 int L2_msg_checkIfData(uint8_t* msg)
 {
-    return (msg[L2_MSG_OFFSET_TYPE] == L2_MSG_TYPE_DATA || msg[L2_MSG_OFFSET_TYPE] == L2_MSG_TYPE_DATA_CONT);
+    return ((msg[L2_MSG_OFFSET_TYPE] & L2_MSG_TYPE_MASK) == L2_MSG_TYPE_DATA || (msg[L2_MSG_OFFSET_TYPE] & L2_MSG_TYPE_MASK) == L2_MSG_TYPE_DATA_CONT);
 }
 
 int L2_msg_checkIfEndData(uint8_t* msg)
 {
-    return (msg[L2_MSG_OFFSET_TYPE] == L2_MSG_TYPE_DATA);
+    return ((msg[L2_MSG_OFFSET_TYPE] & L2_MSG_TYPE_MASK) == L2_MSG_TYPE_DATA);
+}
+
+int L2_msg_checkIfAckDefer(uint8_t* msg)
+{
+    return ((msg[L2_MSG_OFFSET_TYPE] & L2_MSG_FLAG_ACKDEFER) != 0);
+}
+
+int L2_msg_checkIfSync(uint8_t* msg)
+{
+    return ((msg[L2_MSG_OFFSET_TYPE] & L2_MSG_FLAG_SYNC) != 0);
+}
+
+int L2_msg_checkIfPiggyAck(uint8_t* msg)
+{
+    return ((msg[L2_MSG_OFFSET_TYPE] & L2_MSG_FLAG_PIGGYACK) != 0);
+}
+
+int L2_msg_checkIfUnordered(uint8_t* msg)
+{
+    return ((msg[L2_MSG_OFFSET_TYPE] & L2_MSG_FLAG_UNORDERED) != 0);
 }
 
 
 int L2_msg_checkIfAck(uint8_t* msg)
 {
-    return (msg[L2_MSG_OFFSET_TYPE] == L2_MSG_TYPE_ACK);
+    return ((msg[L2_MSG_OFFSET_TYPE] & L2_MSG_TYPE_MASK) == L2_MSG_TYPE_ACK || (msg[L2_MSG_OFFSET_TYPE] & L2_MSG_TYPE_MASK) == L2_MSG_TYPE_BLOCKACK);
+}
+
+int L2_msg_checkIfNack(uint8_t* msg)
+{
+    return ((msg[L2_MSG_OFFSET_TYPE] & L2_MSG_TYPE_MASK) == L2_MSG_TYPE_NACK);
 }
 
-uint8_t L2_msg_encodeAck(uint8_t* msg_ack, uint8_t seq)
+static int L2_msg_checkIfBlockAck(uint8_t* msg)
+{
+    return ((msg[L2_MSG_OFFSET_TYPE] & L2_MSG_TYPE_MASK) == L2_MSG_TYPE_BLOCKACK);
+}
+
+uint8_t L2_msg_encodeAck(uint8_t* msg_ack, uint8_t seq, uint8_t ackMap, uint8_t mss)
 {
     msg_ack[L2_MSG_OFFSET_TYPE] = L2_MSG_TYPE_ACK;
     msg_ack[L2_MSG_OFFSET_SEQ] = seq;
-    msg_ack[L2_MSG_OFFSET_DATA] = 1;
+    msg_ack[L2_MSG_OFFSET_ACKMAP] = ackMap;
+    msg_ack[L2_MSG_OFFSET_MSS] = mss;
 
     return L2_MSG_ACKSIZE;
 }
 
+//one ACK for a whole block of segments : bit i of ackMap reports segment (seq - i)
+uint8_t L2_msg_encodeBlockAck(uint8_t* msg_ack, uint8_t seq, uint16_t ackMap, uint8_t mss)
+{
+    msg_ack[L2_MSG_OFFSET_TYPE] = L2_MSG_TYPE_BLOCKACK;
+    msg_ack[L2_MSG_OFFSET_SEQ] = seq;
+    msg_ack[L2_MSG_OFFSET_ACKMAP] = ackMap & 0xFF;
+    msg_ack[L2_MSG_OFFSET_ACKMAP + 1] = ackMap >> 8;
+    msg_ack[L2_MSG_OFFSET_BLOCKMSS] = mss;
+
+    return L2_MSG_BLOCKACKSIZE;
+}
+
+//broadcast PDUs of srcId that this receiver misses : bit i of nackMap asks for (seq + i)
+uint8_t L2_msg_encodeNack(uint8_t* msg_nack, uint8_t srcId, uint8_t seq, uint8_t nackMap)
+{
+    msg_nack[L2_MSG_OFFSET_TYPE] = L2_MSG_TYPE_NACK;
+    msg_nack[L2_MSG_OFFSET_NACKSRC] = srcId;
+    msg_nack[L2_MSG_OFFSET_NACKSEQ] = seq;
+    msg_nack[L2_MSG_OFFSET_NACKMAP] = nackMap;
+
+    return L2_MSG_NACKSIZE;
+}
+
 uint8_t L2_msg_encodeData(uint8_t* msg_data, uint8_t* data, int seq, int len, uint8_t flag_end)
 {
     if (flag_end == 1)
@@ -37,14 +91,110 @@ uint8_t L2_msg_encodeData(uint8_t* msg_data, uint8_t* data, int seq, int len, ui
 
     return len+L2_MSG_OFFSET_DATA;
 }
-                    
+
+//DATA PDU carrying an ACK for the traffic in the other direction
+uint8_t L2_msg_encodeDataAck(uint8_t* msg_data, uint8_t* data, int seq, int len, uint8_t flag_end, uint8_t ackSeq, uint8_t ackMap)
+{
+    msg_data[L2_MSG_OFFSET_TYPE] = ((flag_end == 1) ? L2_MSG_TYPE_DATA : L2_MSG_TYPE_DATA_CONT) | L2_MSG_FLAG_PIGGYACK;
+    msg_data[L2_MSG_OFFSET_SEQ] = seq;
+    msg_data[L2_MSG_OFFSET_PIGGYSEQ] = ackSeq;
+    msg_data[L2_MSG_OFFSET_PIGGYMAP] = ackMap;
+    memcpy(&msg_data[L2_MSG_OFFSET_DATA + L2_MSG_PIGGYACKSIZE], data, len*sizeof(uint8_t));
+
+    return len+L2_MSG_OFFSET_DATA+L2_MSG_PIGGYACKSIZE;
+}
+
+void L2_msg_setAckDefer(uint8_t* msg_data, uint8_t flag)
+{
+    if (flag == 1)
+        msg_data[L2_MSG_OFFSET_TYPE] |= L2_MSG_FLAG_ACKDEFER;
+    else
+        msg_data[L2_MSG_OFFSET_TYPE] &= ~L2_MSG_FLAG_ACKDEFER;
+}
+
+void L2_msg_setSync(uint8_t* msg_data)
+{
+    msg_data[L2_MSG_OFFSET_TYPE] |= L2_MSG_FLAG_SYNC;
+}
+
+void L2_msg_setUnordered(uint8_t* msg_data)
+{
+    msg_data[L2_MSG_OFFSET_TYPE] |= L2_MSG_FLAG_UNORDERED;
+}
+
 
 uint8_t L2_msg_getSeq(uint8_t* msg)
 {
     return msg[L2_MSG_OFFSET_SEQ];
 }
 
+uint16_t L2_msg_getAckMap(uint8_t* msg)
+{
+    if (L2_msg_checkIfBlockAck(msg))
+        return msg[L2_MSG_OFFSET_ACKMAP] | (msg[L2_MSG_OFFSET_ACKMAP + 1] << 8);
+
+    return msg[L2_MSG_OFFSET_ACKMAP];
+}
+
+//bits of the ACK map : 16 for a BLOCKACK, 8 otherwise
+uint8_t L2_msg_getAckMapBits(uint8_t* msg)
+{
+    return L2_msg_checkIfBlockAck(msg) ? 16 : 8;
+}
+
+//MSS advertised in the ACK, 0 if the ACK has none
+uint8_t L2_msg_getAckMss(uint8_t* msg, uint8_t size)
+{
+    uint8_t offset = L2_msg_checkIfBlockAck(msg) ? L2_MSG_OFFSET_BLOCKMSS : L2_MSG_OFFSET_MSS;
+
+    return (size > offset) ? msg[offset] : 0;
+}
+
+uint8_t L2_msg_getNackSrc(uint8_t* msg)
+{
+    return msg[L2_MSG_OFFSET_NACKSRC];
+}
+
+uint8_t L2_msg_getNackSeq(uint8_t* msg)
+{
+    return msg[L2_MSG_OFFSET_NACKSEQ];
+}
+
+uint8_t L2_msg_getNackMap(uint8_t* msg)
+{
+    return msg[L2_MSG_OFFSET_NACKMAP];
+}
+
+uint8_t L2_msg_getPiggyAckSeq(uint8_t* msg)
+{
+    return msg[L2_MSG_OFFSET_PIGGYSEQ];
+}
+
+uint8_t L2_msg_getPiggyAckMap(uint8_t* msg)
+{
+    return msg[L2_MSG_OFFSET_PIGGYMAP];
+}
+
+//DATA : bytes before the payload
+uint8_t L2_msg_getHeaderSize(uint8_t* msg)
+{
+    return L2_msg_checkIfPiggyAck(msg) ? L2_MSG_OFFSET_DATA + L2_MSG_PIGGYACKSIZE : L2_MSG_OFFSET_DATA;
+}
+
+//shortest frame the type and flags allow (the MSS of an ACK is optional)
+uint8_t L2_msg_getMinSize(uint8_t* msg)
+{
+    if (L2_msg_checkIfData(msg))
+        return L2_msg_getHeaderSize(msg);
+    if (L2_msg_checkIfBlockAck(msg))
+        return L2_MSG_OFFSET_BLOCKMSS;
+    if (L2_msg_checkIfAck(msg))
+        return L2_MSG_OFFSET_MSS;
+
+    return L2_MSG_NACKSIZE;
+}
+
 uint8_t* L2_msg_getWord(uint8_t* msg)
 {
-    return &msg[L2_MSG_OFFSET_DATA];
+    return &msg[L2_msg_getHeaderSize(msg)];
 }
\ No newline at end of file
@@ -3,21 +3,65 @@
 #define L2_MSG_TYPE_ACK         0
 #define L2_MSG_TYPE_DATA        1
 #define L2_MSG_TYPE_DATA_CONT   2
+#define L2_MSG_TYPE_BLOCKACK    3           //ACK with a 16 segment map, for windows wider than 8
+#define L2_MSG_TYPE_NACK        4           //broadcast : holes in the broadcast PDUs of a sender
+#define L2_MSG_TYPE_MASK        0x0F
+
+#define L2_MSG_FLAG_ACKDEFER    0x80        //DATA : the sender keeps transmitting, no ACK for this PDU
+#define L2_MSG_FLAG_SYNC        0x40        //DATA : first PDU after a restart of the sender's sequence numbers
+#define L2_MSG_FLAG_PIGGYACK    0x20        //DATA : an ACK (seq, map) precedes the payload
+#define L2_MSG_FLAG_UNORDERED   0x10        //broadcast DATA : a whole SDU that goes up on arrival, even past a hole
 
 #define L2_MSG_OFFSET_TYPE  0
 #define L2_MSG_OFFSET_SEQ   1
 #define L2_MSG_OFFSET_DATA  2
+#define L2_MSG_OFFSET_ACKMAP 2      //ACK : bit i reports the reception of segment (seq - i)
+#define L2_MSG_OFFSET_MSS   3       //ACK : largest DATA payload the sender of the ACK accepts
+#define L2_MSG_OFFSET_PIGGYSEQ  2   //DATA with PIGGYACK : seq and map of the ACK, then the payload
+#define L2_MSG_OFFSET_PIGGYMAP  3
+#define L2_MSG_PIGGYACKSIZE 2
+
+#define L2_MSG_OFFSET_BLOCKMSS  4   //BLOCKACK : the map takes 2 bytes (low byte first)
+
+#define L2_MSG_OFFSET_NACKSRC   1   //NACK : sender of the broadcast PDUs, then the first hole and the map
+#define L2_MSG_OFFSET_NACKSEQ   2
+#define L2_MSG_OFFSET_NACKMAP   3   //NACK : bit i asks for segment (seq + i)
 
-#define L2_MSG_ACKSIZE      3
+#define L2_MSG_ACKSIZE      4
+#define L2_MSG_NACKSIZE     4
+#define L2_MSG_BLOCKACKSIZE 5
 
-#define L2_MSG_MAXDATASIZE  26
-#define L2_MSSG_MAX_SEQNUM  1024
+#define L2_MSG_MAXPDUSIZE   50      //largest frame of the PHY
+#define L2_MSG_MAXMSS       (L2_MSG_MAXPDUSIZE - L2_MSG_OFFSET_DATA - L2_MSG_PIGGYACKSIZE)
+#define L2_MSG_MAXDATASIZE  26      //payload until the neighbor advertises its MSS, and for broadcast
+#define L2_MSSG_MAX_SEQNUM  256     //one byte sequence field
 
 
 int L2_msg_checkIfData(uint8_t* msg);
 int L2_msg_checkIfAck(uint8_t* msg);
+int L2_msg_checkIfNack(uint8_t* msg);
 int L2_msg_checkIfEndData(uint8_t* msg);
-uint8_t L2_msg_encodeAck(uint8_t* msg_ack, uint8_t seq);
+int L2_msg_checkIfAckDefer(uint8_t* msg);
+int L2_msg_checkIfSync(uint8_t* msg);
+int L2_msg_checkIfPiggyAck(uint8_t* msg);
+int L2_msg_checkIfUnordered(uint8_t* msg);
+uint8_t L2_msg_encodeAck(uint8_t* msg_ack, uint8_t seq, uint8_t ackMap, uint8_t mss);
 uint8_t L2_msg_encodeData(uint8_t* msg_data, uint8_t* data, int seq, int len, uint8_t);
+uint8_t L2_msg_encodeBlockAck(uint8_t* msg_ack, uint8_t seq, uint16_t ackMap, uint8_t mss);
+uint8_t L2_msg_encodeNack(uint8_t* msg_nack, uint8_t srcId, uint8_t seq, uint8_t nackMap);
+uint8_t L2_msg_encodeDataAck(uint8_t* msg_data, uint8_t* data, int seq, int len, uint8_t flag_end, uint8_t ackSeq, uint8_t ackMap);
+void L2_msg_setAckDefer(uint8_t* msg_data, uint8_t flag);
+void L2_msg_setSync(uint8_t* msg_data);
+void L2_msg_setUnordered(uint8_t* msg_data);
 uint8_t L2_msg_getSeq(uint8_t* msg);
-uint8_t* L2_msg_getWord(uint8_t* msg);
\ No newline at end of file
+uint16_t L2_msg_getAckMap(uint8_t* msg);
+uint8_t L2_msg_getAckMapBits(uint8_t* msg);
+uint8_t L2_msg_getAckMss(uint8_t* msg, uint8_t size);
+uint8_t L2_msg_getNackSrc(uint8_t* msg);
+uint8_t L2_msg_getNackSeq(uint8_t* msg);
+uint8_t L2_msg_getNackMap(uint8_t* msg);
+uint8_t L2_msg_getPiggyAckSeq(uint8_t* msg);
+uint8_t L2_msg_getPiggyAckMap(uint8_t* msg);
+uint8_t L2_msg_getHeaderSize(uint8_t* msg);
+uint8_t L2_msg_getMinSize(uint8_t* msg);
+uint8_t* L2_msg_getWord(uint8_t* msg);
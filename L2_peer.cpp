@@ -0,0 +1,139 @@
+#include "mbed.h"
+#include "L2_peer.h"
+#include "protocol_parameters.h"
+
+static L2_peer_t peerTable[L2_MAXPEERS];
+static uint32_t useCnt = 0;
+
+
+static uint32_t L2_peer_clampRto(uint32_t rto)
+{
+    if (rto < L2_ARQ_MINRTO)
+        return L2_ARQ_MINRTO;
+    if (rto > L2_ARQ_MAXRTO)
+        return L2_ARQ_MAXRTO;
+
+    return rto;
+}
+
+//an entry can be reused once it has nothing to send or to acknowledge
+static uint8_t L2_peer_checkBusy(L2_peer_t* peer)
+{
+    return peer->sduPending || peer->txBase != peer->txSeq || peer->rxBuffered != 0 || peer->ackPending;
+}
+
+
+void L2_peer_init(void)
+{
+    memset(peerTable, 0, sizeof(peerTable));
+    useCnt = 0;
+}
+
+L2_peer_t* L2_peer_find(uint8_t id)
+{
+    for (int i = 0; i < L2_MAXPEERS; i++)
+    {
+        if (peerTable[i].used && peerTable[i].id == id)
+            return &peerTable[i];
+    }
+
+    return NULL;
+}
+
+//entry of the given neighbor, replacing the least recently used idle one if the table is full
+//returns NULL if every entry is busy
+L2_peer_t* L2_peer_get(uint8_t id)
+{
+    L2_peer_t* peer = L2_peer_find(id);
+
+    if (peer == NULL)
+    {
+        for (int i = 0; i < L2_MAXPEERS; i++)
+        {
+            if (peerTable[i].used == 0)
+            {
+                peer = &peerTable[i];
+                break;
+            }
+            if (L2_peer_checkBusy(&peerTable[i]) == 0 && (peer == NULL || peerTable[i].lastUse < peer->lastUse))
+                peer = &peerTable[i];
+        }
+
+        if (peer == NULL)
+        {
+            debug("[L2][WARNING] no free neighbor entry for %i\n", id);
+            return NULL;
+        }
+
+        debug_if(DBGMSG_L2 && peer->used, "[L2] peer table is full, replacing %i by %i\n", peer->id, id);
+        memset(peer, 0, sizeof(L2_peer_t));
+        peer->used = 1;
+        peer->id = id;
+        peer->rto = L2_ARQ_INITRTO;
+        peer->mss = L2_MSG_MAXDATASIZE;
+
+        //the neighbor may still hold a receive context of an evicted entry
+        peer->txSeq = rand();
+        peer->txBase = peer->txSeq;
+        peer->txSync = 1;
+    }
+
+    peer->lastUse = ++useCnt;
+
+    return peer;
+}
+
+L2_peer_t* L2_peer_getByIndex(uint8_t idx)
+{
+    return peerTable[idx].used ? &peerTable[idx] : NULL;
+}
+
+uint8_t L2_peer_getIndex(L2_peer_t* peer)
+{
+    return peer - peerTable;
+}
+
+
+//Jacobson/Karels estimator (RFC 6298), rtt in ms
+void L2_peer_updateRtt(L2_peer_t* peer, uint32_t rtt)
+{
+    if (peer->rttValid == 0)
+    {
+        peer->srtt = rtt;
+        peer->rttvar = rtt/2;
+        peer->rttValid = 1;
+    }
+    else
+    {
+        uint32_t delta = (peer->srtt > rtt) ? peer->srtt - rtt : rtt - peer->srtt;
+
+        peer->rttvar = (3*peer->rttvar + delta)/4;
+        peer->srtt = (7*peer->srtt + rtt)/8;
+    }
+
+    //a fresh sample also ends any backoff
+    peer->rto = L2_peer_clampRto(peer->srtt + (peer->rttvar > 0 ? 4*peer->rttvar : 1));
+
+    debug_if(DBGMSG_L2, "[L2] RTT to %i : %i ms (SRTT %i, RTTVAR %i, RTO %i)\n", peer->id, (int)rtt, (int)peer->srtt, (int)peer->rttvar, (int)peer->rto);
+}
+
+//exponential backoff after a timeout
+void L2_peer_backoffRto(L2_peer_t* peer)
+{
+    peer->rto = L2_peer_clampRto(2*peer->rto);
+}
+
+
+uint32_t L2_peer_getSrtt(uint8_t id)
+{
+    L2_peer_t* peer = L2_peer_find(id);
+
+    return (peer != NULL) ? peer->srtt : 0;
+}
+
+uint32_t L2_peer_getRto(uint8_t id)
+{
+    L2_peer_t* peer = L2_peer_find(id);
+
+    return (peer != NULL) ? peer->rto : L2_ARQ_INITRTO;
+}
@@ -0,0 +1,67 @@
+#ifndef L2_PEER_H
+#define L2_PEER_H
+
+#include "mbed.h"
+#include "L2_msg.h"
+#include "L2_txq.h"
+
+#define L2_ARQ_MAXWINDOW            16      //bits in the BLOCKACK map
+#define L2_PEER_MAXSDUSIZE          255
+
+//per-neighbor L2 state, keyed by L2 ID
+typedef struct {
+    uint8_t used;
+    uint8_t id;
+    uint32_t lastUse;       //for replacement of the least recently used entry
+
+    //SDU being sent to this neighbor, segmented in place in the transmit queue
+    uint8_t sduPending;     //accepted and not confirmed yet
+    L2_txqEntry_t* sduEntry;
+    uint8_t* sdu;
+    uint8_t sduLen;
+    uint8_t sduOffset;      //first byte not segmented yet
+
+    //ARQ sender : segments [txBase, txSeq) are in flight, kept by slot (seq % L2_ARQ_MAXWINDOW)
+    //a segment is a span of the SDU, its PDU is rebuilt for every (re)transmission
+    uint8_t mss;            //largest DATA payload the neighbor accepts
+    uint8_t txSync;         //the next new PDU carries the SYNC flag
+    uint8_t txSeq;
+    uint8_t txBase;
+    uint16_t txAcked;       //slots acknowledged out of order
+    uint16_t txRetxReq;     //slots waiting for retransmission
+    uint16_t txSyncMap;     //slots whose PDU carries the SYNC flag
+    uint8_t segOffset[L2_ARQ_MAXWINDOW];
+    uint8_t segLen[L2_ARQ_MAXWINDOW];
+    uint8_t retxCnt[L2_ARQ_MAXWINDOW];
+    uint32_t txTime[L2_ARQ_MAXWINDOW];  //us ticker at phymac_dataReq, for RTT samples
+
+    //ARQ receiver : segments of [rxSeq, rxSeq+window) that arrived ahead of rxSeq
+    uint8_t rxSynced;       //rxSeq is taken from the first SYNC PDU
+    uint8_t rxSeq;
+    uint16_t rxBuffered;
+    uint8_t rxPdu[L2_ARQ_MAXWINDOW][L2_MSG_MAXPDUSIZE];
+    uint8_t rxPduSize[L2_ARQ_MAXWINDOW];
+    uint8_t ackPending;     //an ACK for ackSeq is owed, waiting for a DATA PDU to ride on
+    uint8_t ackDue;         //the delay is over : standalone ACK
+    uint8_t ackSeq;
+
+    //retransmission timeout estimation (ms)
+    uint8_t rttValid;       //at least one RTT sample was taken
+    uint32_t srtt;
+    uint32_t rttvar;
+    uint32_t rto;           //current RTO, backoff included
+} L2_peer_t;
+
+void L2_peer_init(void);
+L2_peer_t* L2_peer_get(uint8_t id);
+L2_peer_t* L2_peer_find(uint8_t id);
+L2_peer_t* L2_peer_getByIndex(uint8_t idx);
+uint8_t L2_peer_getIndex(L2_peer_t* peer);
+
+void L2_peer_updateRtt(L2_peer_t* peer, uint32_t rtt);
+void L2_peer_backoffRto(L2_peer_t* peer);
+
+uint32_t L2_peer_getSrtt(uint8_t id);
+uint32_t L2_peer_getRto(uint8_t id);
+
+#endif
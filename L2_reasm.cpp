@@ -0,0 +1,215 @@
+#include "mbed.h"
+#include "L2_reasm.h"
+#include "L2_peer.h"
+#include "protocol_parameters.h"
+
+//partial SDU of one source; unicast and broadcast SDUs of a source are kept apart
+typedef struct {
+    uint8_t used;
+    uint8_t srcId;
+    uint8_t brflag;
+    uint8_t size;
+    uint32_t lastTime;      //ms, last segment
+    uint8_t buf[L2_PEER_MAXSDUSIZE];
+} L2_reasm_t;
+
+static L2_reasm_t reasmTable[L2_REASM_MAXENTRIES];
+//sources whose partial SDU was dropped : their segments are ignored up to the last one of that SDU
+static uint8_t discardId[L2_REASM_MAXENTRIES];
+static uint8_t discardBr[L2_REASM_MAXENTRIES];
+static uint8_t discardCnt = 0;
+static L2_reasmStats_t reasmStats;
+
+
+static uint32_t L2_reasm_now(void)
+{
+    return us_ticker_read()/1000;
+}
+
+//returns the index of the source in the discard list, -1 if absent
+static int L2_reasm_findDiscard(uint8_t srcId, uint8_t brflag)
+{
+    for (int i = 0; i < discardCnt; i++)
+    {
+        if (discardId[i] == srcId && discardBr[i] == brflag)
+            return i;
+    }
+
+    return -1;
+}
+
+static void L2_reasm_removeDiscard(int idx)
+{
+    if (idx < 0)
+        return;
+
+    discardCnt--;
+    discardId[idx] = discardId[discardCnt];
+    discardBr[idx] = discardBr[discardCnt];
+}
+
+//the rest of the current SDU of the source is discarded as it comes in (one source is forgotten if the list is full)
+static void L2_reasm_addDiscard(uint8_t srcId, uint8_t brflag)
+{
+    if (L2_reasm_findDiscard(srcId, brflag) >= 0)
+        return;
+    if (discardCnt == L2_REASM_MAXENTRIES)
+        L2_reasm_removeDiscard(0);
+
+    discardId[discardCnt] = srcId;
+    discardBr[discardCnt] = brflag;
+    discardCnt++;
+}
+
+//frees the entry and discards the rest of its SDU
+static void L2_reasm_discard(L2_reasm_t* entry)
+{
+    entry->used = 0;
+    L2_reasm_addDiscard(entry->srcId, entry->brflag);
+}
+
+static void L2_reasm_expire(uint32_t now)
+{
+    for (int i = 0; i < L2_REASM_MAXENTRIES; i++)
+    {
+        if (reasmTable[i].used && now - reasmTable[i].lastTime > L2_REASM_TIMEOUT)
+        {
+            debug_if(DBGMSG_L2, "[L2] reassembly from %i timed out (%i bytes dropped)\n", reasmTable[i].srcId, reasmTable[i].size);
+            L2_reasm_discard(&reasmTable[i]);
+            reasmStats.timedOut++;
+        }
+    }
+}
+
+static L2_reasm_t* L2_reasm_find(uint8_t srcId, uint8_t brflag)
+{
+    for (int i = 0; i < L2_REASM_MAXENTRIES; i++)
+    {
+        if (reasmTable[i].used && reasmTable[i].srcId == srcId && reasmTable[i].brflag == brflag)
+            return &reasmTable[i];
+    }
+
+    return NULL;
+}
+
+//free entry, or the one idle for the longest time
+static L2_reasm_t* L2_reasm_alloc(uint8_t srcId, uint8_t brflag)
+{
+    L2_reasm_t* entry = &reasmTable[0];
+
+    for (int i = 0; i < L2_REASM_MAXENTRIES; i++)
+    {
+        if (reasmTable[i].used == 0)
+        {
+            entry = &reasmTable[i];
+            break;
+        }
+        if (reasmTable[i].lastTime < entry->lastTime)
+            entry = &reasmTable[i];
+    }
+
+    if (entry->used)
+    {
+        debug("[L2][WARNING] reassembly table is full, dropping %i bytes from %i\n", entry->size, entry->srcId);
+        L2_reasm_discard(entry);
+        reasmStats.evicted++;
+    }
+
+    entry->used = 1;
+    entry->srcId = srcId;
+    entry->brflag = brflag;
+    entry->size = 0;
+
+    return entry;
+}
+
+
+void L2_reasm_init(void)
+{
+    memset(reasmTable, 0, sizeof(reasmTable));
+    memset(&reasmStats, 0, sizeof(reasmStats));
+    discardCnt = 0;
+}
+
+//appends the payload of a segment, returns the SDU once its last segment is in (NULL otherwise)
+//the SDU stays valid until the next call
+uint8_t* L2_reasm_addSegment(uint8_t srcId, uint8_t brflag, uint8_t* data, uint8_t len, uint8_t flag_end, uint8_t* sduLen)
+{
+    uint32_t now = L2_reasm_now();
+    L2_reasm_t* entry;
+    int idx;
+
+    L2_reasm_expire(now);
+
+    if ((idx = L2_reasm_findDiscard(srcId, brflag)) >= 0)
+    {
+        debug_if(DBGMSG_L2, "[L2] discarding a segment of a dropped SDU from %i\n", srcId);
+        if (flag_end)
+            L2_reasm_removeDiscard(idx);
+        return NULL;
+    }
+
+    if ((entry = L2_reasm_find(srcId, brflag)) == NULL)
+    {
+        //single segment SDU : delivered from the PDU itself
+        if (flag_end)
+        {
+            *sduLen = len;
+            reasmStats.completed++;
+            return data;
+        }
+
+        entry = L2_reasm_alloc(srcId, brflag);
+    }
+
+    if (entry->size + len > L2_PEER_MAXSDUSIZE)
+    {
+        debug("[L2][WARNING] SDU from %i exceeds %i bytes, dropping it\n", srcId, L2_PEER_MAXSDUSIZE);
+        L2_reasm_discard(entry);
+        reasmStats.overflow++;
+        return NULL;
+    }
+
+    memcpy(entry->buf + entry->size, data, len);
+    entry->size += len;
+    entry->lastTime = now;
+
+    debug_if(DBGMSG_L2, "[L2] Aggregation PDU from %i : size : %i end : %i\n", srcId, entry->size, flag_end);
+
+    if (flag_end)
+    {
+        entry->used = 0;
+        *sduLen = entry->size;
+        reasmStats.completed++;
+        return entry->buf;
+    }
+
+    return NULL;
+}
+
+//forgets the partial SDU of a source (its sender gave up on it), the next segment starts a new SDU
+void L2_reasm_drop(uint8_t srcId, uint8_t brflag)
+{
+    L2_reasm_t* entry = L2_reasm_find(srcId, brflag);
+
+    if (entry != NULL)
+        entry->used = 0;
+    L2_reasm_removeDiscard(L2_reasm_findDiscard(srcId, brflag));
+}
+
+//a segment of the source will never come : its SDU is dropped, up to its last segment
+//(when the lost one ended an SDU, the next SDU goes too : nothing tells them apart)
+void L2_reasm_skip(uint8_t srcId, uint8_t brflag)
+{
+    L2_reasm_t* entry = L2_reasm_find(srcId, brflag);
+
+    if (entry != NULL)
+        L2_reasm_discard(entry);
+    else
+        L2_reasm_addDiscard(srcId, brflag);
+}
+
+const L2_reasmStats_t* L2_reasm_getStats(void)
+{
+    return &reasmStats;
+}
@@ -0,0 +1,19 @@
+#ifndef L2_REASM_H
+#define L2_REASM_H
+
+#include "mbed.h"
+
+typedef struct {
+    uint32_t completed;     //SDUs handed to L3
+    uint32_t evicted;       //partial SDUs dropped for a new source (table full)
+    uint32_t timedOut;      //partial SDUs dropped after L2_REASM_TIMEOUT
+    uint32_t overflow;      //partial SDUs dropped for exceeding the maximum SDU size
+} L2_reasmStats_t;
+
+void L2_reasm_init(void);
+uint8_t* L2_reasm_addSegment(uint8_t srcId, uint8_t brflag, uint8_t* data, uint8_t len, uint8_t flag_end, uint8_t* sduLen);
+void L2_reasm_drop(uint8_t srcId, uint8_t brflag);
+void L2_reasm_skip(uint8_t srcId, uint8_t brflag);
+const L2_reasmStats_t* L2_reasm_getStats(void);
+
+#endif
@@ -1,36 +1,61 @@
 #include "mbed.h"
 #include "L2_FSMevent.h"
 #include "protocol_parameters.h"
+#include "L2_timer.h"
+#include "timerwheel.h"
 
 
 
-//ARQ retransmission timer
-static Timeout timer;                       
-static uint8_t timerStatus = 0;
+//ARQ retransmission and delayed ACK timers of the neighbor entries, on the shared timer wheel
+static uint8_t timerHandle[L2_TIMER_COUNT];
+static volatile uint8_t timerExpired[L2_TIMER_COUNT];
+static uint8_t timersCreated = 0;
 
 
-//timer event : ARQ timeout
-void L2_timer_timeoutHandler(void) 
+//timer event : ARQ timeout, or delayed ACK / NACK due
+static void L2_timer_timeoutHandler(uint8_t idx)
 {
-    timerStatus = 0;
-    L2_event_setEventFlag(L2_event_arqTimeout);
+    timerExpired[idx] = 1;
+    L2_event_setEventFlag(idx < L2_MAXPEERS ? L2_event_arqTimeout : L2_event_ackTimeout);
 }
 
 //timer related functions ---------------------------
-void L2_timer_startTimer()
+//creates the timers on the wheel (timerwheel_init first), stops them when called again
+void L2_timer_init(void)
 {
-    uint8_t waitTime = L2_ARQ_MINWAITTIME + rand()%(L2_ARQ_MAXWAITTIME-L2_ARQ_MINWAITTIME);
-    timer.attach(L2_timer_timeoutHandler, waitTime);
-    timerStatus = 1;
+    for (int i = 0; i < L2_TIMER_COUNT; i++)
+    {
+        if (timersCreated)
+            timerwheel_stop(timerHandle[i]);
+        else if ((timerHandle[i] = timerwheel_create(L2_timer_timeoutHandler, i)) == TIMERWHEEL_NONE)
+            error("[L2] no room on the timer wheel for timer %i (TIMERWHEEL_MAXTIMERS)\n", i);
+        timerExpired[i] = 0;
+    }
+    timersCreated = 1;
 }
 
-void L2_timer_stopTimer()
+void L2_timer_startTimer(uint8_t idx, uint32_t waitTime_ms)
 {
-    timer.detach();
-    timerStatus = 0;
+    timerExpired[idx] = 0;
+    timerwheel_start(timerHandle[idx], waitTime_ms);
 }
 
-uint8_t L2_timer_getTimerStatus()
+void L2_timer_stopTimer(uint8_t idx)
 {
-    return timerStatus;
+    timerwheel_stop(timerHandle[idx]);
+    timerExpired[idx] = 0;
+}
+
+uint8_t L2_timer_getTimerStatus(uint8_t idx)
+{
+    return timerwheel_isRunning(timerHandle[idx]);
+}
+
+//1 once if the timer expired since it was started
+uint8_t L2_timer_checkExpired(uint8_t idx)
+{
+    uint8_t expired = timerExpired[idx];
+
+    timerExpired[idx] = 0;
+    return expired;
 }
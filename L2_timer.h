@@ -1,3 +1,12 @@
-void L2_timer_startTimer();
-void L2_timer_stopTimer();
-uint8_t L2_timer_getTimerStatus();
\ No newline at end of file
+//timers of neighbor entry idx : ARQ retransmission, delayed ACK
+//and of broadcast receive context idx : NACK backoff
+#define L2_TIMER_ARQ(idx)           (idx)
+#define L2_TIMER_ACK(idx)           (L2_MAXPEERS + (idx))
+#define L2_TIMER_NACK(idx)          (2*L2_MAXPEERS + (idx))
+#define L2_TIMER_COUNT              (2*L2_MAXPEERS + L2_MCAST_MAXSOURCES)
+
+void L2_timer_init(void);
+void L2_timer_startTimer(uint8_t idx, uint32_t waitTime_ms);
+void L2_timer_stopTimer(uint8_t idx);
+uint8_t L2_timer_getTimerStatus(uint8_t idx);
+uint8_t L2_timer_checkExpired(uint8_t idx);
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include "mbed.h"
+#include "L2_txq.h"
+#include "protocol_parameters.h"
+
+#if L2_TXQ_BYTES < 255
+#error "L2_TXQ_BYTES must hold the largest SDU (255 bytes)"
+#endif
+
+//SDUs accepted from L3, in order : descriptors in a ring, payloads in a byte ring
+//an SDU is taken when its neighbor is free, so it may be taken before older SDUs to busy neighbors
+//payloads stay in place until the SDU is confirmed : neighbors segment them from here
+static L2_txqEntry_t txqEntry[L2_TXQ_MAXSDUS];
+static uint8_t txqFirst = 0;
+static uint8_t txqCount = 0;
+
+static uint8_t txqPool[L2_TXQ_BYTES];
+static uint16_t poolHead = 0;       //payload of the first entry
+static uint16_t poolTail = 0;       //first free byte
+static L2_txqStats_t txqStats;
+
+
+//position of a payload of len bytes in the pool, -1 if it does not fit
+//payloads are never split : the end of the pool is skipped when too short
+static int L2_txq_allocPayload(uint8_t len)
+{
+    if (txqCount == 0)
+    {
+        poolHead = poolTail = 0;
+        return 0;
+    }
+
+    if (poolTail > poolHead)
+    {
+        if (poolTail + len <= L2_TXQ_BYTES)
+            return poolTail;
+        return (len <= poolHead) ? 0 : -1;
+    }
+
+    return (poolTail + len <= poolHead) ? poolTail : -1;
+}
+
+
+void L2_txq_init(void)
+{
+    txqFirst = 0;
+    txqCount = 0;
+    poolHead = poolTail = 0;
+    memset(&txqStats, 0, sizeof(txqStats));
+}
+
+//copies the SDU at the end of the queue, returns 1 if there is no room for it
+int L2_txq_push(uint8_t* sdu, uint8_t len, uint8_t destId, uint8_t unordered, uint8_t sduId)
+{
+    L2_txqEntry_t* entry;
+    int offset;
+
+    if (txqCount == L2_TXQ_MAXSDUS || (offset = L2_txq_allocPayload(len)) < 0)
+    {
+        txqStats.refused++;
+        return 1;
+    }
+
+    entry = &txqEntry[(txqFirst + txqCount) % L2_TXQ_MAXSDUS];
+    entry->sduId = sduId;
+    entry->destId = destId;
+    entry->len = len;
+    entry->unordered = unordered;
+    entry->offset = offset;
+    entry->taken = 0;
+    entry->done = 0;
+    memcpy(&txqPool[offset], sdu, len);
+
+    poolTail = offset + len;
+    txqCount++;
+
+    txqStats.accepted++;
+    if (txqCount > txqStats.maxDepth)
+        txqStats.maxDepth = txqCount;
+
+    return 0;
+}
+
+//oldest SDU after prev (NULL : from the start) not handed to its neighbor yet, NULL if none
+L2_txqEntry_t* L2_txq_getWaiting(L2_txqEntry_t* prev)
+{
+    uint8_t i = (prev == NULL) ? 0 : (uint8_t)((prev - txqEntry + L2_TXQ_MAXSDUS - txqFirst) % L2_TXQ_MAXSDUS + 1);
+
+    for (; i < txqCount; i++)
+    {
+        L2_txqEntry_t* entry = &txqEntry[(txqFirst + i) % L2_TXQ_MAXSDUS];
+
+        if (entry->taken == 0)
+            return entry;
+    }
+
+    return NULL;
+}
+
+//the SDU is now being sent by its neighbor
+void L2_txq_take(L2_txqEntry_t* entry)
+{
+    entry->taken = 1;
+}
+
+uint8_t* L2_txq_getSdu(L2_txqEntry_t* entry)
+{
+    return &txqPool[entry->offset];
+}
+
+//the SDU is confirmed (or given up), its space is reclaimed in order
+void L2_txq_release(L2_txqEntry_t* entry)
+{
+    entry->done = 1;
+
+    while (txqCount > 0 && txqEntry[txqFirst].done)
+    {
+        txqFirst = (txqFirst + 1) % L2_TXQ_MAXSDUS;
+        txqCount--;
+    }
+
+    if (txqCount > 0)
+        poolHead = txqEntry[txqFirst].offset;
+    else
+        poolHead = poolTail = 0;
+}
+
+uint8_t L2_txq_getCount(void)
+{
+    return txqCount;
+}
+
+const L2_txqStats_t* L2_txq_getStats(void)
+{
+    return &txqStats;
+}
@@ -0,0 +1,32 @@
+#ifndef L2_TXQ_H
+#define L2_TXQ_H
+
+#include "mbed.h"
+
+//SDU in the transmit queue, from DATA_REQ to its confirmation
+typedef struct {
+    uint8_t sduId;          //given back to L3 with the DATA_CNF
+    uint8_t destId;
+    uint8_t len;
+    uint8_t unordered;      //broadcast that may overtake older ones (a single PDU only)
+    uint16_t offset;        //payload position in the byte pool
+    uint8_t taken;          //handed to its neighbor
+    uint8_t done;           //released by its neighbor, freed once every older SDU is done too
+} L2_txqEntry_t;
+
+typedef struct {
+    uint32_t accepted;
+    uint32_t refused;       //DATA_REQs refused for a full queue
+    uint8_t maxDepth;       //high-water mark in SDUs
+} L2_txqStats_t;
+
+void L2_txq_init(void);
+int L2_txq_push(uint8_t* sdu, uint8_t len, uint8_t destId, uint8_t unordered, uint8_t sduId);
+L2_txqEntry_t* L2_txq_getWaiting(L2_txqEntry_t* prev);
+void L2_txq_take(L2_txqEntry_t* entry);
+uint8_t* L2_txq_getSdu(L2_txqEntry_t* entry);
+void L2_txq_release(L2_txqEntry_t* entry);
+uint8_t L2_txq_getCount(void);
+const L2_txqStats_t* L2_txq_getStats(void);
+
+#endif
@@ -1,17 +1,35 @@
 #include "mbed.h"
 #include "L3_FSMevent.h"
 
-static uint32_t eventFlag;
+//dataToSend is raised from the serial RX interrupt : set and clear use compare-and-swap
+static volatile uint32_t eventFlag;
+static volatile uint32_t postCnt = 0;     //flags set and timer expiries, for the main loop to tell if it may sleep
 
 
 void L3_event_setEventFlag(L3_event_e event)
 {
-    eventFlag |= (0x01 << event);
+    uint32_t flag = eventFlag;
+
+    while (!core_util_atomic_cas_u32(&eventFlag, &flag, flag | (0x01 << event)));
+    L3_event_post();
+}
+
+//something for the FSM happened without a flag of its own (timer expiry)
+void L3_event_post(void)
+{
+    core_util_atomic_incr_u32(&postCnt, 1);
+}
+
+uint32_t L3_event_getPostCount(void)
+{
+    return postCnt;
 }
 
 void L3_event_clearEventFlag(L3_event_e event)
 {
-    eventFlag &= ~(0x01 << event);
+    uint32_t flag = eventFlag;
+
+    while (!core_util_atomic_cas_u32(&eventFlag, &flag, flag & ~(0x01 << event)));
 }
 void L3_event_clearAllEventFlag(void)
 {
@@ -21,4 +39,15 @@ void L3_event_clearAllEventFlag(void)
 int L3_event_checkEventFlag(L3_event_e event)
 {
     return (eventFlag & (0x01 << event));
+}
+
+//highest priority event pending among mask, L3_EVENT_NONE if none
+int L3_event_getEvent(uint32_t mask)
+{
+    uint32_t pending = eventFlag & mask;
+
+    if (pending == 0)
+        return L3_EVENT_NONE;
+
+    return 31 - __CLZ(pending);
 }
\ No newline at end of file
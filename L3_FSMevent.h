@@ -1,17 +1,24 @@
+//the value is the priority : L3_event_getEvent returns the highest pending one
 typedef enum L3_event
 {
-    L3_event_msgRcvd = 2,
     L3_event_dataToSend = 4,
     L3_event_dataSendCnf = 5,
     L3_event_recfgSrcIdCnf = 6,
     L3_event_scanComplete = 7,
     L3_event_connectRequest = 8,
     L3_event_connectResponse = 9,
-    L3_event_connectionEstablished = 10
+    L3_event_connectionEstablished = 10,
+    L3_event_msgRcvd = 11
 } L3_event_e;
 
+#define L3_EVENT_NONE           (-1)
+#define L3_EVENT_MASK(event)    (0x01 << (event))
+
 
 void L3_event_setEventFlag(L3_event_e event);
 void L3_event_clearEventFlag(L3_event_e event);
 void L3_event_clearAllEventFlag(void);
-int L3_event_checkEventFlag(L3_event_e event);
\ No newline at end of file
+int L3_event_checkEventFlag(L3_event_e event);
+int L3_event_getEvent(uint32_t mask);
+void L3_event_post(void);
+uint32_t L3_event_getPostCount(void);
\ No newline at end of file
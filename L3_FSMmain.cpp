@@ -3,6 +3,8 @@
 #include "L3_timer.h"
 #include "L3_LLinterface.h"
 #include "L3_admin.h"
+#include "L3_session.h"
+#include "L3_request.h"
 #include "protocol_parameters.h"
 #include "mbed.h"
 
@@ -19,6 +21,10 @@
 #define L3_MSG_TYPE_BEACON          0x10
 #define L3_MSG_TYPE_CONN_REQ        0x11
 #define L3_MSG_TYPE_CONN_RESP       0x12
+#define L3_MSG_TYPE_PROBE           0x13
+#define L3_MSG_TYPE_JOIN_REQ        0x14
+#define L3_MSG_TYPE_JOIN_RESP       0x15
+#define L3_MSG_TYPE_ADMIT_ACK       0x16  // 대기열에서 받은 승인 확인 (ConnMsg_t, status/position 미사용)
 #define L3_MSG_TYPE_DATA            0x20
 #define L3_MSG_TYPE_ANNOUNCEMENT    0x30
 #define L3_MSG_TYPE_BROADCAST       0x40
@@ -44,11 +50,17 @@ typedef struct {
     int8_t snr;
     uint8_t nodeType;
     uint8_t isActive;
+    uint8_t freeConn;       // 비콘에 실린 부스 부하
+    uint8_t freeExp;
+    uint8_t queueLen;
 } BoothNode_t;
 
 static BoothNode_t detectedBooths[MAX_BOOTH_NODES];
 static uint8_t numDetectedBooths = 0;
-static uint8_t bestBoothId = 0;
+static uint8_t bestBoothId = 0;        // 연결을 시도할 (시도 중인) 부스
+static BoothNode_t* candidates[MAX_BOOTH_NODES]; // 스캔 결과, 점수 순
+static uint8_t numCandidates = 0;
+static uint8_t nextCandidate = 0;       // 거절되면 다음에 시도할 후보
 static int16_t bestRssi = -200; // 매우 낮은 초기값
 
 //Connection variables
@@ -56,43 +68,79 @@ static uint8_t myNodeType = NODE_TYPE_USER;
 static uint8_t connectedBoothId = 0;
 static uint8_t isConnected = 0;
 static uint8_t connectionRequested = 0;
+static uint8_t connectReq = L3_REQ_NONE; // CONN_RESP (JOIN_RESP) 대기 중인 요청
+static uint8_t joinService = 0;         // 0 : CONN_REQ로 연결만, 아니면 JOIN_REQ로 요청할 서비스
 
 //Experience variables
 static uint8_t experienceRequested = 0;
 static uint8_t inExperience = 0;
+static uint8_t experienceReq = L3_REQ_NONE; // EXPERIENCE_RESP 대기 중인 요청
 
-//Booth capacity management
+//Booth capacity management : users and their roles are in the session table (L3_session)
 #define MAX_BOOTH_CAPACITY          5
-static uint8_t connectedUsers[MAX_BOOTH_CAPACITY];
-static uint8_t experienceUsers[MAX_BOOTH_CAPACITY];
-static uint8_t numConnectedUsers = 0;
-static uint8_t numExperienceUsers = 0;
 
 //Scanning control variables
 static uint8_t scanRequested = 0;
 static uint8_t scanInProgress = 0;
 static uint8_t scanCompleted = 0;
+static uint8_t probeReplyPending = 0;   // 부스 : PROBE 응답 비콘이 예약됨
+static uint32_t beaconInterval = L3_BEACON_INTERVAL; // 부스 : 현재 비콘 주기 (Trickle I, ms)
+static uint32_t beaconOffset = 0;       // 부스 : 주기 안에서 비콘이 나가는 시각 (ms)
+static uint32_t probeTime = 0;          // 사용자 : 마지막 PROBE 전송 시각 (ms)
+static uint8_t goodBoothHeard = 0;      // 사용자 : 이번 스캔에서 조건을 만족하는 부스를 들었음
+
+// L2 전송 큐가 가득 차서 거절된 제어 메시지 (응답, ADMIT_ACK) : DATA_CNF 후 순서대로 다시 보냄
+typedef struct {
+    uint8_t destId;
+    uint8_t size;
+    uint8_t msg[L3_REQ_MAXMSGSIZE];
+} HeldMsg_t;
+
+static HeldMsg_t heldMsgs[L3_HOLD_MAXMSGS];
+static uint8_t numHeldMsgs = 0;
+static uint32_t droppedMsgs = 0;        // L2가 거절해서 아무도 다시 보내지 않는 메시지 (팬아웃, 중계)
 
 //serial port interface
 static Serial pc(USBTX, USBRX);
 static uint8_t myNodeId; // dest ID 제거, 노드 ID만 사용
 
-//Beacon message structure
+//Beacon message structure, also used for the PROBE of a scanning user (load fields 0)
 typedef struct {
     uint8_t msgType;
     uint8_t nodeId;
     uint8_t nodeType;
-    uint8_t reserved;
+    uint8_t freeConn;       // 남은 연결 자리
+    uint8_t freeExp;        // 남은 체험 자리
+    uint8_t queueLen;       // 대기 중인 사용자 수
 } BeaconMsg_t;
 
+//Response status
+#define L3_RESP_ACCEPT              1
+#define L3_RESP_REJECT              2
+#define L3_RESP_QUEUED              3  // 부스가 꽉 차서 대기열에 들어감, 자리가 나면 요청 없이 승인이 옴 (ADMIT_ACK로 확인)
+
 //Connection request/response structure
 typedef struct {
     uint8_t msgType;
     uint8_t srcId;
     uint8_t destId;
-    uint8_t status; // 0: request, 1: accept, 2: reject
+    uint8_t status;   // 0: request, 1: accept, 2: reject, 3: queued
+    uint8_t position; // 응답 : 대기 순번 (queued), 요청 : 1이면 부스가 꽉 찼을 때 대기열에 들어감
 } ConnMsg_t;
 
+//Join request/response structure : connection and experience in one exchange
+#define L3_JOIN_SERVICE_CONNECT     1
+#define L3_JOIN_SERVICE_EXPERIENCE  2
+
+typedef struct {
+    uint8_t msgType;
+    uint8_t srcId;
+    uint8_t destId;
+    uint8_t status;   // 0: request, 1: accept, 2: reject, 3: queued
+    uint8_t service;  // 요청 : 원하는 서비스, 응답 : 부스가 내준 서비스
+    uint8_t position; // ConnMsg_t와 같음
+} JoinMsg_t;
+
 //Experience request/response structure
 typedef struct {
     uint8_t msgType;
@@ -101,78 +149,17 @@ typedef struct {
     uint8_t status; // 0: request, 1: accept, 2: reject (capacity full)
 } ExperienceMsg_t;
 
-//Broadcast message structure
+//Broadcast message structure : group chat of the booth experience
+//a member sends it to the booth, the booth sends its own and relays the members' ones in a single L2 broadcast
 typedef struct {
     uint8_t msgType;
-    uint8_t srcId;
+    uint8_t groupId;        // 그룹을 운영하는 부스 ID
+    uint8_t srcId;          // 작성자 (부스 또는 체험 사용자)
     uint8_t messageLength;
     // message data follows
 } BroadcastMsg_t;
 
-//Helper functions for booth capacity management
-void L3_addConnectedUser(uint8_t userId)
-{
-    if (numConnectedUsers < MAX_BOOTH_CAPACITY)
-    {
-        connectedUsers[numConnectedUsers] = userId;
-        numConnectedUsers++;
-    }
-}
-
-void L3_removeConnectedUser(uint8_t userId)
-{
-    for (int i = 0; i < numConnectedUsers; i++)
-    {
-        if (connectedUsers[i] == userId)
-        {
-            // Shift remaining users
-            for (int j = i; j < numConnectedUsers - 1; j++)
-            {
-                connectedUsers[j] = connectedUsers[j + 1];
-            }
-            numConnectedUsers--;
-            break;
-        }
-    }
-}
-
-void L3_addExperienceUser(uint8_t userId)
-{
-    if (numExperienceUsers < MAX_BOOTH_CAPACITY)
-    {
-        experienceUsers[numExperienceUsers] = userId;
-        numExperienceUsers++;
-    }
-}
-
-void L3_removeExperienceUser(uint8_t userId)
-{
-    for (int i = 0; i < numExperienceUsers; i++)
-    {
-        if (experienceUsers[i] == userId)
-        {
-            // Shift remaining users
-            for (int j = i; j < numExperienceUsers - 1; j++)
-            {
-                experienceUsers[j] = experienceUsers[j + 1];
-            }
-            numExperienceUsers--;
-            break;
-        }
-    }
-}
-
-uint8_t L3_isUserInExperience(uint8_t userId)
-{
-    for (int i = 0; i < numExperienceUsers; i++)
-    {
-        if (experienceUsers[i] == userId)
-        {
-            return 1;
-        }
-    }
-    return 0;
-}
+#define L3_BROADCAST_MAXMSGSIZE     (255 - sizeof(BroadcastMsg_t)) //one L2 SDU
 
 //application event handler : generating SDU from keyboard input
 static void L3service_processInputWord(void)
@@ -203,9 +190,12 @@ static void L3service_processInputWord(void)
                 scanRequested = 1;
                 scanInProgress = 1;
                 scanCompleted = 0;
+                goodBoothHeard = 0;
                 numDetectedBooths = 0;
                 bestBoothId = 0;
                 bestRssi = -200;
+                L3_req_cancel(connectReq);
+                connectReq = L3_REQ_NONE;
                 
                 // 기존 감지된 부스들 초기화
                 for (int i = 0; i < MAX_BOOTH_NODES; i++)
@@ -214,13 +204,22 @@ static void L3service_processInputWord(void)
                 }
                 
                 pc.printf("Scanning for booth nodes...\n");
-                L3_timer_startTimer(); // 스캔 타이머 시작
+                L3_timer_startTimer(L3_TIMER_SCAN, L3_SCAN_TIMEOUT); // 스캔 타이머 시작
+                L3_timer_startTimer(L3_TIMER_PROBE, 0); // 비콘을 기다리지 않고 바로 PROBE 전송
             }
         }
         else if ((c == 'y' || c == 'Y') && bestBoothId != 0)
         {
             // 최적 부스가 있고 연결을 원할 때
             connectionRequested = 1;
+            joinService = 0;
+            L3_event_setEventFlag(L3_event_dataToSend);
+        }
+        else if ((c == 'e' || c == 'E') && bestBoothId != 0)
+        {
+            // 연결과 체험을 한 번에 요청
+            connectionRequested = 1;
+            joinService = L3_JOIN_SERVICE_EXPERIENCE;
             L3_event_setEventFlag(L3_event_dataToSend);
         }
         else if ((c == 'n' || c == 'N') && scanCompleted)
@@ -287,15 +286,136 @@ static void L3service_processInputWord(void)
     }
 }
 
+//sends the same SDU to each user holding the role, returns how many of them L2 refused (mostly a full transmit queue)
+static int L3_sendToUsers(uint8_t* msg, uint8_t size, uint8_t role)
+{
+    int refused = 0;
+    int res;
+
+    for (int id = L3_session_getNext(role, -1); id >= 0; id = L3_session_getNext(role, id))
+    {
+        if ((res = L3_LLI_dataReqFunc(msg, size, id)) != L3_LLI_REQ_OK)
+        {
+            debug("[L3][WARNING] message to user %d is dropped by L2 (cause : %d)\n", id, res);
+            refused++;
+            droppedMsgs++;
+        }
+    }
+
+    return refused;
+}
+
+//control message (response, ADMIT_ACK) : when L2 refuses it for a full transmit queue, it is held
+//and sent again once L2 confirms an SDU, behind the ones held before it
+static void L3_sendControl(uint8_t* msg, uint8_t size, uint8_t destId)
+{
+    if (numHeldMsgs == 0 && L3_LLI_dataReqFunc(msg, size, destId) != L3_LLI_REQ_QUEUEFULL)
+        return;
+
+    if (numHeldMsgs == L3_HOLD_MAXMSGS || size > L3_REQ_MAXMSGSIZE)
+    {
+        //the peer's request is sent again and answered again
+        debug("[L3][WARNING] message 0x%02X to %d is dropped (transmit queue is full)\n", msg[0], destId);
+        return;
+    }
+
+    heldMsgs[numHeldMsgs].destId = destId;
+    heldMsgs[numHeldMsgs].size = size;
+    memcpy(heldMsgs[numHeldMsgs].msg, msg, size);
+    numHeldMsgs++;
+}
+
+//DATA_CNF : L2 may have room again for the held control messages
+static void L3_sendHeldControl(void)
+{
+    uint8_t sent = 0;
+
+    while (sent < numHeldMsgs &&
+           L3_LLI_dataReqFunc(heldMsgs[sent].msg, heldMsgs[sent].size, heldMsgs[sent].destId) != L3_LLI_REQ_QUEUEFULL)
+        sent++;
+
+    if (sent == 0)
+        return;
+
+    numHeldMsgs -= sent;
+    memmove(heldMsgs, heldMsgs + sent, numHeldMsgs*sizeof(HeldMsg_t));
+}
+
+static uint8_t L3_getFreeSlots(uint8_t role)
+{
+    uint8_t cnt = L3_session_getCount(role);
+    
+    return cnt < MAX_BOOTH_CAPACITY ? MAX_BOOTH_CAPACITY - cnt : 0;
+}
+
 void L3_sendBeacon(void)
 {
     BeaconMsg_t beacon;
     beacon.msgType = L3_MSG_TYPE_BEACON;
     beacon.nodeId = myNodeId;
     beacon.nodeType = myNodeType;
-    beacon.reserved = 0;
+    beacon.freeConn = L3_getFreeSlots(L3_SESSION_CONNECTED);
+    beacon.freeExp = L3_getFreeSlots(L3_SESSION_EXPERIENCE);
+    beacon.queueLen = L3_session_getCount(L3_SESSION_WAITING);
+    
+    L3_LLI_unorderedReqFunc((uint8_t*)&beacon, sizeof(BeaconMsg_t), 255); // 브로드캐스트
+    probeReplyPending = 0;
+}
+
+//booth : the beacon goes out in the second half of its interval, at a slot of the booth's ID,
+//so booths reset by the same PROBE do not beacon at the same instant
+static uint32_t L3_getBeaconOffset(uint32_t interval)
+{
+    return interval/2 + (myNodeId % L3_PROBE_SLOTS)*(interval/2)/L3_PROBE_SLOTS;
+}
+
+//booth : a beacon went out, the next interval is twice as long (up to L3_BEACON_MAXINTERVAL)
+static void L3_scheduleNextBeacon(void)
+{
+    uint32_t rest = beaconInterval - beaconOffset;
+    
+    beaconInterval = beaconInterval*2 < L3_BEACON_MAXINTERVAL ? beaconInterval*2 : L3_BEACON_MAXINTERVAL;
+    beaconOffset = L3_getBeaconOffset(beaconInterval);
+    L3_timer_startTimer(L3_TIMER_BEACON, rest + beaconOffset);
+}
+
+//booth : someone new is around, back to the shortest interval (a PROBE reply restarts it by itself)
+static void L3_resetBeaconInterval(void)
+{
+    if (beaconInterval == L3_BEACON_INTERVAL || probeReplyPending)
+        return;
     
-    L3_LLI_dataReqFunc((uint8_t*)&beacon, sizeof(BeaconMsg_t), 255); // 브로드캐스트
+    debug_if(DBGMSG_L3, "[L3] Beacon interval reset from %lu ms\n", (unsigned long)beaconInterval);
+    beaconInterval = L3_BEACON_INTERVAL;
+    beaconOffset = L3_getBeaconOffset(beaconInterval);
+    L3_timer_startTimer(L3_TIMER_BEACON, beaconOffset);
+}
+
+//user : asks the booths around for a beacon now (active scan)
+void L3_sendProbe(void)
+{
+    BeaconMsg_t probe;
+    probe.msgType = L3_MSG_TYPE_PROBE;
+    probe.nodeId = myNodeId;
+    probe.nodeType = myNodeType;
+    probe.freeConn = 0;
+    probe.freeExp = 0;
+    probe.queueLen = 0;
+    
+    L3_LLI_unorderedReqFunc((uint8_t*)&probe, sizeof(BeaconMsg_t), 255); // 브로드캐스트
+    probeTime = us_ticker_read()/1000;
+}
+
+//user : waits in line only when the scan found no booth with room left (the full ones come
+//last), a booth that filled up since its beacon rejects so that the user moves on or scans again
+static uint8_t L3_mayWait(void)
+{
+    for (uint8_t i = nextCandidate - 1; i < numCandidates; i++)
+    {
+        if (candidates[i]->freeConn > 0)
+            return 0;
+    }
+    return 1;
 }
 
 void L3_sendConnectionRequest(uint8_t boothId)
@@ -305,20 +425,114 @@ void L3_sendConnectionRequest(uint8_t boothId)
     connReq.srcId = myNodeId;
     connReq.destId = boothId;
     connReq.status = 0; // request
+    connReq.position = L3_mayWait();
     
-    L3_LLI_dataReqFunc((uint8_t*)&connReq, sizeof(ConnMsg_t), boothId);
+    // 응답이 올 때까지 재전송 (L3_request)
+    connectReq = L3_req_send((uint8_t*)&connReq, sizeof(ConnMsg_t), boothId);
     pc.printf("[INFO] Connection request sent to Booth %d\n", boothId);
 }
 
-void L3_sendConnectionResponse(uint8_t userId, uint8_t accept)
+//user : connection and the service wanted in one request, the response puts the user
+//straight into it (or only connects when the booth has no room for the service)
+void L3_sendJoinRequest(uint8_t boothId, uint8_t service)
+{
+    JoinMsg_t joinReq;
+    joinReq.msgType = L3_MSG_TYPE_JOIN_REQ;
+    joinReq.srcId = myNodeId;
+    joinReq.destId = boothId;
+    joinReq.status = 0; // request
+    joinReq.service = service;
+    joinReq.position = L3_mayWait();
+    
+    connectReq = L3_req_send((uint8_t*)&joinReq, sizeof(JoinMsg_t), boothId);
+    pc.printf("[INFO] Join request sent to Booth %d\n", boothId);
+}
+
+//the booth tried did not take the user : next candidate of the scan, a rescan once none is left
+static void L3_tryNextBooth(void)
+{
+    connectReq = L3_REQ_NONE;
+    
+    if (nextCandidate < numCandidates)
+    {
+        bestBoothId = candidates[nextCandidate++]->nodeId;
+        pc.printf("[INFO] Trying the next booth : %d\n", bestBoothId);
+        if (joinService != 0)
+            L3_sendJoinRequest(bestBoothId, joinService);
+        else
+            L3_sendConnectionRequest(bestBoothId);
+    }
+    else
+    {
+        bestBoothId = 0;
+        pc.printf("No other booth to try. Press 's' to scan again.\n");
+    }
+}
+
+static void L3_buildConnectionResponse(ConnMsg_t* connResp, uint8_t userId, uint8_t status, uint8_t position)
+{
+    connResp->msgType = L3_MSG_TYPE_CONN_RESP;
+    connResp->srcId = myNodeId;
+    connResp->destId = userId;
+    connResp->status = status;
+    connResp->position = position;
+}
+
+static void L3_buildJoinResponse(JoinMsg_t* joinResp, uint8_t userId, uint8_t status, uint8_t service, uint8_t position)
+{
+    joinResp->msgType = L3_MSG_TYPE_JOIN_RESP;
+    joinResp->srcId = myNodeId;
+    joinResp->destId = userId;
+    joinResp->status = status;
+    joinResp->service = service;
+    joinResp->position = position;
+}
+
+void L3_sendConnectionResponse(uint8_t userId, uint8_t status, uint8_t position)
 {
     ConnMsg_t connResp;
-    connResp.msgType = L3_MSG_TYPE_CONN_RESP;
-    connResp.srcId = myNodeId;
-    connResp.destId = userId;
-    connResp.status = accept ? 1 : 2; // 1: accept, 2: reject
+    L3_buildConnectionResponse(&connResp, userId, status, position);
     
-    L3_LLI_dataReqFunc((uint8_t*)&connResp, sizeof(ConnMsg_t), userId);
+    L3_sendControl((uint8_t*)&connResp, sizeof(ConnMsg_t), userId);
+}
+
+void L3_sendJoinResponse(uint8_t userId, uint8_t status, uint8_t service, uint8_t position)
+{
+    JoinMsg_t joinResp;
+    L3_buildJoinResponse(&joinResp, userId, status, service, position);
+    
+    L3_sendControl((uint8_t*)&joinResp, sizeof(JoinMsg_t), userId);
+}
+
+//booth : the user asked for nothing, so the accept is sent again (L3_request) until its ADMIT_ACK
+//no hurry to give up : the place is only lost once L2 could not deliver it or the user stays silent
+static void L3_sendAdmission(uint8_t userId, uint8_t* msg, uint8_t size)
+{
+    if (L3_req_sendPatient(msg, size, userId) == L3_REQ_NONE)
+    {
+        debug("[L3][WARNING] no request left for the admission of %d, sent once\n", userId);
+        L3_sendControl(msg, size, userId);
+    }
+}
+
+//booth : the user is no longer there or left, the admission is not sent again
+static void L3_cancelAdmission(uint8_t userId)
+{
+    L3_req_cancel(L3_req_find(L3_MSG_TYPE_CONN_RESP, userId));
+    L3_req_cancel(L3_req_find(L3_MSG_TYPE_JOIN_RESP, userId));
+}
+
+//user : an accept it did not ask for (admission from the waiting queue, or one sent again) is confirmed
+static void L3_sendAdmitAck(uint8_t boothId)
+{
+    ConnMsg_t ack;
+    ack.msgType = L3_MSG_TYPE_ADMIT_ACK;
+    ack.srcId = myNodeId;
+    ack.destId = boothId;
+    ack.status = 0;
+    ack.position = 0;
+    
+    L3_sendControl((uint8_t*)&ack, sizeof(ConnMsg_t), boothId);
 }
 
 void L3_sendExperienceRequest(uint8_t boothId)
@@ -329,87 +543,169 @@ void L3_sendExperienceRequest(uint8_t boothId)
     expReq.destId = boothId;
     expReq.status = 0; // request
     
-    L3_LLI_dataReqFunc((uint8_t*)&expReq, sizeof(ExperienceMsg_t), boothId);
+    experienceReq = L3_req_send((uint8_t*)&expReq, sizeof(ExperienceMsg_t), boothId);
     pc.printf("[INFO] Experience request sent to Booth %d\n", boothId);
 }
 
-void L3_sendExperienceResponse(uint8_t userId, uint8_t accept)
+void L3_sendExperienceResponse(uint8_t userId, uint8_t status)
 {
     ExperienceMsg_t expResp;
     expResp.msgType = L3_MSG_TYPE_EXPERIENCE_RESP;
     expResp.srcId = myNodeId;
     expResp.destId = userId;
-    expResp.status = accept ? 1 : 2; // 1: accept, 2: reject (capacity full)
+    expResp.status = status; // 1: accept, 2: reject (capacity full)
     
-    L3_LLI_dataReqFunc((uint8_t*)&expResp, sizeof(ExperienceMsg_t), userId);
+    L3_sendControl((uint8_t*)&expResp, sizeof(ExperienceMsg_t), userId);
+}
+
+//builds a group chat message of booth groupId in buf, returns its size
+static uint8_t L3_buildBroadcastMessage(uint8_t* buf, uint8_t groupId, uint8_t* message, uint16_t messageLen)
+{
+    BroadcastMsg_t* header = (BroadcastMsg_t*)buf;
+
+    if (messageLen > L3_BROADCAST_MAXMSGSIZE)
+        messageLen = L3_BROADCAST_MAXMSGSIZE;
+
+    header->msgType = L3_MSG_TYPE_BROADCAST;
+    header->groupId = groupId;
+    header->srcId = myNodeId;
+    header->messageLength = messageLen;
+    memcpy(buf + sizeof(BroadcastMsg_t), message, messageLen);
+
+    return sizeof(BroadcastMsg_t) + messageLen;
+}
+
+//booth : one broadcast frame to the whole experience group, whatever its size
+//returns the L2 result (L3_LLI_REQ_OK when there is nobody to send to)
+int L3_sendBroadcastMessage(uint8_t* message, uint8_t messageLen)
+{
+    uint8_t broadcastMsg[255];
+    uint8_t size;
+
+    if (L3_session_getCount(L3_SESSION_EXPERIENCE) == 0)
+        return L3_LLI_REQ_OK;
+
+    size = L3_buildBroadcastMessage(broadcastMsg, myNodeId, message, messageLen);
+    // 체험 중인 모든 사용자에게 한 번에 브로드캐스트
+    return L3_LLI_dataReqFunc(broadcastMsg, size, 255);
 }
 
-void L3_sendBroadcastMessage(uint8_t* message, uint8_t messageLen)
+//messages dropped for a full L2 transmit queue that nothing sends again (fan-out, relay) : a
+//dropped control message is not counted, the peer's request is sent again and answered again
+uint32_t L3_getDroppedMsgs(void)
 {
-    // 체험 중인 모든 사용자에게 브로드캐스트
-    for (int i = 0; i < numExperienceUsers; i++)
+    return droppedMsgs;
+}
+
+//booth : a member's message goes back out as is, the members filter on the group ID
+static void L3_relayBroadcastMessage(uint8_t* dataPtr, uint8_t size, uint8_t srcId)
+{
+    BroadcastMsg_t* broadcastMsg = (BroadcastMsg_t*)dataPtr;
+
+    if (size < sizeof(BroadcastMsg_t) || size < sizeof(BroadcastMsg_t) + broadcastMsg->messageLength)
     {
-        uint8_t broadcastMsg[L3_MAXDATASIZE];
-        BroadcastMsg_t* header = (BroadcastMsg_t*)broadcastMsg;
-        
-        header->msgType = L3_MSG_TYPE_BROADCAST;
-        header->srcId = myNodeId;
-        header->messageLength = messageLen;
-        memcpy(broadcastMsg + sizeof(BroadcastMsg_t), message, messageLen);
-        
-        L3_LLI_dataReqFunc(broadcastMsg, sizeof(BroadcastMsg_t) + messageLen, experienceUsers[i]);
+        debug_if(DBGMSG_L3, "[L3] Group message from %d is truncated (%d bytes), dropped\n", srcId, size);
+        return;
+    }
+    if (broadcastMsg->groupId != myNodeId ||
+        broadcastMsg->srcId != srcId || !L3_session_check(srcId, L3_SESSION_EXPERIENCE))
+    {
+        debug_if(DBGMSG_L3, "[L3] Group message from %d is not for this booth\n", srcId);
+        return;
+    }
+
+    pc.printf("\n[GROUP from User %d]: %.*s\n", srcId, broadcastMsg->messageLength, (char*)(dataPtr + sizeof(BroadcastMsg_t)));
+    if (L3_LLI_dataReqFunc(dataPtr, size, 255) != L3_LLI_REQ_OK)
+    {
+        pc.printf("[WARNING] Message of User %d not relayed to the group (transmit queue is full)\n", srcId);
+        droppedMsgs++;
     }
 }
 
-void L3_addOrUpdateBooth(uint8_t nodeId, int16_t rssi, int8_t snr)
+void L3_addOrUpdateBooth(BeaconMsg_t* beacon, uint8_t nodeId, int16_t rssi, int8_t snr)
 {
+    BoothNode_t* booth = NULL;
+    
     // 기존 부스 노드 업데이트 확인
     for (int i = 0; i < numDetectedBooths; i++)
     {
         if (detectedBooths[i].nodeId == nodeId)
         {
-            detectedBooths[i].rssi = rssi;
-            detectedBooths[i].snr = snr;
-            detectedBooths[i].isActive = 1;
-            return;
+            booth = &detectedBooths[i];
+            break;
         }
     }
     
     // 새로운 부스 노드 추가
-    if (numDetectedBooths < MAX_BOOTH_NODES)
+    if (booth == NULL)
     {
-        detectedBooths[numDetectedBooths].nodeId = nodeId;
-        detectedBooths[numDetectedBooths].rssi = rssi;
-        detectedBooths[numDetectedBooths].snr = snr;
-        detectedBooths[numDetectedBooths].nodeType = NODE_TYPE_BOOTH;
-        detectedBooths[numDetectedBooths].isActive = 1;
-        numDetectedBooths++;
+        if (numDetectedBooths == MAX_BOOTH_NODES)
+            return;
+        booth = &detectedBooths[numDetectedBooths++];
+        booth->nodeId = nodeId;
+        booth->nodeType = NODE_TYPE_BOOTH;
     }
+    
+    booth->rssi = rssi;
+    booth->snr = snr;
+    booth->isActive = 1;
+    booth->freeConn = beacon->freeConn;
+    booth->freeExp = beacon->freeExp;
+    booth->queueLen = beacon->queueLen;
 }
 
+//link quality plus load : free slots raise the score, waiting users lower it,
+//and a booth with no connection slot left comes after every booth that has one
+static int L3_scoreBooth(BoothNode_t* booth)
+{
+    int score = booth->rssi + L3_SELECT_SLOTWEIGHT*(booth->freeConn + booth->freeExp) - L3_SELECT_QUEUEWEIGHT*booth->queueLen;
+    
+    if (booth->freeConn == 0)
+        score -= L3_SELECT_FULLPENALTY;
+    
+    return score;
+}
+
+//ranks the booths heard by score : a reject or no response moves on to the next one
 void L3_findBestBooth(void)
 {
+    BoothNode_t* best = NULL;
+    int j;
+    
     bestRssi = -200;
     bestBoothId = 0;
+    numCandidates = 0;
     
     for (int i = 0; i < numDetectedBooths; i++)
     {
-        if (detectedBooths[i].isActive && detectedBooths[i].rssi > bestRssi)
-        {
-            bestRssi = detectedBooths[i].rssi;
-            bestBoothId = detectedBooths[i].nodeId;
-        }
+        if (!detectedBooths[i].isActive)
+            continue;
+        
+        for (j = numCandidates; j > 0 && L3_scoreBooth(&detectedBooths[i]) > L3_scoreBooth(candidates[j - 1]); j--)
+            candidates[j] = candidates[j - 1];
+        candidates[j] = &detectedBooths[i];
+        numCandidates++;
+    }
+    nextCandidate = 1;
+    
+    if (numCandidates > 0)
+    {
+        best = candidates[0];
+        bestRssi = best->rssi;
+        bestBoothId = best->nodeId;
     }
     
     scanCompleted = 1;
     scanInProgress = 0;
+    L3_timer_stopTimer(L3_TIMER_PROBE);
     
     if (bestBoothId != 0)
     {
         pc.printf("\n=== BOOTH FOUND ===\n");
         pc.printf("Best Booth ID: %d\n", bestBoothId);
         pc.printf("Signal Strength: %d dBm\n", bestRssi);
-        pc.printf("Do you want to connect? (y/n): ");
+        pc.printf("Free slots: %d (experience %d), waiting: %d\n", best->freeConn, best->freeExp, best->queueLen);
+        pc.printf("Do you want to connect? (y/n, e: connect and experience): ");
     }
     else
     {
@@ -419,6 +715,36 @@ void L3_findBestBooth(void)
     }
 }
 
+//every booth expected ends the scan at once, a booth good enough with room left ends it
+//once the PROBE replies stop (L3_SCAN_QUIETTIME without one, the end of the reply slots
+//at the latest) : the load of the other booths is compared too, and the connection request
+//does not collide with their replies
+static void L3_checkScanDone(BeaconMsg_t* beacon, int16_t rssi, int8_t snr)
+{
+    uint32_t elapsed = us_ticker_read()/1000 - probeTime;
+    uint8_t allHeard = 0;
+    
+#if L3_SCAN_EXPECTEDBOOTHS > 0
+    allHeard = (numDetectedBooths >= L3_SCAN_EXPECTEDBOOTHS);
+#endif
+    if (rssi >= L3_SCAN_RSSITHRESHOLD && snr >= L3_SCAN_SNRTHRESHOLD && beacon->freeConn > 0)
+        goodBoothHeard = 1;
+    if (!allHeard && !goodBoothHeard)
+        return;
+    
+    // 응답이 올 때마다 조용한 구간을 다시 기다림
+    if (!allHeard && elapsed < L3_PROBE_WINDOW)
+    {
+        uint32_t wait = L3_PROBE_WINDOW - elapsed;
+        
+        L3_timer_startTimer(L3_TIMER_SCAN, wait < L3_SCAN_QUIETTIME ? wait : L3_SCAN_QUIETTIME);
+        return;
+    }
+    
+    L3_timer_stopTimer(L3_TIMER_SCAN);
+    L3_findBestBooth();
+}
+
 void L3_handleBeaconMessage(uint8_t* dataPtr, uint8_t srcId, int16_t rssi, int8_t snr)
 {
     BeaconMsg_t* beacon = (BeaconMsg_t*)dataPtr;
@@ -427,77 +753,278 @@ void L3_handleBeaconMessage(uint8_t* dataPtr, uint8_t srcId, int16_t rssi, int8_
     if (scanInProgress && beacon->nodeType == NODE_TYPE_BOOTH)
     {
         debug_if(DBGMSG_L3, "[L3] Booth beacon received from ID %d, RSSI: %d\n", srcId, rssi);
-        L3_addOrUpdateBooth(srcId, rssi, snr);
+        L3_addOrUpdateBooth(beacon, srcId, rssi, snr);
+        L3_checkScanDone(beacon, rssi, snr);
     }
 }
 
-void L3_handleConnectionRequest(uint8_t* dataPtr, uint8_t srcId)
+//booth : a scanning user asked for a beacon, it goes out in a slot of this booth's own
+//so that the booths around do not all answer at once
+void L3_handleProbeMessage(uint8_t srcId)
+{
+    if (probeReplyPending)
+        return;
+    
+    debug_if(DBGMSG_L3, "[L3] Probe received from User %d\n", srcId);
+    probeReplyPending = 1;
+    
+    //the reply is the beacon of a new shortest interval
+    beaconInterval = L3_BEACON_INTERVAL;
+    beaconOffset = (myNodeId % L3_PROBE_SLOTS) * L3_PROBE_SLOTTIME;
+    L3_timer_startTimer(L3_TIMER_BEACON, beaconOffset);
+}
+
+//booth : a full booth puts the user in its waiting queue instead of rejecting it
+void L3_handleConnectionRequest(uint8_t* dataPtr, uint8_t srcId, int16_t rssi, int8_t snr)
 {
     ConnMsg_t* connReq = (ConnMsg_t*)dataPtr;
+    int position;
     
-    if (myNodeType == NODE_TYPE_BOOTH && numConnectedUsers < MAX_BOOTH_CAPACITY)
+    if (myNodeType != NODE_TYPE_BOOTH)
+        return;
+    
+    // 세션 테이블에 사용자 추가 (관리자 화면도 같은 테이블을 사용), 링크 품질은 요청 프레임의 것
+    position = L3_admin_addUser(srcId, rssi, snr, connReq->position);
+    if (position == 0)
     {
-        // 부스가 연결 요청을 받았을 때 (수용 인원 확인)
         pc.printf("[INFO] Connection request from User %d. Accepting...\n", srcId);
-        L3_sendConnectionResponse(srcId, 1); // accept
-        L3_addConnectedUser(srcId);
-        
-        // 관리자 시스템에 사용자 추가
-        if (L3_admin_getStatus() == 1) // ADMIN_MODE_ACTIVE
-        {
-            L3_admin_addUser(srcId, 0, 0); // RSSI와 SNR은 연결 요청에서 가져올 수 없으므로 0으로 설정
-        }
+        L3_sendConnectionResponse(srcId, L3_RESP_ACCEPT, 0);
     }
-    else if (myNodeType == NODE_TYPE_BOOTH)
+    else if (position > 0)
     {
-        // 수용 인원 초과
+        L3_session_find(srcId)->joinService = 0;
+        pc.printf("[INFO] Connection request from User %d. Queueing (position %d)...\n", srcId, position);
+        L3_sendConnectionResponse(srcId, L3_RESP_QUEUED, position);
+    }
+    else
+    {
+        // 대기열까지 꽉 찼거나 사용자가 다른 부스를 시도함
         pc.printf("[INFO] Connection request from User %d. Rejecting (capacity full)...\n", srcId);
-        L3_sendConnectionResponse(srcId, 2); // reject
+        L3_sendConnectionResponse(srcId, L3_RESP_REJECT, 0);
+    }
+}
+
+//booth : a waiting user got a place, it is accepted without asking again (with the
+//experience too if it asked for it with a join request)
+//the accept is resent until the user confirms it, the place goes to the next one if it never does
+void L3_admitWaitingUser(uint8_t userId)
+{
+    L3_session_t* session = L3_session_find(userId);
+    ConnMsg_t connResp;
+    JoinMsg_t joinResp;
+    
+    pc.printf("[INFO] User %d admitted from the waiting queue\n", userId);
+    if (session != NULL && session->joinService == L3_JOIN_SERVICE_EXPERIENCE &&
+        L3_session_getCount(L3_SESSION_EXPERIENCE) < MAX_BOOTH_CAPACITY)
+    {
+        L3_session_add(userId, L3_SESSION_EXPERIENCE);
+        L3_buildJoinResponse(&joinResp, userId, L3_RESP_ACCEPT, L3_JOIN_SERVICE_EXPERIENCE, 0);
+        L3_sendAdmission(userId, (uint8_t*)&joinResp, sizeof(JoinMsg_t));
+    }
+    else if (session != NULL && session->joinService != 0)
+    {
+        L3_buildJoinResponse(&joinResp, userId, L3_RESP_ACCEPT, L3_JOIN_SERVICE_CONNECT, 0);
+        L3_sendAdmission(userId, (uint8_t*)&joinResp, sizeof(JoinMsg_t));
+    }
+    else
+    {
+        L3_buildConnectionResponse(&connResp, userId, L3_RESP_ACCEPT, 0);
+        L3_sendAdmission(userId, (uint8_t*)&connResp, sizeof(ConnMsg_t));
     }
 }
 
+//booth : the admitted user has its accept
+static void L3_handleAdmitAck(uint8_t srcId)
+{
+    uint8_t req = L3_req_find(L3_MSG_TYPE_CONN_RESP, srcId);
+    
+    if (req == L3_REQ_NONE)
+        req = L3_req_find(L3_MSG_TYPE_JOIN_RESP, srcId);
+    L3_req_complete(req);
+}
+
+//user : connected already, the booth did not get the ADMIT_ACK and sent its accept again
+static void L3_handleRepeatedAdmission(uint8_t* dataPtr, uint8_t srcId)
+{
+    if (srcId == connectedBoothId && ((ConnMsg_t*)dataPtr)->status == L3_RESP_ACCEPT)
+        L3_sendAdmitAck(srcId);
+}
+
+//user : the booth queued the request, its accept comes by itself once a place frees up
+static void L3_waitInLine(uint8_t boothId, uint8_t position)
+{
+    connectionRequested = 0;
+    connectReq = L3_REQ_NONE;
+    pc.printf("[INFO] Booth %d is full, waiting in line (position %d)\n", boothId, position);
+    pc.printf("You will be let in as soon as a place frees up.\n");
+}
+
 void L3_handleConnectionResponse(uint8_t* dataPtr, uint8_t srcId)
 {
     ConnMsg_t* connResp = (ConnMsg_t*)dataPtr;
+    uint8_t req = L3_req_find(L3_MSG_TYPE_CONN_REQ, srcId);
+    
+    // 앞서 응답이 없던 부스의 늦은 승인도 받아들임 (그 부스에는 이미 세션이 있음)
+    // 늦은 거절은 이미 다음 후보로 넘어갔으므로 무시
+    if (connResp->status != L3_RESP_ACCEPT && req == L3_REQ_NONE)
+    {
+        debug_if(DBGMSG_L3, "[L3] Late response from Booth %d ignored\n", srcId);
+        return;
+    }
+    if (connResp->status == L3_RESP_ACCEPT && req == L3_REQ_NONE && myNodeType == NODE_TYPE_USER)
+        L3_sendAdmitAck(srcId);
+    L3_req_complete(req);
     
-    if (myNodeType == NODE_TYPE_USER && connResp->status == 1)
+    if (myNodeType == NODE_TYPE_USER && connResp->status == L3_RESP_ACCEPT)
     {
-        // 사용자가 연결 승인을 받았을 때
+        // 사용자가 연결 승인을 받았을 때 (다른 부스로의 요청은 그만둠)
+        L3_req_cancel(connectReq);
+        connectReq = L3_REQ_NONE;
         pc.printf("[INFO] Connection accepted by Booth %d!\n", srcId);
         connectedBoothId = srcId;
         isConnected = 1;
         main_state = L3STATE_CONNECTED;
         pc.printf("Connected! Do you want to experience the booth? (y/n): ");
     }
-    else if (connResp->status == 2)
+    else if (connResp->status == L3_RESP_REJECT)
     {
         pc.printf("[INFO] Connection rejected by Booth %d (may be full)\n", srcId);
         connectionRequested = 0;
+        L3_tryNextBooth();
+    }
+    else if (connResp->status == L3_RESP_QUEUED)
+    {
+        L3_waitInLine(srcId, connResp->position);
     }
 }
 
-void L3_handleExperienceRequest(uint8_t* dataPtr, uint8_t srcId)
+//booth : both sessions are taken before the response goes out, so the group traffic that follows
+//it already counts the user in
+void L3_handleJoinRequest(uint8_t* dataPtr, uint8_t srcId, int16_t rssi, int8_t snr)
 {
-    ExperienceMsg_t* expReq = (ExperienceMsg_t*)dataPtr;
+    JoinMsg_t* joinReq = (JoinMsg_t*)dataPtr;
+    uint8_t service = L3_JOIN_SERVICE_CONNECT;
+    int position;
+    
+    if (myNodeType != NODE_TYPE_BOOTH)
+        return;
+    
+    position = L3_admin_addUser(srcId, rssi, snr, joinReq->position);
+    if (position < 0)
+    {
+        // 대기열까지 꽉 찼거나 사용자가 다른 부스를 시도함
+        pc.printf("[INFO] Join request from User %d. Rejecting (capacity full)...\n", srcId);
+        L3_sendJoinResponse(srcId, L3_RESP_REJECT, 0, 0);
+        return;
+    }
+    if (position > 0)
+    {
+        // 자리가 나면 요청한 서비스까지 한 번에 승인
+        L3_session_find(srcId)->joinService = joinReq->service;
+        pc.printf("[INFO] Join request from User %d. Queueing (position %d)...\n", srcId, position);
+        L3_sendJoinResponse(srcId, L3_RESP_QUEUED, 0, position);
+        return;
+    }
+    
+    if (joinReq->service == L3_JOIN_SERVICE_EXPERIENCE && (L3_session_check(srcId, L3_SESSION_EXPERIENCE) ||
+                                                           L3_session_getCount(L3_SESSION_EXPERIENCE) < MAX_BOOTH_CAPACITY))
+    {
+        L3_session_add(srcId, L3_SESSION_EXPERIENCE);
+        service = L3_JOIN_SERVICE_EXPERIENCE;
+    }
+    
+    pc.printf("[INFO] Join request from User %d. Accepting%s...\n", srcId,
+              service == L3_JOIN_SERVICE_EXPERIENCE ? " into the experience" : " (experience full)");
+    L3_sendJoinResponse(srcId, L3_RESP_ACCEPT, service, 0);
+}
+
+//user : like a connection response, and an accept with the experience skips CONNECTED
+void L3_handleJoinResponse(uint8_t* dataPtr, uint8_t srcId)
+{
+    JoinMsg_t* joinResp = (JoinMsg_t*)dataPtr;
+    uint8_t req = L3_req_find(L3_MSG_TYPE_JOIN_REQ, srcId);
+    
+    if (myNodeType != NODE_TYPE_USER || (joinResp->status != L3_RESP_ACCEPT && req == L3_REQ_NONE))
+    {
+        debug_if(DBGMSG_L3, "[L3] Join response from Booth %d ignored\n", srcId);
+        return;
+    }
+    if (req == L3_REQ_NONE)
+        L3_sendAdmitAck(srcId);
+    L3_req_complete(req);
+    
+    if (joinResp->status == L3_RESP_REJECT)
+    {
+        pc.printf("[INFO] Join rejected by Booth %d (may be full)\n", srcId);
+        connectionRequested = 0;
+        L3_tryNextBooth();
+        return;
+    }
+    if (joinResp->status == L3_RESP_QUEUED)
+    {
+        L3_waitInLine(srcId, joinResp->position);
+        return;
+    }
     
-    if (myNodeType == NODE_TYPE_BOOTH && numExperienceUsers < MAX_BOOTH_CAPACITY)
+    L3_req_cancel(connectReq);
+    connectReq = L3_REQ_NONE;
+    connectedBoothId = srcId;
+    isConnected = 1;
+    
+    if (joinResp->service == L3_JOIN_SERVICE_EXPERIENCE)
+    {
+        pc.printf("[INFO] Joined Booth %d!\n", srcId);
+        inExperience = 1;
+        main_state = L3STATE_IN_USE;
+        pc.printf("=== BOOTH EXPERIENCE STARTED ===\n");
+        pc.printf("You are now in group chat mode. Send messages to all participants:\n");
+        pc.printf("Enter message: ");
+    }
+    else
+    {
+        pc.printf("[INFO] Connection accepted by Booth %d, experience full\n", srcId);
+        main_state = L3STATE_CONNECTED;
+        pc.printf("Connected! Do you want to experience the booth? (y/n): ");
+    }
+}
+
+void L3_handleExperienceRequest(uint8_t*, uint8_t srcId)
+{
+    if (myNodeType == NODE_TYPE_BOOTH && !L3_session_check(srcId, L3_SESSION_CONNECTED))
+    {
+        // 연결되지 않은 사용자 (대기 중, 연결 해제됨, 모르는 노드) 는 체험할 수 없음
+        pc.printf("[INFO] Experience request from User %d. Rejecting (not connected)...\n", srcId);
+        L3_sendExperienceResponse(srcId, L3_RESP_REJECT);
+    }
+    else if (myNodeType == NODE_TYPE_BOOTH && (L3_session_check(srcId, L3_SESSION_EXPERIENCE) ||
+                                               L3_session_getCount(L3_SESSION_EXPERIENCE) < MAX_BOOTH_CAPACITY))
     {
         // 부스가 체험 요청을 받았을 때 (수용 인원 확인)
         pc.printf("[INFO] Experience request from User %d. Accepting...\n", srcId);
-        L3_sendExperienceResponse(srcId, 1); // accept
-        L3_addExperienceUser(srcId);
+        L3_sendExperienceResponse(srcId, L3_RESP_ACCEPT);
+        L3_session_add(srcId, L3_SESSION_EXPERIENCE);
     }
     else if (myNodeType == NODE_TYPE_BOOTH)
     {
         // 수용 인원 초과
         pc.printf("[INFO] Experience request from User %d. Rejecting (capacity full)...\n", srcId);
-        L3_sendExperienceResponse(srcId, 2); // reject
+        L3_sendExperienceResponse(srcId, L3_RESP_REJECT);
     }
 }
 
 void L3_handleExperienceResponse(uint8_t* dataPtr, uint8_t srcId)
 {
     ExperienceMsg_t* expResp = (ExperienceMsg_t*)dataPtr;
+    uint8_t req = L3_req_find(L3_MSG_TYPE_EXPERIENCE_REQ, srcId);
+    
+    // 재전송된 요청의 중복 응답은 무시
+    if (req == L3_REQ_NONE)
+    {
+        debug_if(DBGMSG_L3, "[L3] Experience response from Booth %d without a request\n", srcId);
+        return;
+    }
+    L3_req_complete(req);
+    experienceReq = L3_REQ_NONE;
     
     if (myNodeType == NODE_TYPE_USER && expResp->status == 1)
     {
@@ -518,14 +1045,22 @@ void L3_handleExperienceResponse(uint8_t* dataPtr, uint8_t srcId)
     }
 }
 
-void L3_handleBroadcastMessage(uint8_t* dataPtr, uint8_t srcId)
+void L3_handleBroadcastMessage(uint8_t* dataPtr, uint8_t size, uint8_t srcId)
 {
     BroadcastMsg_t* broadcastMsg = (BroadcastMsg_t*)dataPtr;
     char* message = (char*)(dataPtr + sizeof(BroadcastMsg_t));
     
+    // 헤더와 메시지 길이만큼 오지 않은 프레임은 버림
+    if (size < sizeof(BroadcastMsg_t) || size < sizeof(BroadcastMsg_t) + broadcastMsg->messageLength)
+        return;
+    
+    // 내 부스 그룹의 메시지만, 내가 보낸 메시지의 중계본은 제외
+    if (srcId != connectedBoothId || broadcastMsg->groupId != connectedBoothId || broadcastMsg->srcId == myNodeId)
+        return;
+    
     pc.printf("\n[BROADCAST from %s %d]: %.*s\n", 
-              (srcId >= 100) ? "Booth" : "User", 
-              srcId, 
+              (broadcastMsg->srcId >= 100) ? "Booth" : "User", 
+              broadcastMsg->srcId, 
               broadcastMsg->messageLength, 
               message);
     
@@ -538,6 +1073,10 @@ void L3_handleBroadcastMessage(uint8_t* dataPtr, uint8_t srcId)
 void L3_initFSM(uint8_t userId) // 파라미터명 변경: destId -> userId
 {
     myNodeId = userId; // myDestId -> myNodeId로 변경
+    numHeldMsgs = 0;
+    L3_timer_init();
+    L3_session_init();
+    L3_req_init();
     
     // 노드 타입 설정 (ID에 따라 구분)
     if (userId >= 100) // ID 100 이상은 부스로 가정
@@ -552,8 +1091,10 @@ void L3_initFSM(uint8_t userId) // 파라미터명 변경: destId -> userId
         pc.printf("Booth capacity: %d users\n", MAX_BOOTH_CAPACITY);
         pc.printf("Waiting for user connections...\n");
         
-        // 부스는 자동으로 비콘 전송 시작
-        L3_timer_startTimer();
+        // 부스는 자동으로 비콘 전송 시작 (가장 짧은 주기부터)
+        beaconInterval = L3_BEACON_INTERVAL;
+        beaconOffset = L3_getBeaconOffset(beaconInterval);
+        L3_timer_startTimer(L3_TIMER_BEACON, beaconOffset);
     }
     else
     {
@@ -566,8 +1107,43 @@ void L3_initFSM(uint8_t userId) // 파라미터명 변경: destId -> userId
     pc.attach(&L3service_processInputWord, Serial::RxIrq);
 }
 
-void L3_FSMrun(void)
+//events the FSM handles, in every state
+#define L3_EVENTS           (L3_EVENT_MASK(L3_event_msgRcvd) | L3_EVENT_MASK(L3_event_dataToSend) | \
+                             L3_EVENT_MASK(L3_event_dataSendCnf))
+
+//a request got no response after its last try, or L2 could not deliver it
+static void L3_handleFailedRequests(void)
+{
+    uint8_t msgType, destId;
+    
+    while (L3_req_getFailed(&msgType, &destId))
+    {
+        if ((msgType == L3_MSG_TYPE_CONN_REQ || msgType == L3_MSG_TYPE_JOIN_REQ) && main_state == L3STATE_SCANNING)
+        {
+            // 응답 없는 부스는 건너뜀
+            pc.printf("[INFO] No response from Booth %d\n", destId);
+            L3_tryNextBooth();
+        }
+        else if (msgType == L3_MSG_TYPE_EXPERIENCE_REQ)
+        {
+            experienceReq = L3_REQ_NONE;
+            pc.printf("[INFO] No response from Booth %d to the experience request\n", destId);
+            pc.printf("Do you want to experience the booth? (y/n): ");
+        }
+        else if (msgType == L3_MSG_TYPE_CONN_RESP || msgType == L3_MSG_TYPE_JOIN_RESP)
+        {
+            // 부스 : 승인을 확인하지 않은 사용자는 내보내고 다음 대기자에게 자리를 줌
+            pc.printf("[INFO] User %d did not confirm its admission, dropped\n", destId);
+            L3_admin_removeUser(destId);
+        }
+    }
+}
+
+//handles the highest priority pending event, returns 0 if there was none
+static uint8_t L3_FSMstep(void)
 {   
+    int event;
+
     if (prev_state != main_state)
     {
         debug_if(DBGMSG_L3, "[L3] State transition from %i to %i\n", prev_state, main_state);
@@ -575,28 +1151,43 @@ void L3_FSMrun(void)
     }
 
     //FSM should be implemented here! ---->>>>
+    event = L3_event_getEvent(L3_EVENTS);
+    
+    // 제어 요청의 재전송과 실패 처리 (DATA_CNF 결과는 L3_request가 이미 받음)
+    if (event == L3_event_dataSendCnf)
+    {
+        L3_event_clearEventFlag(L3_event_dataSendCnf);
+        L3_sendHeldControl();
+    }
+    L3_req_run();
+    L3_handleFailedRequests();
+
     switch (main_state)
     {
         case L3STATE_SCANNING: //SCANNING state (메인 상태)
             
             // 타이머 만료 시 처리
-            if (!L3_timer_getTimerStatus())
+            if (myNodeType == NODE_TYPE_BOOTH && !L3_timer_getTimerStatus(L3_TIMER_BEACON))
             {
-                if (myNodeType == NODE_TYPE_BOOTH)
-                {
-                    // 부스는 주기적으로 비콘 전송
-                    L3_sendBeacon();
-                    L3_timer_startTimer(); // 타이머 재시작
-                }
-                else if (myNodeType == NODE_TYPE_USER && scanInProgress)
-                {
-                    // 사용자 스캔 타임아웃
-                    L3_findBestBooth();
-                    // 스캔 완료 후 타이머 재시작하지 않음
-                }
+                // 부스는 비콘 전송 후 주기를 늘려 다음 비콘 예약
+                L3_sendBeacon();
+                L3_scheduleNextBeacon();
+            }
+            else if (myNodeType == NODE_TYPE_USER && scanInProgress && !L3_timer_getTimerStatus(L3_TIMER_SCAN))
+            {
+                // 사용자 스캔 타임아웃
+                L3_findBestBooth();
+                // 스캔 완료 후 타이머 재시작하지 않음
+            }
+            else if (myNodeType == NODE_TYPE_USER && scanInProgress && numDetectedBooths == 0 &&
+                     !L3_timer_getTimerStatus(L3_TIMER_PROBE))
+            {
+                // 아직 응답한 부스가 없으면 PROBE (재)전송
+                L3_sendProbe();
+                L3_timer_startTimer(L3_TIMER_PROBE, L3_PROBE_RETRY);
             }
             
-            if (L3_event_checkEventFlag(L3_event_msgRcvd)) //if data reception event happens
+            if (event == L3_event_msgRcvd) //if data reception event happens
             {
                 //Retrieving data info.
                 uint8_t* dataPtr = L3_LLI_getMsgPtr();
@@ -607,6 +1198,14 @@ void L3_FSMrun(void)
                 
                 uint8_t msgType = dataPtr[0];
                 
+                // 부스 : 모르는 사용자가 보이면 비콘 주기를 다시 짧게 (연결 요청자는 이미 부스를 찾았음)
+                if (myNodeType == NODE_TYPE_BOOTH && msgType != L3_MSG_TYPE_BEACON && msgType != L3_MSG_TYPE_CONN_REQ &&
+                    msgType != L3_MSG_TYPE_JOIN_REQ &&
+                    L3_session_find(srcId) == NULL)
+                {
+                    L3_resetBeaconInterval();
+                }
+                
                 switch (msgType)
                 {
                     case L3_MSG_TYPE_BEACON:
@@ -616,14 +1215,52 @@ void L3_FSMrun(void)
                         }
                         break;
                         
+                    case L3_MSG_TYPE_PROBE:
+                        if (myNodeType == NODE_TYPE_BOOTH)
+                        {
+                            L3_handleProbeMessage(srcId);
+                        }
+                        break;
+                        
                     case L3_MSG_TYPE_CONN_REQ:
-                        L3_handleConnectionRequest(dataPtr, srcId);
+                        L3_handleConnectionRequest(dataPtr, srcId, rssi, snr);
                         break;
                         
                     case L3_MSG_TYPE_CONN_RESP:
                         L3_handleConnectionResponse(dataPtr, srcId);
                         break;
                         
+                    case L3_MSG_TYPE_JOIN_REQ:
+                        L3_handleJoinRequest(dataPtr, srcId, rssi, snr);
+                        break;
+                        
+                    case L3_MSG_TYPE_JOIN_RESP:
+                        L3_handleJoinResponse(dataPtr, srcId);
+                        break;
+                        
+                    case L3_MSG_TYPE_ADMIT_ACK:
+                        if (myNodeType == NODE_TYPE_BOOTH)
+                        {
+                            L3_handleAdmitAck(srcId);
+                        }
+                        break;
+                        
+                    case L3_MSG_TYPE_EXPERIENCE_REQ:
+                        // 부스는 SCANNING 상태에 머무르므로 여기서 체험 요청 처리
+                        if (myNodeType == NODE_TYPE_BOOTH)
+                        {
+                            L3_handleExperienceRequest(dataPtr, srcId);
+                        }
+                        break;
+                        
+                    case L3_MSG_TYPE_BROADCAST:
+                        // 체험 사용자의 단체 채팅 메시지를 그룹 전체에 중계
+                        if (myNodeType == NODE_TYPE_BOOTH)
+                        {
+                            L3_relayBroadcastMessage(dataPtr, size, srcId);
+                        }
+                        break;
+                        
                     case L3_MSG_TYPE_ANNOUNCEMENT:
                         if (myNodeType == NODE_TYPE_USER)
                         {
@@ -641,11 +1278,14 @@ void L3_FSMrun(void)
                 
                 L3_event_clearEventFlag(L3_event_msgRcvd);
             }
-            else if (L3_event_checkEventFlag(L3_event_dataToSend)) //connection request
+            else if (event == L3_event_dataToSend) //connection request
             {
-                if (myNodeType == NODE_TYPE_USER && connectionRequested && bestBoothId != 0)
+                if (myNodeType == NODE_TYPE_USER && connectionRequested && bestBoothId != 0 && connectReq == L3_REQ_NONE)
                 {
-                    L3_sendConnectionRequest(bestBoothId);
+                    if (joinService != 0)
+                        L3_sendJoinRequest(bestBoothId, joinService);
+                    else
+                        L3_sendConnectionRequest(bestBoothId);
                     connectionRequested = 0;
                 }
                 
@@ -655,7 +1295,7 @@ void L3_FSMrun(void)
 
         case L3STATE_CONNECTED: //CONNECTED state
             
-            if (L3_event_checkEventFlag(L3_event_msgRcvd)) //if data reception event happens
+            if (event == L3_event_msgRcvd) //if data reception event happens
             {
                 //Retrieving data info.
                 uint8_t* dataPtr = L3_LLI_getMsgPtr();
@@ -676,7 +1316,7 @@ void L3_FSMrun(void)
                         break;
                         
                     case L3_MSG_TYPE_CONN_REQ:
-                        L3_handleConnectionRequest(dataPtr, srcId);
+                        L3_handleConnectionRequest(dataPtr, srcId, L3_LLI_getRssi(), L3_LLI_getSnr());
                         break;
                         
                     case L3_MSG_TYPE_EXPERIENCE_REQ:
@@ -687,6 +1327,11 @@ void L3_FSMrun(void)
                         L3_handleExperienceResponse(dataPtr, srcId);
                         break;
                         
+                    case L3_MSG_TYPE_CONN_RESP:
+                    case L3_MSG_TYPE_JOIN_RESP:
+                        L3_handleRepeatedAdmission(dataPtr, srcId);
+                        break;
+                        
                     case L3_MSG_TYPE_ANNOUNCEMENT:
                         // 연결된 상태에서도 공지 메시지 처리
                         if (myNodeType == NODE_TYPE_USER)
@@ -705,12 +1350,13 @@ void L3_FSMrun(void)
                 
                 L3_event_clearEventFlag(L3_event_msgRcvd);
             }
-            else if (L3_event_checkEventFlag(L3_event_dataToSend)) //if data needs to be sent
+            else if (event == L3_event_dataToSend) //if data needs to be sent
             {
                 if (myNodeType == NODE_TYPE_USER && experienceRequested)
                 {
-                    // 체험 요청 전송
-                    L3_sendExperienceRequest(connectedBoothId);
+                    // 체험 요청 전송 (응답을 기다리는 중이면 그대로 둠)
+                    if (experienceReq == L3_REQ_NONE)
+                        L3_sendExperienceRequest(connectedBoothId);
                     experienceRequested = 0;
                 }
                 else if (wordLen > 0) //일반 메시지 전송
@@ -722,17 +1368,19 @@ void L3_FSMrun(void)
                     if (myNodeType == NODE_TYPE_USER && isConnected)
                     {
                         // 사용자가 부스에게 개별 메시지 전송
-                        L3_LLI_dataReqFunc(sdu, wordLen + 1, connectedBoothId);
-                        debug_if(DBGMSG_L3, "[L3] Message sent to Booth %d: %s\n", connectedBoothId, originalWord);
+                        if (L3_LLI_dataReqFunc(sdu, wordLen + 1, connectedBoothId) == L3_LLI_REQ_OK)
+                            debug_if(DBGMSG_L3, "[L3] Message sent to Booth %d: %s\n", connectedBoothId, originalWord);
+                        else
+                            pc.printf("[WARNING] Message not sent (transmit queue is full), try again\n");
                     }
-                    else if (myNodeType == NODE_TYPE_BOOTH && numConnectedUsers > 0)
+                    else if (myNodeType == NODE_TYPE_BOOTH && L3_session_getCount(L3_SESSION_CONNECTED) > 0)
                     {
                         // 부스가 연결된 사용자들에게 메시지 전송
-                        for (int i = 0; i < numConnectedUsers; i++)
-                        {
-                            L3_LLI_dataReqFunc(sdu, wordLen + 1, connectedUsers[i]);
-                        }
-                        debug_if(DBGMSG_L3, "[L3] Message sent to %d connected users: %s\n", numConnectedUsers, originalWord);
+                        int refused = L3_sendToUsers(sdu, wordLen + 1, L3_SESSION_CONNECTED);
+
+                        if (refused > 0)
+                            pc.printf("[WARNING] Message not sent to %d of the users (transmit queue is full)\n", refused);
+                        debug_if(DBGMSG_L3, "[L3] Message sent to %d connected users: %s\n", L3_session_getCount(L3_SESSION_CONNECTED), originalWord);
                     }
                     
                     // 입력 버퍼 초기화
@@ -749,7 +1397,7 @@ void L3_FSMrun(void)
 
         case L3STATE_IN_USE: //IN_USE state (부스 체험 중)
             
-            if (L3_event_checkEventFlag(L3_event_msgRcvd)) //if data reception event happens
+            if (event == L3_event_msgRcvd) //if data reception event happens
             {
                 //Retrieving data info.
                 uint8_t* dataPtr = L3_LLI_getMsgPtr();
@@ -770,14 +1418,19 @@ void L3_FSMrun(void)
                         break;
                         
                     case L3_MSG_TYPE_BROADCAST:
-                        L3_handleBroadcastMessage(dataPtr, srcId);
+                        L3_handleBroadcastMessage(dataPtr, size, srcId);
+                        break;
+                        
+                    case L3_MSG_TYPE_CONN_RESP:
+                    case L3_MSG_TYPE_JOIN_RESP:
+                        L3_handleRepeatedAdmission(dataPtr, srcId);
                         break;
                         
                     case L3_MSG_TYPE_CONN_REQ:
                         // 체험 중에도 새로운 연결 요청 처리 (부스만)
                         if (myNodeType == NODE_TYPE_BOOTH)
                         {
-                            L3_handleConnectionRequest(dataPtr, srcId);
+                            L3_handleConnectionRequest(dataPtr, srcId, L3_LLI_getRssi(), L3_LLI_getSnr());
                         }
                         break;
                         
@@ -807,28 +1460,28 @@ void L3_FSMrun(void)
                 
                 L3_event_clearEventFlag(L3_event_msgRcvd);
             }
-            else if (L3_event_checkEventFlag(L3_event_dataToSend)) //브로드캐스트 메시지 전송
+            else if (event == L3_event_dataToSend) //브로드캐스트 메시지 전송
             {
                 if (wordLen > 0)
                 {
                     if (myNodeType == NODE_TYPE_USER && inExperience)
                     {
-                        // 사용자가 부스에게 브로드캐스트 요청
-                        sdu[0] = L3_MSG_TYPE_BROADCAST;
-                        sdu[1] = myNodeId; // srcId
-                        sdu[2] = wordLen; // messageLength
-                        memcpy(sdu + 3, originalWord, wordLen);
+                        // 사용자가 부스에게 브로드캐스트 요청 (부스가 그룹 전체에 중계)
+                        uint8_t size = L3_buildBroadcastMessage(sdu, connectedBoothId, originalWord, wordLen);
                         
-                        L3_LLI_dataReqFunc(sdu, wordLen + 3, connectedBoothId);
-                        debug_if(DBGMSG_L3, "[L3] Broadcast message sent to Booth %d: %s\n", connectedBoothId, originalWord);
+                        if (L3_LLI_dataReqFunc(sdu, size, connectedBoothId) == L3_LLI_REQ_OK)
+                            debug_if(DBGMSG_L3, "[L3] Broadcast message sent to Booth %d: %s\n", connectedBoothId, originalWord);
+                        else
+                            pc.printf("[WARNING] Message not sent (transmit queue is full), try again\n");
                         
                         pc.printf("Enter message: ");
                     }
-                    else if (myNodeType == NODE_TYPE_BOOTH && numExperienceUsers > 0)
+                    else if (myNodeType == NODE_TYPE_BOOTH && L3_session_getCount(L3_SESSION_EXPERIENCE) > 0)
                     {
                         // 부스가 체험 중인 모든 사용자에게 브로드캐스트
-                        L3_sendBroadcastMessage(originalWord, wordLen);
-                        debug_if(DBGMSG_L3, "[L3] Broadcast message sent to %d experience users: %s\n", numExperienceUsers, originalWord);
+                        if (L3_sendBroadcastMessage(originalWord, wordLen) != L3_LLI_REQ_OK)
+                            pc.printf("[WARNING] Group message not sent (transmit queue is full), try again\n");
+                        debug_if(DBGMSG_L3, "[L3] Broadcast message sent to the %d experience users: %s\n", L3_session_getCount(L3_SESSION_EXPERIENCE), originalWord);
                     }
                     
                     // 입력 버퍼 초기화
@@ -844,19 +1497,30 @@ void L3_FSMrun(void)
             debug_if(DBGMSG_L3, "[L3] Unknown state: %d\n", main_state);
             break;
     }
+
+    return (event != L3_EVENT_NONE);
 }
 
-//data reception FSM event
-void L3_recvDataFromLowerLayer(uint8_t* ptr, uint8_t size, uint8_t srcId, int16_t rssi, int8_t snr)
+//handles pending events in priority order, up to L3_FSM_EVENTBUDGET of them per call
+//returns the number handled, an expired timer included (0 : nothing to do until the next event)
+uint8_t L3_FSMrun(void)
 {
-    debug_if(DBGMSG_L3, "[L3] Received data from node %d, size: %d, RSSI: %d, SNR: %d\n", 
-             srcId, size, rssi, snr);
+    uint8_t handled;
+    uint8_t timerWork = L3_timer_takeFired();   //the first step handles it, even with no event
+
+    for (handled = 0; handled < L3_FSM_EVENTBUDGET; handled++)
+    {
+        if (L3_FSMstep() == 0)
+            break;
+    }
+
+    return handled + timerWork;
 }
 
 // 관리자 시스템을 위한 추가 함수들
 void L3_admin_sendAnnouncement(char* message, uint8_t messageLen)
 {
-    if (myNodeType == NODE_TYPE_BOOTH && numConnectedUsers > 0)
+    if (myNodeType == NODE_TYPE_BOOTH && L3_session_getCount(L3_SESSION_CONNECTED) > 0)
     {
         // 공지 메시지 구조: [msgType][srcId][messageLength][message]
         uint8_t announcementMsg[L3_MAXDATASIZE];
@@ -866,50 +1530,38 @@ void L3_admin_sendAnnouncement(char* message, uint8_t messageLen)
         memcpy(announcementMsg + 3, message, messageLen);
         
         // 연결된 모든 사용자에게 공지 전송
-        for (int i = 0; i < numConnectedUsers; i++)
-        {
-            L3_LLI_dataReqFunc(announcementMsg, messageLen + 3, connectedUsers[i]);
-        }
+        int refused = L3_sendToUsers(announcementMsg, messageLen + 3, L3_SESSION_CONNECTED);
         
-        pc.printf("[ADMIN] Announcement sent to %d users: %.*s\n", numConnectedUsers, messageLen, message);
+        pc.printf("[ADMIN] Announcement sent to %d users: %.*s\n", L3_session_getCount(L3_SESSION_CONNECTED) - refused, messageLen, message);
+        if (refused > 0)
+            pc.printf("[ADMIN] %d users did not get it (transmit queue is full)\n", refused);
     }
 }
 
 uint8_t L3_admin_getConnectedUserCount(void)
 {
-    return numConnectedUsers;
+    return L3_session_getCount(L3_SESSION_CONNECTED);
 }
 
 uint8_t L3_admin_getExperienceUserCount(void)
 {
-    return numExperienceUsers;
-}
-
-uint8_t* L3_admin_getConnectedUsers(void)
-{
-    return connectedUsers;
-}
-
-uint8_t* L3_admin_getExperienceUsers(void)
-{
-    return experienceUsers;
+    return L3_session_getCount(L3_SESSION_EXPERIENCE);
 }
 
 void L3_admin_disconnectUser(uint8_t userId)
 {
-    // 연결된 사용자 목록에서 제거
-    L3_removeConnectedUser(userId);
-    
-    // 체험 중인 사용자 목록에서도 제거
-    L3_removeExperienceUser(userId);
+    // 연결된 사용자 목록과 체험 중인 사용자 목록에서 제거
+    L3_cancelAdmission(userId);
+    L3_admin_removeUser(userId);
     
     pc.printf("[ADMIN] User %d has been disconnected\n", userId);
 }
 
 void L3_admin_kickUserFromExperience(uint8_t userId)
 {
-    // 체험 중인 사용자 목록에서만 제거
-    L3_removeExperienceUser(userId);
+    // 체험 중인 사용자 목록에서만 제거, 빈 자리는 대기열 맨 앞 사용자에게
+    L3_session_remove(userId, L3_SESSION_EXPERIENCE);
     
     pc.printf("[ADMIN] User %d has been removed from experience\n", userId);
+    L3_admin_admitWaiting();
 }
\ No newline at end of file
@@ -1,2 +1,6 @@
 void L3_initFSM(uint8_t);
-void L3_FSMrun(void);
\ No newline at end of file
+uint8_t L3_FSMrun(void);
+int L3_sendBroadcastMessage(uint8_t* message, uint8_t messageLen);
+uint32_t L3_getDroppedMsgs(void);
+void L3_admitWaitingUser(uint8_t userId);
+void L3_admin_disconnectUser(uint8_t userId);
@@ -1,6 +1,7 @@
 #include "mbed.h"
 #include "L3_FSMevent.h" 
 #include "L3_msg.h"
+#include "L3_request.h"
 #include "L2_LLinterface.h"  // Added to access L2 RSSI/SNR functions
 #include "protocol_parameters.h"
 #include "time.h"
@@ -13,8 +14,10 @@ static uint8_t rcvdSrcId;
 
 //Downward primitives
 //TX function
-void (*L3_LLI_dataReqFunc)(uint8_t* msg, uint8_t size, uint8_t destId);
+int (*L3_LLI_dataReqFunc)(uint8_t* msg, uint8_t size, uint8_t destId);
+int (*L3_LLI_unorderedReqFunc)(uint8_t* msg, uint8_t size, uint8_t destId);
 void (*L3_LLI_reconfigSrcIdReqFunc)(uint8_t myId);
+uint8_t (*L3_LLI_sduIdFunc)(void);
 
 //interface event : DATA_IND, RX data has arrived
 void L3_LLI_dataInd(uint8_t* dataPtr, uint8_t srcId, uint8_t size, int8_t snr, int16_t rssi)
@@ -31,12 +34,20 @@ void L3_LLI_dataInd(uint8_t* dataPtr, uint8_t srcId, uint8_t size, int8_t snr, i
     L3_event_setEventFlag(L3_event_msgRcvd);
 }
 
-void L3_LLI_dataCnf(uint8_t res)
+//interface event : DATA_CNF, L2 is done with SDU sduId to destId
+void L3_LLI_dataCnf(uint8_t res, uint8_t destId, uint8_t sduId)
 {
-    debug_if(DBGMSG_L3, "\n --> DATA CNF : res : %i\n", res);
+    debug_if(DBGMSG_L3, "\n --> DATA CNF : res : %i, to node:%d, SDU %d\n", res, destId, sduId);
+    L3_req_handleCnf(res, sduId);
     L3_event_setEventFlag(L3_event_dataSendCnf);
 }
 
+//1 while the last DATA_IND is not handled yet : there is room for one message
+uint8_t L3_LLI_checkMsgPending(void)
+{
+    return L3_event_checkEventFlag(L3_event_msgRcvd) != 0;
+}
+
 void L3_LLI_reconfigSrcIdCnf(uint8_t res)
 {
     debug_if(DBGMSG_L3, "\n --> RECONFIG SRCID CNF : res : %i\n", res);
@@ -82,16 +93,22 @@ int8_t L3_LLI_getCurrentSnr()
 }
 
 // Setter functions
-void L3_LLI_setDataReqFunc(void (*funcPtr)(uint8_t*, uint8_t, uint8_t))
+void L3_LLI_setDataReqFunc(int (*funcPtr)(uint8_t*, uint8_t, uint8_t))
 {
     L3_LLI_dataReqFunc = funcPtr;
 }
 
+void L3_LLI_setUnorderedReqFunc(int (*funcPtr)(uint8_t*, uint8_t, uint8_t))
+{
+    L3_LLI_unorderedReqFunc = funcPtr;
+}
+
 void L3_LLI_setReconfigSrcIdReqFunc(void (*funcPtr)(uint8_t))
 {
     L3_LLI_reconfigSrcIdReqFunc = funcPtr;
 }
 
-void L3_LLI_setMsgPtr(uint8_t* ptr, uint8_t size, uint8_t srcId, int16_t rssi, int8_t snr) {
-    // 구현 내용
-}
\ No newline at end of file
+void L3_LLI_setSduIdFunc(uint8_t (*funcPtr)(void))
+{
+    L3_LLI_sduIdFunc = funcPtr;
+}
@@ -1,9 +1,17 @@
-extern void (*L3_LLI_dataReqFunc)(uint8_t* msg, uint8_t size, uint8_t destId);
+//results of L3_LLI_dataReqFunc
+#define L3_LLI_REQ_OK                   0
+#define L3_LLI_REQ_INVALID              1   //bad destination or empty SDU
+#define L3_LLI_REQ_QUEUEFULL            2   //L2 transmit queue is full, try again after a DATA_CNF
+
+extern int (*L3_LLI_dataReqFunc)(uint8_t* msg, uint8_t size, uint8_t destId);
+extern int (*L3_LLI_unorderedReqFunc)(uint8_t* msg, uint8_t size, uint8_t destId);   //broadcast that may overtake older ones
+extern uint8_t (*L3_LLI_sduIdFunc)(void);   //ID of the SDU the last L3_LLI_REQ_OK queued, given back by its DATA_CNF
 
 // Data indication and confirmation functions
 void L3_LLI_dataInd(uint8_t* dataPtr, uint8_t srcId, uint8_t size, int8_t snr, int16_t rssi);
-void L3_LLI_dataCnf(uint8_t res);
+void L3_LLI_dataCnf(uint8_t res, uint8_t destId, uint8_t sduId);   //res 1 : delivered, 0 : L2 gave up
 void L3_LLI_reconfigSrcIdCnf(uint8_t res);
+uint8_t L3_LLI_checkMsgPending(void);   //1 : L3 has not taken the last DATA_IND yet
 
 // Getter functions for received message info
 uint8_t* L3_LLI_getMsgPtr();
@@ -17,6 +25,7 @@ int16_t L3_LLI_getCurrentRssi();
 int8_t L3_LLI_getCurrentSnr();
 
 // Setter functions for callback registration
-void L3_LLI_setDataReqFunc(void (*funcPtr)(uint8_t*, uint8_t, uint8_t));
+void L3_LLI_setDataReqFunc(int (*funcPtr)(uint8_t*, uint8_t, uint8_t));
+void L3_LLI_setUnorderedReqFunc(int (*funcPtr)(uint8_t*, uint8_t, uint8_t));
 void L3_LLI_setReconfigSrcIdReqFunc(void (*funcPtr)(uint8_t));
-void L3_LLI_setMsgPtr(uint8_t* ptr, uint8_t size, uint8_t srcId, int16_t rssi, int8_t snr);
\ No newline at end of file
+void L3_LLI_setSduIdFunc(uint8_t (*funcPtr)(void));
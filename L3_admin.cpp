@@ -1,15 +1,20 @@
 #include "L3_admin.h"
 #include "L3_LLinterface.h"
 #include "L3_FSMevent.h"
+#include "L3_FSMmain.h"
+#include "L3_session.h"
 #include "protocol_parameters.h"
 #include "mbed.h"
 #include <string.h>
+#include <stdlib.h>
 
 // Global variables
 static uint8_t adminModeStatus = ADMIN_MODE_INACTIVE;
-static BoothInfo_t boothInfo;
-static UserInfo_t connectedUsers[MAX_CONNECTED_USERS];
-static UserInfo_t waitingUsers[MAX_WAITING_USERS];
+static BoothInfo_t boothInfo;     // user counts come from the session table
+
+// Connection waiting queue : FIFO ring of the users holding L3_SESSION_WAITING
+static uint8_t waitRing[MAX_WAITING_USERS];
+static uint8_t waitHead = 0;
 
 // Command input buffer
 static char commandBuffer[MAX_ANNOUNCEMENT_SIZE];
@@ -37,14 +42,7 @@ void L3_admin_init(uint8_t boothId, uint8_t capacity)
     boothInfo.waitingUsers = 0;
     boothInfo.isOperational = 1;
     
-    // Initialize user arrays
-    for (int i = 0; i < MAX_CONNECTED_USERS; i++) {
-        connectedUsers[i].isActive = 0;
-    }
-    
-    for (int i = 0; i < MAX_WAITING_USERS; i++) {
-        waitingUsers[i].isActive = 0;
-    }
+    waitHead = 0;
     
     // Reset command buffer
     commandLength = 0;
@@ -59,9 +57,11 @@ void L3_admin_activate(void)
     pc.printf("[ADMIN] Admin mode activated - Booth operation enabled\n");
     pc.printf("Available booth commands:\n");
     pc.printf("  - 'b message': Send broadcast announcement\n");
+    pc.printf("  - 'g message': Send a message to the experience group chat\n");
     pc.printf("  - 'i': Check booth information\n");
     pc.printf("  - 'u': Check active user list\n");
     pc.printf("  - 'w': Check waiting queue\n");
+    pc.printf("  - 'd id': Disconnect a user\n");
 }
 
 void L3_admin_deactivate(void)
@@ -75,106 +75,140 @@ uint8_t L3_admin_getStatus(void)
     return adminModeStatus;
 }
 
-// User management functions
-void L3_admin_addUser(uint8_t userId, int16_t rssi, int8_t snr)
+// Position of the user in the waiting queue (1 : next to get in), 0 if not waiting
+uint8_t L3_admin_getWaitingPosition(uint8_t userId)
 {
-    // Try to add to connected users first
-    if (boothInfo.currentUsers < boothInfo.capacity) {
-        for (int i = 0; i < MAX_CONNECTED_USERS; i++) {
-            if (!connectedUsers[i].isActive) {
-                connectedUsers[i].userId = userId;
-                connectedUsers[i].status = USER_STATUS_CONNECTED;
-                connectedUsers[i].rssi = rssi;
-                connectedUsers[i].snr = snr;
-                connectedUsers[i].connectTime = time(NULL);
-                connectedUsers[i].isActive = 1;
-                boothInfo.currentUsers++;
-                
-                pc.printf("[BOOTH] User %d connected (RSSI: %d, SNR: %d)\n", userId, rssi, snr);
-                pc.printf("Board connected : %d\n", boothInfo.currentUsers);
-                return;
-            }
+    uint8_t count = L3_admin_getWaitingCount();
+    
+    for (uint8_t i = 0; i < count; i++) {
+        if (waitRing[(waitHead + i) % MAX_WAITING_USERS] == userId) {
+            return i + 1;
         }
+    }
+    return 0;
+}
+
+// Takes the user out of the ring, the ones behind move up
+static void L3_admin_unqueue(uint8_t userId)
+{
+    uint8_t count = L3_admin_getWaitingCount();
+    uint8_t position = L3_admin_getWaitingPosition(userId);
+    
+    if (position == 0) {
+        return;
+    }
+    if (position == 1) {
+        waitHead = (waitHead + 1) % MAX_WAITING_USERS;
+        return;
+    }
+    for (uint8_t i = position - 1; i + 1 < count; i++) {
+        waitRing[(waitHead + i) % MAX_WAITING_USERS] = waitRing[(waitHead + i + 1) % MAX_WAITING_USERS];
+    }
+}
+
+// User management functions
+// Returns 0 once connected, the position in the waiting queue when the booth is full,
+// -1 when the queue is full too (or the user would rather not wait)
+int L3_admin_addUser(uint8_t userId, int16_t rssi, int8_t snr, uint8_t mayWait)
+{
+    L3_session_t* session;
+    uint8_t role;
+    
+    if (L3_session_check(userId, L3_SESSION_CONNECTED) || L3_session_check(userId, L3_SESSION_WAITING)) {
+        // Request sent again : only the link info is refreshed
+        session = L3_session_find(userId);
+        session->rssi = rssi;
+        session->snr = snr;
+        return L3_admin_getWaitingPosition(userId);
+    }
+    
+    // Try to add to connected users first, then to the waiting queue
+    if (L3_admin_getUserCount() < boothInfo.capacity) {
+        role = L3_SESSION_CONNECTED;
+    } else if (!mayWait) {
+        return -1;
+    } else if (L3_admin_getWaitingCount() < MAX_WAITING_USERS) {
+        role = L3_SESSION_WAITING;
     } else {
-        // Add to waiting queue
-        for (int i = 0; i < MAX_WAITING_USERS; i++) {
-            if (!waitingUsers[i].isActive) {
-                waitingUsers[i].userId = userId;
-                waitingUsers[i].status = USER_STATUS_WAITING;
-                waitingUsers[i].rssi = rssi;
-                waitingUsers[i].snr = snr;
-                waitingUsers[i].connectTime = time(NULL);
-                waitingUsers[i].isActive = 1;
-                boothInfo.waitingUsers++;
-                
-                pc.printf("[BOOTH] User %d added to waiting queue (RSSI: %d, SNR: %d)\n", userId, rssi, snr);
-                return;
-            }
-        }
         pc.printf("[BOOTH] Cannot add user %d - booth and waiting queue full\n", userId);
+        return -1;
+    }
+    
+    // The ring slot is taken before the count goes up
+    if (role == L3_SESSION_WAITING) {
+        waitRing[(waitHead + L3_admin_getWaitingCount()) % MAX_WAITING_USERS] = userId;
+    }
+    if ((session = L3_session_add(userId, role)) == NULL) {
+        pc.printf("[BOOTH] Cannot add user %d - no session left\n", userId);
+        return -1;
     }
+    session->rssi = rssi;
+    session->snr = snr;
+    session->connectTime = time(NULL);
+    
+    if (role == L3_SESSION_CONNECTED) {
+        pc.printf("[BOOTH] User %d connected (RSSI: %d, SNR: %d)\n", userId, rssi, snr);
+        pc.printf("Board connected : %d\n", L3_admin_getUserCount());
+        return 0;
+    }
+    
+    pc.printf("[BOOTH] User %d added to waiting queue (RSSI: %d, SNR: %d)\n", userId, rssi, snr);
+    return L3_admin_getWaitingCount();
 }
 
 void L3_admin_removeUser(uint8_t userId)
 {
     // Remove from connected users
-    for (int i = 0; i < MAX_CONNECTED_USERS; i++) {
-        if (connectedUsers[i].isActive && connectedUsers[i].userId == userId) {
-            connectedUsers[i].isActive = 0;
-            boothInfo.currentUsers--;
-            pc.printf("[BOOTH] User %d disconnected\n", userId);
-            pc.printf("Board connected : %d\n", boothInfo.currentUsers);
-            
-            // Try to move someone from waiting queue
-            if (boothInfo.waitingUsers > 0) {
-                for (int j = 0; j < MAX_WAITING_USERS; j++) {
-                    if (waitingUsers[j].isActive) {
-                        L3_admin_moveWaitingToConnected(waitingUsers[j].userId);
-                        break;
-                    }
-                }
-            }
-            return;
-        }
+    if (L3_session_check(userId, L3_SESSION_CONNECTED)) {
+        L3_session_remove(userId, L3_SESSION_EXPERIENCE);
+        L3_session_remove(userId, L3_SESSION_CONNECTED);
+        pc.printf("[BOOTH] User %d disconnected\n", userId);
+        pc.printf("Board connected : %d\n", L3_admin_getUserCount());
+        
+        L3_admin_admitWaiting();
+        return;
     }
     
     // Remove from waiting queue
-    for (int i = 0; i < MAX_WAITING_USERS; i++) {
-        if (waitingUsers[i].isActive && waitingUsers[i].userId == userId) {
-            waitingUsers[i].isActive = 0;
-            boothInfo.waitingUsers--;
-            pc.printf("[BOOTH] User %d removed from waiting queue\n", userId);
-            return;
+    if (L3_session_check(userId, L3_SESSION_WAITING)) {
+        L3_admin_unqueue(userId);
+        L3_session_remove(userId, L3_SESSION_WAITING);
+        pc.printf("[BOOTH] User %d removed from waiting queue\n", userId);
+    }
+}
+
+// Every path that frees a place ends here : the longest waiting users take the free
+// connection places and are told so (with the experience if they asked and it has room)
+void L3_admin_admitWaiting(void)
+{
+    uint8_t next;
+    
+    while (L3_admin_getWaitingCount() > 0 && L3_admin_getUserCount() < boothInfo.capacity) {
+        next = waitRing[waitHead];
+        L3_admin_moveWaitingToConnected(next);
+        if (!L3_session_check(next, L3_SESSION_CONNECTED)) {
+            break;  // queue out of step with the sessions
         }
+        L3_admitWaitingUser(next);
     }
 }
 
 void L3_admin_moveWaitingToConnected(uint8_t userId)
 {
-    // Find user in waiting queue
-    for (int i = 0; i < MAX_WAITING_USERS; i++) {
-        if (waitingUsers[i].isActive && waitingUsers[i].userId == userId) {
-            // Move to connected users
-            for (int j = 0; j < MAX_CONNECTED_USERS; j++) {
-                if (!connectedUsers[j].isActive) {
-                    connectedUsers[j] = waitingUsers[i];
-                    connectedUsers[j].status = USER_STATUS_CONNECTED;
-                    connectedUsers[j].connectTime = time(NULL);
-                    
-                    // Remove from waiting queue
-                    waitingUsers[i].isActive = 0;
-                    
-                    boothInfo.currentUsers++;
-                    boothInfo.waitingUsers--;
-                    
-                    pc.printf("[BOOTH] User %d moved from waiting to connected\n", userId);
-                    pc.printf("Board connected : %d\n", boothInfo.currentUsers);
-                    return;
-                }
-            }
-            break;
-        }
+    L3_session_t* session;
+    
+    if (!L3_session_check(userId, L3_SESSION_WAITING)) {
+        return;
     }
+    
+    // Connected role first : the record stays in place
+    L3_admin_unqueue(userId);
+    session = L3_session_add(userId, L3_SESSION_CONNECTED);
+    L3_session_remove(userId, L3_SESSION_WAITING);
+    session->connectTime = time(NULL);
+    
+    pc.printf("[BOOTH] User %d moved from waiting to connected\n", userId);
+    pc.printf("Board connected : %d\n", L3_admin_getUserCount());
 }
 
 // Command processing functions
@@ -217,6 +251,12 @@ void L3_admin_processCommand(char* command)
     if (command[0] == 'b' && command[1] == ' ') {
         // Broadcast announcement
         L3_admin_sendBroadcast(command + 2);
+    } else if (command[0] == 'g' && command[1] == ' ') {
+        // Group chat message, one frame for every experience user
+        if (L3_sendBroadcastMessage((uint8_t*)command + 2, strlen(command + 2)) == L3_LLI_REQ_OK)
+            pc.printf("[ADMIN] Group message sent: %s\n", command + 2);
+        else
+            pc.printf("[ADMIN] Group message not sent (transmit queue is full), try again\n");
     } else if (command[0] == 'i' && command[1] == '\0') {
         // Show booth information
         L3_admin_showBoothInfo();
@@ -226,8 +266,17 @@ void L3_admin_processCommand(char* command)
     } else if (command[0] == 'w' && command[1] == '\0') {
         // Show waiting queue
         L3_admin_showWaitingQueue();
+    } else if (command[0] == 'd' && command[1] == ' ') {
+        // Disconnect a user, the first one waiting takes the place
+        char* end;
+        long userId = strtol(command + 2, &end, 10);
+
+        if (end == command + 2 || *end != '\0' || userId < 1 || userId > 254)
+            pc.printf("[ADMIN] Usage: d <user ID, 1-254>\n");
+        else
+            L3_admin_disconnectUser((uint8_t)userId);
     } else {
-        pc.printf("[ADMIN] Unknown command. Available commands: b, i, u, w\n");
+        pc.printf("[ADMIN] Unknown command. Available commands: b, g, i, u, w, d\n");
     }
 }
 
@@ -242,13 +291,16 @@ void L3_admin_sendBroadcast(char* message)
         announcement.announcementLength = MAX_ANNOUNCEMENT_SIZE - 1;
     }
     
-    strncpy(announcement.message, message, announcement.announcementLength);
+    memcpy(announcement.message, message, announcement.announcementLength);
     announcement.message[announcement.announcementLength] = '\0';
     
     // Send broadcast to all nodes (ID 255 = broadcast)
-    L3_LLI_dataReqFunc((uint8_t*)&announcement, 
-                       sizeof(uint8_t) * 3 + announcement.announcementLength + 1, 
-                       255);
+    if (L3_LLI_dataReqFunc((uint8_t*)&announcement, 
+                           sizeof(uint8_t) * 3 + announcement.announcementLength + 1, 
+                           255) != L3_LLI_REQ_OK) {
+        pc.printf("[ADMIN] Broadcast not sent (transmit queue is full), try again\n");
+        return;
+    }
     
     pc.printf("[ADMIN] Broadcast sent: %s\n", message);
 }
@@ -258,29 +310,40 @@ void L3_admin_showBoothInfo(void)
     pc.printf("\n=== BOOTH INFORMATION ===\n");
     pc.printf("Booth ID: %d\n", boothInfo.boothId);
     pc.printf("Capacity: %d\n", boothInfo.capacity);
-    pc.printf("Connected Users: %d\n", boothInfo.currentUsers);
-    pc.printf("Waiting Users: %d\n", boothInfo.waitingUsers);
+    pc.printf("Connected Users: %d\n", L3_admin_getUserCount());
+    pc.printf("Waiting Users: %d\n", L3_admin_getWaitingCount());
     pc.printf("Operational: %s\n", boothInfo.isOperational ? "Yes" : "No");
     pc.printf("========================\n");
 }
 
+static void L3_admin_showSession(uint8_t userId)
+{
+    L3_session_t* session = L3_session_find(userId);
+    
+    pc.printf("%-3d | %-4d | %-3d | %lu\n", 
+             session->userId,
+             session->rssi,
+             session->snr,
+             session->connectTime);
+}
+
+//one line per user holding the role, in ID order
+static void L3_admin_showSessions(uint8_t role)
+{
+    for (int id = L3_session_getNext(role, -1); id >= 0; id = L3_session_getNext(role, id)) {
+        L3_admin_showSession(id);
+    }
+}
+
 void L3_admin_showUserList(void)
 {
     pc.printf("\n=== CONNECTED USERS ===\n");
-    if (boothInfo.currentUsers == 0) {
+    if (L3_admin_getUserCount() == 0) {
         pc.printf("No users connected.\n");
     } else {
         pc.printf("ID  | RSSI | SNR | Connect Time\n");
         pc.printf("----+------+-----+-------------\n");
-        for (int i = 0; i < MAX_CONNECTED_USERS; i++) {
-            if (connectedUsers[i].isActive) {
-                pc.printf("%-3d | %-4d | %-3d | %lu\n", 
-                         connectedUsers[i].userId,
-                         connectedUsers[i].rssi,
-                         connectedUsers[i].snr,
-                         connectedUsers[i].connectTime);
-            }
-        }
+        L3_admin_showSessions(L3_SESSION_CONNECTED);
     }
     pc.printf("======================\n");
 }
@@ -288,19 +351,14 @@ void L3_admin_showUserList(void)
 void L3_admin_showWaitingQueue(void)
 {
     pc.printf("\n=== WAITING QUEUE ===\n");
-    if (boothInfo.waitingUsers == 0) {
+    if (L3_admin_getWaitingCount() == 0) {
         pc.printf("No users waiting.\n");
     } else {
         pc.printf("ID  | RSSI | SNR | Wait Time\n");
         pc.printf("----+------+-----+----------\n");
-        for (int i = 0; i < MAX_WAITING_USERS; i++) {
-            if (waitingUsers[i].isActive) {
-                pc.printf("%-3d | %-4d | %-3d | %lu\n", 
-                         waitingUsers[i].userId,
-                         waitingUsers[i].rssi,
-                         waitingUsers[i].snr,
-                         waitingUsers[i].connectTime);
-            }
+        // In queue order
+        for (uint8_t i = 0; i < L3_admin_getWaitingCount(); i++) {
+            L3_admin_showSession(waitRing[(waitHead + i) % MAX_WAITING_USERS]);
         }
     }
     pc.printf("====================\n");
@@ -309,15 +367,17 @@ void L3_admin_showWaitingQueue(void)
 // Utility functions
 uint8_t L3_admin_getUserCount(void)
 {
-    return boothInfo.currentUsers;
+    return L3_session_getCount(L3_SESSION_CONNECTED);
 }
 
 uint8_t L3_admin_getWaitingCount(void)
 {
-    return boothInfo.waitingUsers;
+    return L3_session_getCount(L3_SESSION_WAITING);
 }
 
 BoothInfo_t* L3_admin_getBoothInfo(void)
 {
+    boothInfo.currentUsers = L3_admin_getUserCount();
+    boothInfo.waitingUsers = L3_admin_getWaitingCount();
     return &boothInfo;
 }
\ No newline at end of file
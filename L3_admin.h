@@ -10,25 +10,10 @@
 // Broadcast message types
 #define L3_MSG_TYPE_ANNOUNCEMENT    0x30
 
-// User status
-#define USER_STATUS_CONNECTED       0
-#define USER_STATUS_WAITING         1
-
 // Maximum limits
-#define MAX_CONNECTED_USERS         20
 #define MAX_WAITING_USERS          10
 #define MAX_ANNOUNCEMENT_SIZE      100
 
-// User info structure
-typedef struct {
-    uint8_t userId;
-    uint8_t status;         // connected or waiting
-    int16_t rssi;
-    int8_t snr;
-    uint32_t connectTime;   // connection timestamp
-    uint8_t isActive;
-} UserInfo_t;
-
 // Booth info structure
 typedef struct {
     uint8_t boothId;
@@ -45,10 +30,11 @@ void L3_admin_deactivate(void);
 uint8_t L3_admin_getStatus(void);
 
 // User management functions
-void L3_admin_addUser(uint8_t userId, int16_t rssi, int8_t snr);
+int L3_admin_addUser(uint8_t userId, int16_t rssi, int8_t snr, uint8_t mayWait);
 void L3_admin_removeUser(uint8_t userId);
 void L3_admin_moveUserToWaiting(uint8_t userId);
 void L3_admin_moveWaitingToConnected(uint8_t userId);
+void L3_admin_admitWaiting(void);
 
 // Command processing functions
 void L3_admin_processCommand(char* command);
@@ -65,6 +51,7 @@ char* L3_admin_getCommand(void);
 // Utility functions
 uint8_t L3_admin_getUserCount(void);
 uint8_t L3_admin_getWaitingCount(void);
+uint8_t L3_admin_getWaitingPosition(uint8_t userId);
 BoothInfo_t* L3_admin_getBoothInfo(void);
 
 #endif // L3_ADMIN_H
\ No newline at end of file
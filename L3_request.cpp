@@ -0,0 +1,214 @@
+#include "mbed.h"
+#include "L3_request.h"
+#include "L3_timer.h"
+#include "L3_LLinterface.h"
+#include "protocol_parameters.h"
+
+#if L3_REQ_MAXPENDING >= L3_REQ_NONE
+#error "L3_REQ_MAXPENDING must leave L3_REQ_NONE free as a handle"
+#endif
+
+#define L3_REQ_FREE                 0
+#define L3_REQ_WAITING              1   //for the response
+#define L3_REQ_FAILED               2   //until the FSM picks it up
+
+//control request of the node, kept until its response (or its failure) : resent when it got to
+//the peer but nothing came back, given up when L2 could not deliver it or after the last try
+typedef struct {
+    uint8_t state;
+    uint8_t destId;
+    uint8_t msg[L3_REQ_MAXMSGSIZE];
+    uint8_t size;
+    uint8_t tries;
+    uint8_t cnfPending;     //L2 has not confirmed the last copy yet (one copy at a time)
+    uint8_t sduId;          //L2's ID of that copy, matched against the DATA_CNF
+    uint8_t patient;        //no try counts while L2 is still retransmitting
+    uint32_t startTime;     //ms, first try
+    uint32_t sentTime;      //ms, last copy handed to L2
+} L3_req_t;
+
+static L3_req_t reqs[L3_REQ_MAXPENDING];
+static L3_reqStats_t stats;
+
+
+void L3_req_init(void)
+{
+    memset(reqs, 0, sizeof(reqs));
+    memset(&stats, 0, sizeof(stats));
+}
+
+static void L3_req_transmit(uint8_t handle)
+{
+    L3_req_t* req = &reqs[handle];
+    int res;
+
+    //refused (full transmit queue) : the next try sends it
+    if ((res = L3_LLI_dataReqFunc(req->msg, req->size, req->destId)) == L3_LLI_REQ_OK)
+    {
+        req->cnfPending = 1;
+        req->sduId = L3_LLI_sduIdFunc();
+        req->sentTime = us_ticker_read()/1000;
+    }
+    else
+        debug("[L3][WARNING] request 0x%02X to %d is dropped by L2 (cause : %d)\n", req->msg[0], req->destId, res);
+
+    req->tries++;
+    L3_timer_startTimer(L3_TIMER_REQ(handle), L3_REQ_TIMEOUT);
+}
+
+static void L3_req_free(uint8_t handle)
+{
+    L3_timer_stopTimer(L3_TIMER_REQ(handle));
+    reqs[handle].state = L3_REQ_FREE;
+}
+
+static uint8_t L3_req_start(uint8_t* msg, uint8_t size, uint8_t destId, uint8_t patient)
+{
+    uint8_t handle;
+
+    for (handle = 0; handle < L3_REQ_MAXPENDING && reqs[handle].state != L3_REQ_FREE; handle++);
+    if (handle == L3_REQ_MAXPENDING || size > L3_REQ_MAXMSGSIZE)
+        return L3_REQ_NONE;
+
+    reqs[handle].state = L3_REQ_WAITING;
+    reqs[handle].destId = destId;
+    memcpy(reqs[handle].msg, msg, size);
+    reqs[handle].size = size;
+    reqs[handle].tries = 0;
+    reqs[handle].cnfPending = 0;
+    reqs[handle].patient = patient;
+    reqs[handle].startTime = us_ticker_read()/1000;
+
+    L3_req_transmit(handle);
+
+    return handle;
+}
+
+//sends the request, returns its handle (L3_REQ_NONE : too many requests pending)
+uint8_t L3_req_send(uint8_t* msg, uint8_t size, uint8_t destId)
+{
+    return L3_req_start(msg, size, destId, 0);
+}
+
+//same, but the tries only count once L2 delivered a copy : a slow link delays the failure
+//instead of causing it (L2 giving up still ends the request)
+uint8_t L3_req_sendPatient(uint8_t* msg, uint8_t size, uint8_t destId)
+{
+    return L3_req_start(msg, size, destId, 1);
+}
+
+//request of the type waiting for a response of the node, L3_REQ_NONE if none
+uint8_t L3_req_find(uint8_t msgType, uint8_t destId)
+{
+    for (uint8_t handle = 0; handle < L3_REQ_MAXPENDING; handle++)
+    {
+        if (reqs[handle].state == L3_REQ_WAITING && reqs[handle].destId == destId && reqs[handle].msg[0] == msgType)
+            return handle;
+    }
+
+    return L3_REQ_NONE;
+}
+
+//the response came
+void L3_req_complete(uint8_t handle)
+{
+    uint32_t elapsed;
+
+    if (handle >= L3_REQ_MAXPENDING || reqs[handle].state != L3_REQ_WAITING)
+        return;
+
+    elapsed = us_ticker_read()/1000 - reqs[handle].startTime;
+    debug_if(DBGMSG_L3, "[L3] Request 0x%02X to %d done in %lu ms (%d tries)\n",
+             reqs[handle].msg[0], reqs[handle].destId, (unsigned long)elapsed, reqs[handle].tries);
+
+    stats.completed++;
+    stats.totalTime += elapsed;
+    if (elapsed > stats.maxTime)
+        stats.maxTime = elapsed;
+
+    L3_req_free(handle);
+}
+
+//no longer needed (another booth took the user, a new scan...)
+void L3_req_cancel(uint8_t handle)
+{
+    if (handle < L3_REQ_MAXPENDING && reqs[handle].state == L3_REQ_WAITING)
+        L3_req_free(handle);
+}
+
+//DATA_CNF from L2 for SDU sduId : the request whose copy it is learns whether the peer could be
+//reached. L2 giving up means it cannot, so there is no use sending again
+void L3_req_handleCnf(uint8_t res, uint8_t sduId)
+{
+    for (uint8_t handle = 0; handle < L3_REQ_MAXPENDING; handle++)
+    {
+        L3_req_t* req = &reqs[handle];
+
+        if (req->state != L3_REQ_WAITING || req->cnfPending == 0 || req->sduId != sduId)
+            continue;
+
+        req->cnfPending = 0;
+        if (res == 0)
+        {
+            debug_if(DBGMSG_L3, "[L3] Request 0x%02X to %d could not be delivered\n", req->msg[0], req->destId);
+            L3_timer_stopTimer(L3_TIMER_REQ(handle));
+            req->state = L3_REQ_FAILED;
+        }
+        return;
+    }
+}
+
+//response timeouts : a request L2 delivered is sent again, one it is still retransmitting is
+//only given more time. That try counts once L2 took longer than its own retry limits allow
+//(L3_REQ_CNFWAIT), a patient one's never
+void L3_req_run(void)
+{
+    for (uint8_t handle = 0; handle < L3_REQ_MAXPENDING; handle++)
+    {
+        L3_req_t* req = &reqs[handle];
+
+        if (req->state != L3_REQ_WAITING || L3_timer_getTimerStatus(L3_TIMER_REQ(handle)))
+            continue;
+
+        if (req->tries >= L3_REQ_MAXTRIES)
+        {
+            debug_if(DBGMSG_L3, "[L3] Request 0x%02X to %d got no response after %d tries\n", req->msg[0], req->destId, req->tries);
+            req->state = L3_REQ_FAILED;
+        }
+        else if (req->cnfPending)
+        {
+            if (req->patient == 0 && us_ticker_read()/1000 - req->sentTime >= L3_REQ_CNFWAIT)
+                req->tries++;
+            L3_timer_startTimer(L3_TIMER_REQ(handle), L3_REQ_TIMEOUT);
+        }
+        else
+        {
+            debug_if(DBGMSG_L3, "[L3] Request 0x%02X to %d sent again\n", req->msg[0], req->destId);
+            stats.resent++;
+            L3_req_transmit(handle);
+        }
+    }
+}
+
+//a request given up, returns 0 if there is none : its handle is free from here on
+uint8_t L3_req_getFailed(uint8_t* msgType, uint8_t* destId)
+{
+    for (uint8_t handle = 0; handle < L3_REQ_MAXPENDING; handle++)
+    {
+        if (reqs[handle].state != L3_REQ_FAILED)
+            continue;
+
+        *msgType = reqs[handle].msg[0];
+        *destId = reqs[handle].destId;
+        stats.failed++;
+        L3_req_free(handle);
+        return 1;
+    }
+
+    return 0;
+}
+
+const L3_reqStats_t* L3_req_getStats(void)
+{
+    return &stats;
+}
@@ -0,0 +1,31 @@
+#ifndef L3_REQUEST_H
+#define L3_REQUEST_H
+
+#include "mbed.h"
+
+#define L3_REQ_NONE                 0xFF    //no request (handle)
+#define L3_REQ_MAXMSGSIZE           8       //control messages are kept for resending
+
+//handshakes of the node, from the first try to the response
+typedef struct {
+    uint32_t completed;
+    uint32_t failed;        //no response after the last try, or L2 gave up
+    uint32_t resent;
+    uint32_t totalTime;     //ms, completed ones
+    uint32_t maxTime;
+} L3_reqStats_t;
+
+void L3_req_init(void);
+uint8_t L3_req_send(uint8_t* msg, uint8_t size, uint8_t destId);
+uint8_t L3_req_sendPatient(uint8_t* msg, uint8_t size, uint8_t destId);
+uint8_t L3_req_find(uint8_t msgType, uint8_t destId);
+void L3_req_complete(uint8_t handle);
+void L3_req_cancel(uint8_t handle);
+
+void L3_req_handleCnf(uint8_t res, uint8_t sduId);
+void L3_req_run(void);
+uint8_t L3_req_getFailed(uint8_t* msgType, uint8_t* destId);
+
+const L3_reqStats_t* L3_req_getStats(void);
+
+#endif
@@ -0,0 +1,107 @@
+#include "mbed.h"
+#include "L3_session.h"
+#include "protocol_parameters.h"
+
+#if L3_SESSION_MAXRECORDS > 255
+#error "L3_SESSION_MAXRECORDS must fit the uint8_t record index"
+#endif
+
+//users at the booth, indexed by node ID : one bit per ID and role, and a record per user
+//holding any role, so that lookups, joins and leaves never search
+static uint32_t roleMap[L3_SESSION_ROLES][256/32];
+static uint8_t roleCnt[L3_SESSION_ROLES];
+
+static L3_session_t records[L3_SESSION_MAXRECORDS];
+static uint8_t recordIdx[256];                  //record + 1 of each node ID, 0 : none
+static uint8_t freeRecords[L3_SESSION_MAXRECORDS];
+static uint8_t freeCnt;
+
+
+void L3_session_init(void)
+{
+    memset(roleMap, 0, sizeof(roleMap));
+    memset(roleCnt, 0, sizeof(roleCnt));
+    memset(recordIdx, 0, sizeof(recordIdx));
+
+    for (int i = 0; i < L3_SESSION_MAXRECORDS; i++)
+        freeRecords[i] = L3_SESSION_MAXRECORDS - 1 - i;
+    freeCnt = L3_SESSION_MAXRECORDS;
+}
+
+uint8_t L3_session_check(uint8_t userId, uint8_t role)
+{
+    return (roleMap[role][userId/32] >> (userId%32)) & 0x01;
+}
+
+//record of the user, NULL if it holds no role
+L3_session_t* L3_session_find(uint8_t userId)
+{
+    return recordIdx[userId] ? &records[recordIdx[userId] - 1] : NULL;
+}
+
+//gives the user the role, returns its record (NULL if there is none left for a new user)
+L3_session_t* L3_session_add(uint8_t userId, uint8_t role)
+{
+    L3_session_t* session = L3_session_find(userId);
+
+    if (session == NULL)
+    {
+        if (freeCnt == 0)
+            return NULL;
+
+        recordIdx[userId] = freeRecords[--freeCnt] + 1;
+        session = &records[recordIdx[userId] - 1];
+        memset(session, 0, sizeof(L3_session_t));
+        session->userId = userId;
+    }
+
+    if (L3_session_check(userId, role) == 0)
+    {
+        roleMap[role][userId/32] |= (1UL << (userId%32));
+        roleCnt[role]++;
+    }
+
+    return session;
+}
+
+//takes the role back, the record is freed with the last one
+void L3_session_remove(uint8_t userId, uint8_t role)
+{
+    if (L3_session_check(userId, role) == 0)
+        return;
+
+    roleMap[role][userId/32] &= ~(1UL << (userId%32));
+    roleCnt[role]--;
+
+    for (uint8_t r = 0; r < L3_SESSION_ROLES; r++)
+    {
+        if (L3_session_check(userId, r))
+            return;
+    }
+
+    freeRecords[freeCnt++] = recordIdx[userId] - 1;
+    recordIdx[userId] = 0;
+}
+
+uint8_t L3_session_getCount(uint8_t role)
+{
+    return roleCnt[role];
+}
+
+//lowest user ID above userId holding the role, -1 if none : pass -1 to start
+int L3_session_getNext(uint8_t role, int userId)
+{
+    int id = userId + 1;
+
+    while (id < 256)
+    {
+        uint32_t bits = roleMap[role][id/32] & (0xFFFFFFFFUL << (id%32));
+
+        if (bits != 0)
+            return (id & ~31) + 31 - __CLZ(bits & (~bits + 1));
+
+        id = (id & ~31) + 32;
+    }
+
+    return -1;
+}
@@ -0,0 +1,29 @@
+#ifndef L3_SESSION_H
+#define L3_SESSION_H
+
+#include "mbed.h"
+
+//roles a user holds at the booth, one membership bitmap each
+#define L3_SESSION_CONNECTED        0
+#define L3_SESSION_EXPERIENCE       1
+#define L3_SESSION_WAITING          2
+#define L3_SESSION_ROLES            3
+
+//a user with at least one role
+typedef struct {
+    uint8_t userId;
+    int16_t rssi;
+    int8_t snr;
+    uint32_t connectTime;   // connection (or queueing) timestamp
+    uint8_t joinService;    // service asked for by a waiting JOIN_REQ, 0 : connection only
+} L3_session_t;
+
+void L3_session_init(void);
+L3_session_t* L3_session_find(uint8_t userId);
+L3_session_t* L3_session_add(uint8_t userId, uint8_t role);
+void L3_session_remove(uint8_t userId, uint8_t role);
+uint8_t L3_session_check(uint8_t userId, uint8_t role);
+uint8_t L3_session_getCount(uint8_t role);
+int L3_session_getNext(uint8_t role, int userId);
+
+#endif
@@ -1,35 +1,61 @@
 #include "mbed.h"
 #include "L3_FSMevent.h"
+#include "L3_timer.h"
 #include "protocol_parameters.h"
+#include "timerwheel.h"
 
 
-//ARQ retransmission timer
-static Timeout timer;                       
-static uint8_t timerStatus = 0;
+//beacon, scan, probe and request timers, on the shared timer wheel
+static uint8_t timerHandle[L3_TIMER_COUNT];
+static uint8_t timersCreated = 0;
+static volatile uint8_t timerFired = 0;
 
 
-//timer event : ARQ timeout
-void L3_timer_timeoutHandler(void) 
+//timer event : polled by the FSM through L3_timer_getTimerStatus
+static void L3_timer_timeoutHandler(uint8_t)
 {
-    timerStatus = 0;
-    //L3_event_setEventFlag(L3_event_arqTimeout);
+    timerFired = 1;
+    L3_event_post(); //the main loop must not sleep through it
 }
 
 //timer related functions ---------------------------
-void L3_timer_startTimer()
+//creates the timers on the wheel (timerwheel_init first), stops them when called again
+void L3_timer_init(void)
 {
-    uint8_t waitTime = 1;//L2_ARQ_MINWAITTIME + rand()%(L2_ARQ_MAXWAITTIME-L2_ARQ_MINWAITTIME); //timer length
-    timer.attach(L3_timer_timeoutHandler, waitTime);
-    timerStatus = 1;
+    for (int i = 0; i < L3_TIMER_COUNT; i++)
+    {
+        if (timersCreated)
+            timerwheel_stop(timerHandle[i]);
+        else if ((timerHandle[i] = timerwheel_create(L3_timer_timeoutHandler, i)) == TIMERWHEEL_NONE)
+            error("[L3] no room on the timer wheel for timer %i (TIMERWHEEL_MAXTIMERS)\n", i);
+    }
+    timersCreated = 1;
 }
 
-void L3_timer_stopTimer()
+void L3_timer_startTimer(uint8_t idx, uint32_t waitTime_ms)
 {
-    timer.detach();
-    timerStatus = 0;
+    timerwheel_start(timerHandle[idx], waitTime_ms);
 }
 
-uint8_t L3_timer_getTimerStatus()
+void L3_timer_stopTimer(uint8_t idx)
 {
-    return timerStatus;
+    timerwheel_stop(timerHandle[idx]);
+}
+
+uint8_t L3_timer_getTimerStatus(uint8_t idx)
+{
+    return timerwheel_isRunning(timerHandle[idx]);
+}
+
+//1 if a timer expired since the last call : the next FSM step polls the timers and handles it
+uint8_t L3_timer_takeFired(void)
+{
+    uint8_t fired;
+
+    core_util_critical_section_enter();
+    fired = timerFired;
+    timerFired = 0;
+    core_util_critical_section_exit();
+
+    return fired;
 }
@@ -1,3 +1,13 @@
-void L3_timer_startTimer();
-void L3_timer_stopTimer();
-uint8_t L3_timer_getTimerStatus();
\ No newline at end of file
+//L3 timers : booth beacon period, user scan window, PROBE retry
+//and the response wait of control request handle h
+#define L3_TIMER_BEACON             0
+#define L3_TIMER_SCAN               1
+#define L3_TIMER_PROBE              2
+#define L3_TIMER_REQ(h)             (3 + (h))
+#define L3_TIMER_COUNT              (3 + L3_REQ_MAXPENDING)
+
+void L3_timer_init(void);
+void L3_timer_startTimer(uint8_t idx, uint32_t waitTime_ms);
+void L3_timer_stopTimer(uint8_t idx);
+uint8_t L3_timer_getTimerStatus(uint8_t idx);
+uint8_t L3_timer_takeFired(void);
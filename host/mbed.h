@@ -0,0 +1,108 @@
+/* Host stand-in for the subset of the mbed API used by the protocol stack.
+ *
+ * The simulator build (host/Makefile) includes this header ahead of every
+ * stack source; it claims the MBED_H guard so that ../mbed.h and the exported
+ * mbed tree are never pulled in. Serial, Timeout, the tickers and debug
+ * output are backed by the simulator core (sim.cpp) and act on whichever node
+ * is currently executing; timers therefore run on simulated time.
+ */
+#ifndef MBED_H
+#define MBED_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <math.h>
+
+typedef uint64_t us_timestamp_t;
+
+typedef enum {
+    USBTX = 0x02,
+    USBRX = 0x03,
+    NC = (int)0xFFFFFFFF
+} PinName;
+
+//debug output (platform/mbed_debug.h)
+void debug(const char *format, ...);
+void debug_if(int condition, const char *format, ...);
+
+//fatal error (platform/mbed_error.h) : the simulation stops
+void error(const char *format, ...) __attribute__((noreturn));
+
+//microsecond ticker (hal/us_ticker_api.h)
+uint32_t us_ticker_read(void);
+
+//atomic operations (platform/mbed_critical.h), callbacks and the main loop never preempt each other here
+inline bool core_util_atomic_cas_u32(volatile uint32_t *ptr, uint32_t *expectedCurrentValue, uint32_t desiredValue)
+{
+    return __atomic_compare_exchange_n(ptr, expectedCurrentValue, desiredValue, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+inline uint8_t core_util_atomic_incr_u8(volatile uint8_t *valuePtr, uint8_t delta)
+{
+    return __atomic_add_fetch(valuePtr, delta, __ATOMIC_SEQ_CST);
+}
+
+inline uint32_t core_util_atomic_incr_u32(volatile uint32_t *valuePtr, uint32_t delta)
+{
+    return __atomic_add_fetch(valuePtr, delta, __ATOMIC_SEQ_CST);
+}
+
+//critical sections and sleep (platform/mbed_critical.h, platform/mbed_power_mgmt.h) : a node never
+//preempts itself, and its sleep ends with the pass; the simulator moves the clock to the next event
+inline void core_util_critical_section_enter(void) {}
+inline void core_util_critical_section_exit(void) {}
+inline void sleep_manager_lock_deep_sleep(void) {}
+inline void sleep(void) {}
+
+//count leading zeros (CMSIS cmsis_gcc.h)
+#define __CLZ             (uint8_t)__builtin_clz
+
+//RTC (platform/mbed_rtc_time.h), driven by the simulation clock
+time_t sim_rtc_time(time_t* t);
+#define time(t)     sim_rtc_time(t)
+
+
+//console of the current node
+class Serial
+{
+public:
+    enum IrqType {
+        RxIrq = 0,
+        TxIrq
+    };
+
+    Serial(PinName tx, PinName rx, int baud = 9600);
+
+    int printf(const char *format, ...);
+    int scanf(const char *format, ...);
+    int getc(void);
+    int putc(int c);
+    int readable(void);
+    void attach(void (*func)(void), IrqType type = RxIrq);
+};
+
+
+//one-shot timer firing in the context of the node that armed it
+class Timeout
+{
+public:
+    Timeout();
+    ~Timeout();
+
+    void attach(void (*func)(void), float t);
+    void attach_us(void (*func)(void), us_timestamp_t t);
+    void detach(void);
+
+private:
+    static void fire(void *arg);
+
+    void (*handler)(void);
+    int event;
+};
+
+#endif
@@ -0,0 +1,694 @@
+#include "mbed.h"
+#include "sim.h"
+#include <unistd.h>
+
+typedef struct {
+    uint8_t used;
+    sim_time_t at;
+    int seq;
+    int node;
+    sim_handler_t handler;
+    void* arg;
+} sim_event_t;
+
+typedef struct {
+    const sim_nodeOps_t* ops;
+    uint8_t id;
+    uint8_t active;
+    uint8_t stalled;        //main loop held up : interrupts still post, the FSMs do not run
+    void (*rxHandler)(void);
+    char rxQueue[256];
+    uint8_t rxHead;
+    uint8_t rxTail;
+    sim_time_t lastKeyAt;
+    char output[SIM_OUTPUT_SIZE];
+    uint16_t outputLen;
+    uint8_t atLineStart;
+    sim_nodeStats_t stats;
+} sim_node_t;
+
+static sim_event_t events[SIM_SCHED_SIZE];
+static int eventSeq = 0;
+
+static const sim_nodeOps_t* registered[SIM_MAX_NODES];
+static sim_node_t nodes[SIM_MAX_NODES];
+static int numNodes = 0;
+static int curNode = -1;
+
+static uint8_t verbose = 0;
+static sim_dataCheck_t dataCheck = NULL;
+
+
+//clock ----------------------------------------------------
+static uint8_t realtime = 0;
+static sim_time_t virtualNow = 0;
+
+static sim_time_t wallNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (sim_time_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+void sim_clock_setRealtime(uint8_t enable)
+{
+    realtime = enable;
+}
+
+sim_time_t sim_clock_now(void)
+{
+    static sim_time_t origin = 0;
+
+    if (!realtime)
+        return virtualNow;
+
+    if (origin == 0)
+        origin = wallNow() - virtualNow;
+
+    return wallNow() - origin;
+}
+
+//moves virtual time forward to the next pending event, but not past limit
+static void advance(sim_time_t limit);
+
+
+//scheduler ------------------------------------------------
+int sim_sched_add(sim_time_t at, int node, sim_handler_t handler, void* arg)
+{
+    for (int i = 0; i < SIM_SCHED_SIZE; i++)
+    {
+        if (!events[i].used)
+        {
+            events[i].used = 1;
+            events[i].at = at;
+            events[i].seq = ++eventSeq;
+            events[i].node = node;
+            events[i].handler = handler;
+            events[i].arg = arg;
+
+            return events[i].seq;
+        }
+    }
+
+    fprintf(stderr, "[SIM] event pool exhausted\n");
+    exit(1);
+}
+
+void sim_sched_cancel(int event)
+{
+    for (int i = 0; i < SIM_SCHED_SIZE; i++)
+    {
+        if (events[i].used && events[i].seq == event)
+        {
+            events[i].used = 0;
+            return;
+        }
+    }
+}
+
+//index of the earliest pending event (ties broken by insertion order), -1 if none
+static int nextEvent(void)
+{
+    int next = -1;
+
+    for (int i = 0; i < SIM_SCHED_SIZE; i++)
+    {
+        if (events[i].used &&
+            (next < 0 ||
+             events[i].at < events[next].at ||
+             (events[i].at == events[next].at && events[i].seq < events[next].seq)))
+        {
+            next = i;
+        }
+    }
+
+    return next;
+}
+
+//fires every event that is due, returns the number of fired events
+int sim_sched_runDue(void)
+{
+    int fired = 0;
+    int i;
+
+    while ((i = nextEvent()) >= 0 && events[i].at <= sim_clock_now())
+    {
+        sim_event_t ev = events[i];
+        events[i].used = 0;
+
+        int prev = sim_node_enter(ev.node);
+        ev.handler(ev.arg);
+        sim_node_leave(prev);
+
+        fired++;
+    }
+
+    return fired;
+}
+
+
+static void advance(sim_time_t limit)
+{
+    int i = nextEvent();
+    sim_time_t next = (i >= 0 && events[i].at < limit) ? events[i].at : limit;
+
+    if (next > virtualNow)
+        virtualNow = next;
+}
+
+
+//nodes ----------------------------------------------------
+void sim_node_register(int idx, const sim_nodeOps_t* ops)
+{
+    if (idx >= 0 && idx < SIM_MAX_NODES)
+        registered[idx] = ops;
+}
+
+int sim_node_add(uint8_t id)
+{
+    if (numNodes >= SIM_MAX_NODES || registered[numNodes] == NULL)
+    {
+        fprintf(stderr, "[SIM] no stack copy left for node %i (max %i)\n", id, SIM_MAX_NODES);
+        exit(1);
+    }
+
+    int idx = numNodes++;
+    sim_node_t* n = &nodes[idx];
+
+    n->ops = registered[idx];
+    n->id = id;
+    n->active = 1;
+    n->atLineStart = 1;
+
+    int prev = sim_node_enter(idx);
+    n->ops->init(id);
+    sim_node_leave(prev);
+
+    return idx;
+}
+
+int sim_node_count(void)
+{
+    return numNodes;
+}
+
+uint8_t sim_node_getId(int idx)
+{
+    return nodes[idx].id;
+}
+
+int sim_node_enter(int idx)
+{
+    int prev = curNode;
+    curNode = idx;
+    return prev;
+}
+
+void sim_node_leave(int prev)
+{
+    curNode = prev;
+}
+
+int sim_node_current(void)
+{
+    return curNode;
+}
+
+const sim_nodeStats_t* sim_node_getStats(int idx)
+{
+    return &nodes[idx].stats;
+}
+
+
+//console --------------------------------------------------
+void sim_setVerbose(uint8_t v)
+{
+    verbose = v;
+}
+
+void sim_node_output(int idx, const char* text)
+{
+    if (idx < 0 || idx >= numNodes)
+    {
+        fputs(text, stdout);
+        return;
+    }
+
+    sim_node_t* n = &nodes[idx];
+    size_t len = strlen(text);
+
+    //keep the most recent half when the capture buffer fills up
+    if (n->outputLen + len >= SIM_OUTPUT_SIZE)
+    {
+        uint16_t keep = SIM_OUTPUT_SIZE/2;
+        if (len >= keep)
+        {
+            text += len - keep + 1;
+            len = keep - 1;
+            n->outputLen = 0;
+        }
+        else if (n->outputLen > keep)
+        {
+            memmove(n->output, n->output + n->outputLen - keep, keep);
+            n->outputLen = keep;
+        }
+    }
+    memcpy(n->output + n->outputLen, text, len);
+    n->outputLen += len;
+    n->output[n->outputLen] = '\0';
+
+    if (verbose)
+    {
+        for (const char* p = text; *p; p++)
+        {
+            if (n->atLineStart)
+            {
+                printf("[%10.3f][%3i] ", sim_clock_now()/1000.0, n->id);
+                n->atLineStart = 0;
+            }
+            putchar(*p);
+            if (*p == '\n')
+                n->atLineStart = 1;
+        }
+    }
+}
+
+void sim_node_setRxHandler(int idx, void (*func)(void))
+{
+    if (idx >= 0 && idx < numNodes)
+        nodes[idx].rxHandler = func;
+}
+
+int sim_node_getc(int idx)
+{
+    if (idx < 0 || nodes[idx].rxHead == nodes[idx].rxTail)
+        return -1;
+
+    return (uint8_t)nodes[idx].rxQueue[nodes[idx].rxTail++];
+}
+
+static void keyHandler(void* arg)
+{
+    sim_node_t* n = &nodes[sim_node_current()];
+
+    n->rxQueue[n->rxHead++] = (char)(intptr_t)arg;
+    if (n->rxHandler != NULL)
+        n->rxHandler();
+}
+
+void sim_node_type(int idx, const char* text)
+{
+    sim_node_t* n = &nodes[idx];
+    sim_time_t at = sim_clock_now();
+
+    if (n->lastKeyAt > at)
+        at = n->lastKeyAt;
+
+    for (const char* p = text; *p; p++)
+    {
+        at += SIM_KEY_INTERVAL_US;
+        sim_sched_add(at, idx, keyHandler, (void*)(intptr_t)*p);
+    }
+    n->lastKeyAt = at;
+}
+
+
+//L2/L3 boundary hooks ---------------------------------------
+void sim_node_onDataInd(int idx, uint8_t srcId, uint8_t* dataPtr, uint8_t size, uint8_t l3Busy)
+{
+    nodes[idx].stats.sduRcvd++;
+    nodes[idx].stats.sduRcvdBytes += size;
+    if (l3Busy)
+        nodes[idx].stats.sduOverwritten++;
+
+    if (dataCheck != NULL && dataCheck(srcId, dataPtr, size) == 0)
+        nodes[idx].stats.sduBad++;
+}
+
+void sim_node_onDataCnf(int idx, uint8_t res)
+{
+    if (res)
+        nodes[idx].stats.cnfOk++;
+    else
+        nodes[idx].stats.cnfFail++;
+}
+
+
+//scenario control -------------------------------------------
+//runs the FSMs of all nodes, then fires the events that are due; returns the
+//number of fired events
+int sim_step(void)
+{
+    for (int pass = 0; pass < SIM_PASSES_PER_STEP; pass++)
+    {
+        for (int i = 0; i < numNodes; i++)
+        {
+            if (!nodes[i].active || nodes[i].stalled)
+                continue;
+
+            int prev = sim_node_enter(i);
+            nodes[i].ops->run();
+            sim_node_leave(prev);
+        }
+    }
+
+    return sim_sched_runDue();
+}
+
+//nothing happened at this instant: wait (realtime) or jump (virtual)
+static void idle(sim_time_t limit)
+{
+    if (realtime)
+        usleep(100);
+    else
+        advance(limit);
+}
+
+void sim_run(sim_time_t duration)
+{
+    sim_time_t end = sim_clock_now() + duration;
+
+    while (sim_clock_now() < end)
+    {
+        if (sim_step() == 0)
+            idle(end);
+    }
+}
+
+//runs until done(arg) returns 1, returns the elapsed time or SIM_TIME_NEVER
+sim_time_t sim_runUntil(uint8_t (*done)(void* arg), void* arg, sim_time_t timeout)
+{
+    sim_time_t start = sim_clock_now();
+
+    while (1)
+    {
+        int fired = sim_step();
+
+        if (done(arg))
+            return sim_clock_now() - start;
+        if (sim_clock_now() - start >= timeout)
+            return SIM_TIME_NEVER;
+        if (fired == 0)
+            idle(start + timeout);
+    }
+}
+
+typedef struct {
+    sim_node_t* node;
+    const char* pattern;
+    const char* other;      //NULL : none
+    int matched;            //0 : pattern, 1 : other
+} expect_t;
+
+static uint8_t outputMatches(void* arg)
+{
+    expect_t* e = (expect_t*)arg;
+    char* match = strstr(e->node->output, e->pattern);
+    char* otherMatch = e->other != NULL ? strstr(e->node->output, e->other) : NULL;
+
+    e->matched = (otherMatch != NULL && (match == NULL || otherMatch < match));
+    if (e->matched)
+        match = otherMatch;
+    if (match == NULL)
+        return 0;
+
+    //consume the output up to the end of the match
+    size_t consumed = (match - e->node->output) + strlen(e->matched ? e->other : e->pattern);
+    memmove(e->node->output, e->node->output + consumed, e->node->outputLen - consumed + 1);
+    e->node->outputLen -= consumed;
+
+    return 1;
+}
+
+sim_time_t sim_node_expect(int idx, const char* pattern, sim_time_t timeout)
+{
+    expect_t e;
+
+    e.node = &nodes[idx];
+    e.pattern = pattern;
+    e.other = NULL;
+
+    return sim_runUntil(outputMatches, &e, timeout);
+}
+
+//same for whichever of two patterns shows up first, *matched tells which (0 : pattern, 1 : other)
+sim_time_t sim_node_expectEither(int idx, const char* pattern, const char* other, int* matched, sim_time_t timeout)
+{
+    expect_t e;
+    sim_time_t t;
+
+    e.node = &nodes[idx];
+    e.pattern = pattern;
+    e.other = other;
+    e.matched = 0;
+
+    t = sim_runUntil(outputMatches, &e, timeout);
+    *matched = e.matched;
+
+    return t;
+}
+
+//DATA_REQ issued by the node's L3 on behalf of the scenario
+int sim_node_dataReq(int idx, uint8_t* sdu, uint8_t len, uint8_t destId)
+{
+    int prev = sim_node_enter(idx);
+    int res = nodes[idx].ops->dataReq(sdu, len, destId);
+    sim_node_leave(prev);
+
+    return res;
+}
+
+//holds up the node's main loop (long console output, busy L3) : received frames pile up in L2
+void sim_node_setStalled(int idx, uint8_t stalled)
+{
+    nodes[idx].stalled = stalled;
+}
+
+void sim_node_configArqWindow(int idx, uint8_t size)
+{
+    int prev = sim_node_enter(idx);
+    nodes[idx].ops->configArqWindow(size);
+    sim_node_leave(prev);
+}
+
+void sim_node_configAckDelay(int idx, uint16_t delay)
+{
+    int prev = sim_node_enter(idx);
+    nodes[idx].ops->configAckDelay(delay);
+    sim_node_leave(prev);
+}
+
+void sim_node_configMss(int idx, uint8_t mss)
+{
+    int prev = sim_node_enter(idx);
+    nodes[idx].ops->configMss(mss);
+    sim_node_leave(prev);
+}
+
+//L2 retransmission timeout estimate of a node towards one of its neighbors (ms)
+uint32_t sim_node_getSrtt(int idx, uint8_t peerId)
+{
+    return nodes[idx].ops->getSrtt(peerId);
+}
+
+uint32_t sim_node_getRto(int idx, uint8_t peerId)
+{
+    return nodes[idx].ops->getRto(peerId);
+}
+
+void sim_node_getReasmStats(int idx, uint32_t* completed, uint32_t* evicted, uint32_t* timedOut)
+{
+    nodes[idx].ops->getReasmStats(completed, evicted, timedOut);
+}
+
+//SDU bytes the node's L2 copied on its TX path (DATA_REQ to PDU)
+uint32_t sim_node_getTxCopiedBytes(int idx)
+{
+    return nodes[idx].ops->getTxCopiedBytes();
+}
+
+//frames the node's L2 dropped for a full RX queue
+uint32_t sim_node_getRxOverflow(int idx)
+{
+    return nodes[idx].ops->getRxOverflow();
+}
+
+//fan-out and relayed messages the node's L3 dropped for a full L2 transmit queue
+uint32_t sim_node_getDroppedMsgs(int idx)
+{
+    return nodes[idx].ops->getDroppedMsgs();
+}
+
+//L2 event-to-handling latency of the node, in FSM passes
+void sim_node_getEventStats(int idx, uint32_t* handled, uint32_t* totalPasses, uint32_t* maxPasses)
+{
+    nodes[idx].ops->getEventStats(handled, totalPasses, maxPasses);
+}
+
+//sleeps of the node's main loop ended by work for the FSMs (the stack runs in no simulated time,
+//so the idle share and dispatch latency of the scheduler only mean something on target)
+uint32_t sim_node_getWakeups(int idx)
+{
+    return nodes[idx].ops->getWakeups();
+}
+
+//reliable broadcast : NACKs sent and held back, PDUs repeated (sender) and given up (receiver)
+void sim_node_getMcastStats(int idx, uint32_t* nacksSent, uint32_t* nacksSuppressed, uint32_t* repaired, uint32_t* lost)
+{
+    int prev = sim_node_enter(idx);
+    nodes[idx].ops->getMcastStats(nacksSent, nacksSuppressed, repaired, lost);
+    sim_node_leave(prev);
+}
+
+//L3 handshakes : requests answered (with their time from the first try, ms), given up and sent again
+void sim_node_getReqStats(int idx, uint32_t* completed, uint32_t* failed, uint32_t* resent, uint32_t* totalTime, uint32_t* maxTime)
+{
+    int prev = sim_node_enter(idx);
+    nodes[idx].ops->getReqStats(completed, failed, resent, totalTime, maxTime);
+    sim_node_leave(prev);
+}
+
+//content check applied to every SDU delivered to L3, counted in sduBad
+void sim_node_setDataCheck(sim_dataCheck_t check)
+{
+    dataCheck = check;
+}
+
+
+//mbed stand-ins -------------------------------------------
+static void outputv(const char* format, va_list args)
+{
+    char buf[1200];
+
+    vsnprintf(buf, sizeof(buf), format, args);
+    sim_node_output(sim_node_current(), buf);
+}
+
+void debug(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    outputv(format, args);
+    va_end(args);
+}
+
+void debug_if(int condition, const char *format, ...)
+{
+    if (condition)
+    {
+        va_list args;
+        va_start(args, format);
+        outputv(format, args);
+        va_end(args);
+    }
+}
+
+void error(const char *format, ...)
+{
+    va_list args;
+
+    fprintf(stderr, "node %i: ", sim_node_current() >= 0 ? sim_node_getId(sim_node_current()) : -1);
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    exit(1);
+}
+
+uint32_t us_ticker_read(void)
+{
+    return (uint32_t)sim_clock_now();
+}
+
+//the RTC follows the simulation clock so that srand(time(NULL)) and
+//connection timestamps repeat from run to run
+time_t sim_rtc_time(time_t* t)
+{
+    time_t now = SIM_RTC_EPOCH + (time_t)(sim_clock_now()/1000000);
+
+    if (t != NULL)
+        *t = now;
+
+    return now;
+}
+
+Serial::Serial(PinName, PinName, int)
+{
+}
+
+int Serial::printf(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    outputv(format, args);
+    va_end(args);
+
+    return 0;
+}
+
+//node IDs are assigned by the scenario, nothing is read from a console
+int Serial::scanf(const char*, ...)
+{
+    return 0;
+}
+
+int Serial::getc(void)
+{
+    return sim_node_getc(sim_node_current());
+}
+
+int Serial::putc(int c)
+{
+    char text[2] = {(char)c, '\0'};
+    sim_node_output(sim_node_current(), text);
+    return c;
+}
+
+int Serial::readable(void)
+{
+    int idx = sim_node_current();
+    return idx >= 0 && nodes[idx].rxHead != nodes[idx].rxTail;
+}
+
+void Serial::attach(void (*func)(void), IrqType type)
+{
+    if (type == RxIrq)
+        sim_node_setRxHandler(sim_node_current(), func);
+}
+
+Timeout::Timeout() : handler(NULL), event(0)
+{
+}
+
+Timeout::~Timeout()
+{
+    detach();
+}
+
+void Timeout::fire(void* arg)
+{
+    Timeout* self = (Timeout*)arg;
+
+    self->event = 0;
+    self->handler();
+}
+
+void Timeout::attach(void (*func)(void), float t)
+{
+    attach_us(func, (us_timestamp_t)(t * 1000000.0f));
+}
+
+void Timeout::attach_us(void (*func)(void), us_timestamp_t t)
+{
+    detach();
+    handler = func;
+    event = sim_sched_add(sim_clock_now() + t, sim_node_current(), fire, this);
+}
+
+void Timeout::detach(void)
+{
+    if (event != 0)
+    {
+        sim_sched_cancel(event);
+        event = 0;
+    }
+}
@@ -0,0 +1,119 @@
+/* Simulator core: clock, event scheduler and node registry.
+ *
+ * Every node is a full copy of the protocol stack compiled into its own
+ * namespace (see sim_unit.cpp / sim_node.cpp). The core runs the FSMs of all
+ * nodes in turn and dispatches timer, keyboard and radio events in the
+ * context of the node they belong to.
+ *
+ * By default time is virtual: once no event is due and the FSMs have run,
+ * the clock jumps straight to the next pending event, so runs are fast and
+ * repeat exactly. Realtime mode paces the same scheduler by the wall clock.
+ */
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+
+#ifndef SIM_MAX_NODES
+#define SIM_MAX_NODES               16
+#endif
+
+#define SIM_SCHED_SIZE              512     //max pending events
+#define SIM_PASSES_PER_STEP         8       //FSM passes per node between event dispatches
+#define SIM_KEY_INTERVAL_US         1000    //spacing of injected keystrokes
+#define SIM_OUTPUT_SIZE             8192    //captured console text per node
+
+#define SIM_RTC_EPOCH               1700000000  //RTC value at simulation start
+
+#define SIM_TIME_NEVER              ((sim_time_t)-1)
+
+typedef uint64_t sim_time_t;    //microseconds since simulation start
+
+//entry points of one stack copy, registered by sim_node.cpp
+typedef struct {
+    void (*init)(uint8_t id);
+    void (*run)(void);
+    int (*dataReq)(uint8_t* sdu, uint8_t len, uint8_t destId);
+    void (*configArqWindow)(uint8_t size);
+    void (*configMss)(uint8_t mss);
+    void (*configAckDelay)(uint16_t delay);
+    uint32_t (*getSrtt)(uint8_t peerId);
+    uint32_t (*getRto)(uint8_t peerId);
+    void (*getReasmStats)(uint32_t* completed, uint32_t* evicted, uint32_t* timedOut);
+    uint32_t (*getTxCopiedBytes)(void);
+    uint32_t (*getRxOverflow)(void);
+    uint32_t (*getDroppedMsgs)(void);
+    void (*getEventStats)(uint32_t* handled, uint32_t* totalPasses, uint32_t* maxPasses);
+    uint32_t (*getWakeups)(void);
+    void (*getMcastStats)(uint32_t* nacksSent, uint32_t* nacksSuppressed, uint32_t* repaired, uint32_t* lost);
+    void (*getReqStats)(uint32_t* completed, uint32_t* failed, uint32_t* resent, uint32_t* totalTime, uint32_t* maxTime);
+} sim_nodeOps_t;
+
+//per-node counters collected at the L2/L3 boundary
+typedef struct {
+    uint32_t sduRcvd;
+    uint32_t sduRcvdBytes;
+    uint32_t cnfOk;
+    uint32_t cnfFail;
+    uint32_t sduBad;        //rejected by the scenario's content check
+    uint32_t sduOverwritten;    //given while L3 still held the previous one : never handled by L3
+} sim_nodeStats_t;
+
+typedef void (*sim_handler_t)(void* arg);
+typedef uint8_t (*sim_dataCheck_t)(uint8_t srcId, uint8_t* dataPtr, uint8_t size);
+
+
+//clock: virtual (discrete-event, default) or paced by the wall clock
+void sim_clock_setRealtime(uint8_t enable);
+sim_time_t sim_clock_now(void);
+
+//scheduler
+int sim_sched_add(sim_time_t at, int node, sim_handler_t handler, void* arg);
+void sim_sched_cancel(int event);
+int sim_sched_runDue(void);
+
+//node registry and execution context
+void sim_node_register(int idx, const sim_nodeOps_t* ops);
+int sim_node_add(uint8_t id);
+int sim_node_count(void);
+uint8_t sim_node_getId(int idx);
+int sim_node_enter(int idx);
+void sim_node_leave(int prev);
+int sim_node_current(void);
+
+//console of a node
+void sim_node_output(int idx, const char* text);
+void sim_node_setRxHandler(int idx, void (*func)(void));
+int sim_node_getc(int idx);
+void sim_node_type(int idx, const char* text);
+
+//hooks called by sim_node.cpp at the L2/L3 boundary
+void sim_node_onDataInd(int idx, uint8_t srcId, uint8_t* dataPtr, uint8_t size, uint8_t l3Busy);
+void sim_node_onDataCnf(int idx, uint8_t res);
+
+//scenario control
+void sim_setVerbose(uint8_t verbose);
+int sim_step(void);
+void sim_run(sim_time_t duration);
+sim_time_t sim_runUntil(uint8_t (*done)(void* arg), void* arg, sim_time_t timeout);
+sim_time_t sim_node_expect(int idx, const char* pattern, sim_time_t timeout);
+sim_time_t sim_node_expectEither(int idx, const char* pattern, const char* other, int* matched, sim_time_t timeout);
+int sim_node_dataReq(int idx, uint8_t* sdu, uint8_t len, uint8_t destId);
+void sim_node_setStalled(int idx, uint8_t stalled);
+void sim_node_configArqWindow(int idx, uint8_t size);
+void sim_node_configMss(int idx, uint8_t mss);
+void sim_node_configAckDelay(int idx, uint16_t delay);
+uint32_t sim_node_getSrtt(int idx, uint8_t peerId);
+uint32_t sim_node_getRto(int idx, uint8_t peerId);
+void sim_node_getReasmStats(int idx, uint32_t* completed, uint32_t* evicted, uint32_t* timedOut);
+uint32_t sim_node_getTxCopiedBytes(int idx);
+uint32_t sim_node_getRxOverflow(int idx);
+uint32_t sim_node_getDroppedMsgs(int idx);
+void sim_node_getEventStats(int idx, uint32_t* handled, uint32_t* totalPasses, uint32_t* maxPasses);
+uint32_t sim_node_getWakeups(int idx);
+void sim_node_getMcastStats(int idx, uint32_t* nacksSent, uint32_t* nacksSuppressed, uint32_t* repaired, uint32_t* lost);
+void sim_node_getReqStats(int idx, uint32_t* completed, uint32_t* failed, uint32_t* resent, uint32_t* totalTime, uint32_t* maxTime);
+void sim_node_setDataCheck(sim_dataCheck_t check);
+const sim_nodeStats_t* sim_node_getStats(int idx);
+
+#endif
@@ -0,0 +1,1291 @@
+#include "mbed.h"
+#include "sim.h"
+#include "sim_medium.h"
+#include "../protocol_parameters.h"
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define BOOTH_ID_BASE               100
+#define SIM_INBOX_STALL             200000  //us the booth's main loop is held up per round (inbox)
+#define L3_MSG_TYPE_DATA            0x20
+
+//scenario parameters (command line)
+static int sduLen = 200;
+static int sduCount = 20;
+static float lossRate = 0;
+static int arqWindow = 0;      //0 : L2_ARQ_WINDOWSIZE
+static int mss = 0;            //0 : L2_MSS
+static int ackDelay = -1;      //-1 : L2_ARQ_ACKDELAY
+static int numPeers = 4;
+
+
+static void usage(void)
+{
+    printf("usage: popin_sim [-v] [-r] [-s seed] [-p loss] [-l len] [-c count] [-w window] [-m mss] [-a delay] [-n peers] <scenario>\n");
+    printf("  -r      pace the simulation by the wall clock instead of virtual time\n");
+    printf("  -w      L2 ARQ window of every node (1 : stop-and-wait, up to 16 : block ACK)\n");
+    printf("  -m      L2 MSS advertised by every node (bytes of DATA payload)\n");
+    printf("  -a      L2 delayed ACK of every node in ms (0 : ACK right away)\n");
+    printf("scenarios:\n");
+    printf("  join    booth %i and user 1: scan, connect and enter the booth experience\n", BOOTH_ID_BASE);
+    printf("  bulk    user 1 sends <count> SDUs of <len> bytes to user 2 through L2\n");
+    printf("  fanout  user 1 sends <count> SDUs of <len> bytes to each of <peers> users at once\n");
+    printf("  fanin   <peers> users send <count> SDUs of <len> bytes each to user 1 at once\n");
+    printf("  inbox   users 1 and 2 send <count> SDUs of <len> bytes each to booth %i while it is busy : SDUs its L3 handles\n", BOOTH_ID_BASE);
+    printf("  queue   user 1 requests <count> SDUs of <len> bytes to user 2 back to back\n");
+    printf("  burst   user 1 queues <count> SDUs of <len> bytes to user 2 (as many as L2 holds), then one to user 3 :\n"
+           "          time until user 3 has it\n");
+    printf("  chat    users 1 and 2 exchange <count> requests and replies of <len> bytes\n");
+    printf("  group   <peers> users join booth %i, then <count> rounds of group chat by the booth and every user\n", BOOTH_ID_BASE);
+    printf("  scan    user 1 scans <count> times among <peers> booths\n");
+    printf("  sweep   scan with 1, 5 and 10 booths, each in a simulation of its own\n");
+    printf("  crowd   users fill <peers> booths one after another : scan and connect, again after a reject\n");
+    printf("  rush    users fill <peers> booths arriving every 100 ms, while the others are still joining\n");
+    printf("  entry   user 1 joins booth %i and its experience in two steps, user 2 booth %i with one join request :\n"
+           "          time to the first group message\n", BOOTH_ID_BASE, BOOTH_ID_BASE + 1);
+    printf("  line    booth %i full, 3 more users wait in line : the booth lets them in as users leave\n", BOOTH_ID_BASE);
+    printf("  hall    <peers> booths idle 60 s, user 1 scans <count> times, idle 60 s more : beacon airtime per booth\n");
+}
+
+static void printPhyTotals(void)
+{
+    sim_phyStats_t total;
+    uint32_t overflow = 0;
+    uint32_t handled = 0, totalPasses = 0, maxPasses = 0;
+    uint32_t wakeups = 0, maxWakeups = 0;
+
+    sim_medium_getTotals(&total);
+    for (int i = 0; i < sim_node_count(); i++)
+    {
+        uint32_t h, t, m;
+
+        overflow += sim_node_getRxOverflow(i);
+        sim_node_getEventStats(i, &h, &t, &m);
+        handled += h;
+        totalPasses += t;
+        if (m > maxPasses)
+            maxPasses = m;
+
+        h = sim_node_getWakeups(i);
+        wakeups += h;
+        if (h > maxWakeups)
+            maxWakeups = h;
+    }
+
+    printf("frames sent       : %lu (%lu bytes, %.1f ms airtime)\n",
+           (unsigned long)total.txFrames, (unsigned long)total.txBytes, total.txAirtime/1000.0);
+    printf("frames received   : %lu (lost %lu, collided %lu)\n",
+           (unsigned long)total.rxFrames, (unsigned long)total.rxLost, (unsigned long)total.rxCollided);
+    printf("L2 RX overflows   : %lu\n", (unsigned long)overflow);
+    printf("L2 event latency  : %.2f FSM passes on average, %lu at most (%lu events)\n",
+           handled ? totalPasses/(double)handled : 0.0, (unsigned long)maxPasses, (unsigned long)handled);
+    printf("main loop wake-ups: %lu (%lu for the busiest node)\n", (unsigned long)wakeups, (unsigned long)maxWakeups);
+}
+
+//L3 control handshakes of every node, from the first try of the request to its response
+static void printHandshakes(void)
+{
+    uint32_t completed = 0, failed = 0, resent = 0, totalTime = 0, maxTime = 0;
+
+    for (int i = 0; i < sim_node_count(); i++)
+    {
+        uint32_t c, f, r, t, m;
+
+        sim_node_getReqStats(i, &c, &f, &r, &t, &m);
+        completed += c;
+        failed += f;
+        resent += r;
+        totalTime += t;
+        if (m > maxTime)
+            maxTime = m;
+    }
+
+    printf("L3 handshakes     : %lu done (%.1f ms on average, %lu ms at most), %lu given up, %lu requests sent again\n",
+           (unsigned long)completed, completed ? totalTime/(double)completed : 0.0, (unsigned long)maxTime,
+           (unsigned long)failed, (unsigned long)resent);
+}
+
+//what every scenario must keep, over all nodes : no corrupted SDU, none overwritten before L3
+//handled it, no fan-out or relayed message L3 dropped for a full L2 transmit queue,
+//and on a lossless channel no L3 handshake or broadcast given up. Prints what broke, 1 if
+//anything did
+static int checkNodes(void)
+{
+    uint32_t bad = 0, overwritten = 0, dropped = 0, failed = 0, lost = 0;
+
+    for (int i = 0; i < sim_node_count(); i++)
+    {
+        const sim_nodeStats_t* stats = sim_node_getStats(i);
+        uint32_t c, f, r, t, m;
+
+        bad += stats->sduBad;
+        overwritten += stats->sduOverwritten;
+        dropped += sim_node_getDroppedMsgs(i);
+        sim_node_getReqStats(i, &c, &f, &r, &t, &m);
+        failed += f;
+        sim_node_getMcastStats(i, &c, &r, &t, &m);
+        lost += m;
+    }
+
+    if (bad)
+        printf("FAILED            : %lu SDUs corrupted\n", (unsigned long)bad);
+    if (overwritten)
+        printf("FAILED            : %lu SDUs overwritten before L3 handled them\n", (unsigned long)overwritten);
+    if (dropped)
+        printf("FAILED            : %lu L3 messages dropped for a full L2 transmit queue\n", (unsigned long)dropped);
+    if (lossRate == 0 && failed)
+        printf("FAILED            : %lu L3 handshakes given up without losses\n", (unsigned long)failed);
+    if (lossRate == 0 && lost)
+        printf("FAILED            : %lu broadcast PDUs given up without losses\n", (unsigned long)lost);
+
+    return (bad || overwritten || dropped || (lossRate == 0 && (failed || lost))) ? 1 : 0;
+}
+
+//PHY frames (DATA and ACK) spent per KB delivered
+static void printFramesPerKB(uint32_t delivered)
+{
+    sim_phyStats_t total;
+    sim_medium_getTotals(&total);
+
+    printf("frames per KB     : %.1f\n", delivered ? total.txFrames*1024.0/delivered : 0.0);
+}
+
+static int addNode(uint8_t id)
+{
+    int idx = sim_node_add(id);
+
+    if (arqWindow > 0)
+        sim_node_configArqWindow(idx, arqWindow);
+    if (mss > 0)
+        sim_node_configMss(idx, mss);
+    if (ackDelay >= 0)
+        sim_node_configAckDelay(idx, ackDelay);
+
+    return idx;
+}
+
+static void printStep(const char* name, sim_time_t t)
+{
+    if (t == SIM_TIME_NEVER)
+        printf("%-18s: timeout\n", name);
+    else
+        printf("%-18s: %.1f ms\n", name, t/1000.0);
+}
+
+
+//scan -> connect -> experience of one user, time it took (SIM_TIME_NEVER : a step timed out)
+//like the user would, it starts over from the scan when L3 gave up on the connection (a late
+//accept of that request may still end the scan), and asks again when L3 gave up on the experience
+static sim_time_t joinBooth(int user, uint8_t verbose)
+{
+    static const char* const steps[3][3] = {
+        {"s", "BOOTH FOUND", "Connected!"}, {"y", "Connected!", "scan again"}, {"y", "BOOTH EXPERIENCE STARTED", "to the experience request"}};
+    static const char* const names[3] = {"scan", "connect", "experience"};
+    sim_time_t t, total = 0;
+    int matched, again = 0;
+
+    for (int i = 0; i < 3; i++)
+    {
+        sim_node_type(user, steps[i][0]);
+        t = sim_node_expectEither(user, steps[i][1], steps[i][2], &matched, i == 0 ? 2000000 : 60000000);
+
+        //every beacon of the scan window may be lost : scan again, like the user would
+        for (int retry = 0; i == 0 && t == SIM_TIME_NEVER && retry < 10; retry++)
+        {
+            total += 2000000;
+            sim_node_type(user, steps[i][0]);
+            t = sim_node_expectEither(user, steps[i][1], steps[i][2], &matched, 2000000);
+        }
+        if (t == SIM_TIME_NEVER || (matched && i > 0 && ++again > 10))
+        {
+            if (verbose)
+                printStep(names[i], SIM_TIME_NEVER);
+            return SIM_TIME_NEVER;
+        }
+        total += t;
+
+        if (matched)
+        {
+            i = (i == 0 ? 1 : i == 1 ? -1 : i - 1);
+            continue;
+        }
+        if (verbose)
+            printStep(names[i], t);
+    }
+
+    return total;
+}
+
+//scan -> join (connection and experience at once) of one user, like joinBooth
+static sim_time_t enterBooth(int user)
+{
+    sim_time_t t, total = 0;
+    int matched, again = 0;
+
+    for (int retry = 0; ; retry++)
+    {
+        sim_node_type(user, "s");
+        if ((t = sim_node_expectEither(user, "BOOTH FOUND", "BOOTH EXPERIENCE STARTED", &matched, 2000000)) == SIM_TIME_NEVER)
+        {
+            if (retry == 10)
+                return SIM_TIME_NEVER;
+            total += 2000000;
+            continue;
+        }
+        total += t;
+        if (matched)
+            return total;   //late accept of the join given up before
+
+        sim_node_type(user, "e");
+        if ((t = sim_node_expectEither(user, "BOOTH EXPERIENCE STARTED", "scan again", &matched, 60000000)) == SIM_TIME_NEVER ||
+            (matched && ++again > 10))
+            return SIM_TIME_NEVER;
+        total += t;
+        if (!matched)
+            return total;
+    }
+}
+
+//booth + user : scan -> connect -> experience
+static int scenario_join(void)
+{
+    int booth = addNode(BOOTH_ID_BASE);
+    int user = addNode(1);
+    sim_time_t total;
+
+    sim_run(1500000);   //let the booth beacon at least once
+
+    if ((total = joinBooth(user, 1)) == SIM_TIME_NEVER)
+        return 1;
+
+    printStep("total", total);
+    printHandshakes();
+    printPhyTotals();
+    (void)booth;
+
+    return checkNodes();
+}
+
+typedef struct {
+    const sim_nodeStats_t* tx;
+    const sim_nodeStats_t* rx;
+    uint32_t rcvd;
+    uint32_t confirmed;
+    uint32_t failed;
+} transfer_t;
+
+//the SDU reached the receiver's L3 and the sender got its confirmation, or the
+//sender's L2 gave up on it
+static uint8_t transferDone(void* arg)
+{
+    transfer_t* t = (transfer_t*)arg;
+    return (t->rx->sduRcvd != t->rcvd && t->tx->cnfOk != t->confirmed) || t->tx->cnfFail != t->failed;
+}
+
+//unicast SDU stream between two idle users, one SDU outstanding at a time
+static int scenario_bulk(void)
+{
+    int src = addNode(1);
+    int dst = addNode(2);
+    uint8_t sdu[255];
+    transfer_t t;
+    sim_time_t start = sim_clock_now();
+    int failed = 0;
+
+    sdu[0] = L3_MSG_TYPE_DATA;
+    for (int i = 1; i < sduLen; i++)
+        sdu[i] = 'a' + i%26;
+
+    t.tx = sim_node_getStats(src);
+    t.rx = sim_node_getStats(dst);
+
+    for (int i = 0; i < sduCount; i++)
+    {
+        t.rcvd = t.rx->sduRcvd;
+        t.confirmed = t.tx->cnfOk;
+        t.failed = t.tx->cnfFail;
+
+        sim_node_dataReq(src, sdu, sduLen, sim_node_getId(dst));
+        if (sim_runUntil(transferDone, &t, 600000000) == SIM_TIME_NEVER || t.tx->cnfFail != t.failed)
+            failed++;
+    }
+
+    sim_time_t elapsed = sim_clock_now() - start;
+
+    printf("SDUs sent         : %i (%i failed)\n", sduCount, failed);
+    printf("SDUs delivered    : %lu (%lu bytes)\n", (unsigned long)t.rx->sduRcvd, (unsigned long)t.rx->sduRcvdBytes);
+    printf("L2 confirmations  : %lu ok, %lu failed\n", (unsigned long)t.tx->cnfOk, (unsigned long)t.tx->cnfFail);
+    printf("elapsed           : %.1f ms (simulated)\n", elapsed/1000.0);
+    printf("goodput           : %.1f bytes/s\n", elapsed ? t.rx->sduRcvdBytes*1000000.0/elapsed : 0.0);
+    printf("L2 bytes copied   : %.1f per SDU\n", sduCount ? sim_node_getTxCopiedBytes(src)/(double)sduCount : 0.0);
+    printFramesPerKB(t.rx->sduRcvdBytes);
+    printf("L2 SRTT / RTO     : %lu / %lu ms\n",
+           (unsigned long)sim_node_getSrtt(src, sim_node_getId(dst)), (unsigned long)sim_node_getRto(src, sim_node_getId(dst)));
+    printPhyTotals();
+
+    return (checkNodes() || failed) ? 1 : 0;
+}
+
+typedef struct {
+    int n;
+    transfer_t t[SIM_MAX_NODES];
+    uint32_t cnfBase;
+} fanout_t;
+
+//every SDU of the round is confirmed and every successful one has been delivered
+static uint8_t fanoutDone(void* arg)
+{
+    fanout_t* f = (fanout_t*)arg;
+    const sim_nodeStats_t* tx = f->t[0].tx;
+    int delivered = 0;
+
+    if (tx->cnfOk + tx->cnfFail - f->cnfBase < (uint32_t)f->n)
+        return 0;
+
+    for (int i = 0; i < f->n; i++)
+        delivered += (f->t[i].rx->sduRcvd != f->t[i].rcvd);
+
+    return delivered >= f->n - (int)(tx->cnfFail - f->t[0].failed);
+}
+
+//one node serving several neighbors : per-neighbor ARQ contexts let the streams interleave
+static int scenario_fanout(void)
+{
+    int src = addNode(1);
+    int dst[SIM_MAX_NODES];
+    uint8_t sdu[255];
+    fanout_t f;
+    sim_time_t start = sim_clock_now();
+    int failed = 0;
+
+    if (numPeers < 1 || numPeers > SIM_MAX_NODES - 1)
+        numPeers = SIM_MAX_NODES - 1;
+
+    f.n = numPeers;
+    for (int i = 0; i < f.n; i++)
+    {
+        dst[i] = addNode(2 + i);
+        f.t[i].tx = sim_node_getStats(src);
+        f.t[i].rx = sim_node_getStats(dst[i]);
+    }
+
+    sdu[0] = L3_MSG_TYPE_DATA;
+    for (int i = 1; i < sduLen; i++)
+        sdu[i] = 'a' + i%26;
+
+    for (int r = 0; r < sduCount; r++)
+    {
+        f.cnfBase = f.t[0].tx->cnfOk + f.t[0].tx->cnfFail;
+        for (int i = 0; i < f.n; i++)
+        {
+            f.t[i].rcvd = f.t[i].rx->sduRcvd;
+            f.t[i].failed = f.t[i].tx->cnfFail;
+            sim_node_dataReq(src, sdu, sduLen, sim_node_getId(dst[i]));
+        }
+
+        if (sim_runUntil(fanoutDone, &f, 600000000) == SIM_TIME_NEVER)
+            failed += f.n;
+        else
+            failed += f.t[0].tx->cnfFail - f.t[0].failed;
+    }
+
+    sim_time_t elapsed = sim_clock_now() - start;
+    uint32_t bytes = 0;
+
+    for (int i = 0; i < f.n; i++)
+    {
+        printf("user %-3i          : %lu SDUs delivered, SRTT %lu ms\n", sim_node_getId(dst[i]),
+               (unsigned long)f.t[i].rx->sduRcvd, (unsigned long)sim_node_getSrtt(src, sim_node_getId(dst[i])));
+        bytes += f.t[i].rx->sduRcvdBytes;
+    }
+    printf("SDUs sent         : %i (%i failed)\n", sduCount*f.n, failed);
+    printf("elapsed           : %.1f ms (simulated)\n", elapsed/1000.0);
+    printf("goodput           : %.1f bytes/s\n", elapsed ? bytes*1000000.0/elapsed : 0.0);
+    printPhyTotals();
+
+    return (checkNodes() || failed) ? 1 : 0;
+}
+
+//payload derived from the sender, so that spliced SDUs are detected
+static void fillSdu(uint8_t* sdu, uint8_t srcId)
+{
+    sdu[0] = L3_MSG_TYPE_DATA;
+    for (int i = 1; i < sduLen; i++)
+        sdu[i] = srcId*7 + i;
+}
+
+//L3 control messages (booth beacons) are not the scenario's to check
+static uint8_t checkSdu(uint8_t srcId, uint8_t* dataPtr, uint8_t size)
+{
+    uint8_t expected[255];
+
+    if (dataPtr[0] != L3_MSG_TYPE_DATA)
+        return 1;
+
+    fillSdu(expected, srcId);
+    return size == sduLen && memcmp(dataPtr, expected, size) == 0;
+}
+
+typedef struct {
+    int n;
+    transfer_t t[SIM_MAX_NODES];
+} fanin_t;
+
+static uint8_t faninDone(void* arg)
+{
+    fanin_t* f = (fanin_t*)arg;
+
+    for (int i = 0; i < f->n; i++)
+    {
+        if (f->t[i].tx->cnfOk == f->t[i].confirmed && f->t[i].tx->cnfFail == f->t[i].failed)
+            return 0;
+    }
+
+    return 1;
+}
+
+//several users upload segmented SDUs to the same node at once : per-source reassembly
+static int scenario_fanin(void)
+{
+    int dst = addNode(1);
+    int src[SIM_MAX_NODES];
+    uint8_t sdu[255];
+    fanin_t f;
+    sim_time_t start = sim_clock_now();
+    uint32_t completed, evicted, timedOut;
+    int failed = 0;
+
+    if (numPeers < 1 || numPeers > SIM_MAX_NODES - 1)
+        numPeers = SIM_MAX_NODES - 1;
+
+    f.n = numPeers;
+    for (int i = 0; i < f.n; i++)
+    {
+        src[i] = addNode(2 + i);
+        f.t[i].tx = sim_node_getStats(src[i]);
+        f.t[i].rx = sim_node_getStats(dst);
+    }
+    sim_node_setDataCheck(checkSdu);
+
+    for (int r = 0; r < sduCount; r++)
+    {
+        for (int i = 0; i < f.n; i++)
+        {
+            f.t[i].confirmed = f.t[i].tx->cnfOk;
+            f.t[i].failed = f.t[i].tx->cnfFail;
+
+            fillSdu(sdu, sim_node_getId(src[i]));
+            sim_node_dataReq(src[i], sdu, sduLen, sim_node_getId(dst));
+        }
+
+        if (sim_runUntil(faninDone, &f, 600000000) == SIM_TIME_NEVER)
+            failed += f.n;
+        else
+        {
+            for (int i = 0; i < f.n; i++)
+                failed += f.t[i].tx->cnfFail - f.t[i].failed;
+        }
+    }
+
+    sim_time_t elapsed = sim_clock_now() - start;
+    const sim_nodeStats_t* rx = sim_node_getStats(dst);
+
+    sim_node_getReasmStats(dst, &completed, &evicted, &timedOut);
+
+    printf("SDUs sent         : %i (%i failed)\n", sduCount*f.n, failed);
+    printf("SDUs delivered    : %lu (%lu corrupted)\n", (unsigned long)rx->sduRcvd, (unsigned long)rx->sduBad);
+    printf("reassembly        : %lu completed, %lu evicted, %lu timed out\n",
+           (unsigned long)completed, (unsigned long)evicted, (unsigned long)timedOut);
+    printf("elapsed           : %.1f ms (simulated)\n", elapsed/1000.0);
+    printf("goodput           : %.1f bytes/s\n", elapsed ? rx->sduRcvdBytes*1000000.0/elapsed : 0.0);
+    printPhyTotals();
+
+    return (checkNodes() || failed) ? 1 : 0;
+}
+
+//two users send to the same booth while its main loop is held up : their frames wait in L2 and
+//meet in one pass, L3 has room for one SDU at a time (counted at the L2/L3 boundary and as handled)
+static int scenario_inbox(void)
+{
+    int booth = addNode(BOOTH_ID_BASE);
+    int src[2];
+    uint8_t sdu[255];
+    fanin_t f;
+    sim_time_t start = sim_clock_now();
+    int failed = 0;
+
+    f.n = 2;
+    for (int i = 0; i < f.n; i++)
+    {
+        src[i] = addNode(1 + i);
+        f.t[i].tx = sim_node_getStats(src[i]);
+        f.t[i].rx = sim_node_getStats(booth);
+    }
+    sim_node_setDataCheck(checkSdu);
+
+    for (int r = 0; r < sduCount; r++)
+    {
+        sim_node_setStalled(booth, 1);
+        for (int i = 0; i < f.n; i++)
+        {
+            f.t[i].confirmed = f.t[i].tx->cnfOk;
+            f.t[i].failed = f.t[i].tx->cnfFail;
+
+            //one after the other : the frames must not collide
+            fillSdu(sdu, sim_node_getId(src[i]));
+            sim_node_dataReq(src[i], sdu, sduLen, sim_node_getId(booth));
+            sim_run(SIM_INBOX_STALL/f.n);
+        }
+        sim_node_setStalled(booth, 0);
+
+        if (sim_runUntil(faninDone, &f, 600000000) == SIM_TIME_NEVER)
+            failed += f.n;
+        else
+        {
+            for (int i = 0; i < f.n; i++)
+                failed += f.t[i].tx->cnfFail - f.t[i].failed;
+        }
+    }
+    sim_run(SIM_INBOX_STALL);   //the last SDUs reach the booth's L3
+
+    const sim_nodeStats_t* rx = sim_node_getStats(booth);
+    uint32_t handled = rx->sduRcvd - rx->sduOverwritten;
+
+    printf("SDUs sent         : %i (%i failed)\n", sduCount*f.n, failed);
+    printf("SDUs given to L3  : %lu (%lu corrupted)\n", (unsigned long)rx->sduRcvd, (unsigned long)rx->sduBad);
+    printf("SDUs L3 handled   : %lu (%lu overwritten before L3 ran)\n", (unsigned long)handled, (unsigned long)rx->sduOverwritten);
+    printf("RX queue overflow : %lu frames\n", (unsigned long)sim_node_getRxOverflow(booth));
+    printf("elapsed           : %.1f ms (simulated)\n", (sim_clock_now() - start)/1000.0);
+
+    return (checkNodes() || failed || handled != (uint32_t)(sduCount*f.n - failed)) ? 1 : 0;
+}
+
+typedef struct {
+    const sim_nodeStats_t* tx;
+    uint32_t accepted;
+} queue_t;
+
+static uint8_t queueDone(void* arg)
+{
+    queue_t* q = (queue_t*)arg;
+    return q->tx->cnfOk + q->tx->cnfFail == q->accepted;
+}
+
+//DATA_REQs faster than L2 can send : queued in order up to the queue size, refused beyond
+static int scenario_queue(void)
+{
+    int src = addNode(1);
+    int dst = addNode(2);
+    uint8_t sdu[255];
+    queue_t q;
+    sim_time_t start = sim_clock_now();
+    int refused = 0;
+
+    q.tx = sim_node_getStats(src);
+    q.accepted = 0;
+    fillSdu(sdu, sim_node_getId(src));
+    sim_node_setDataCheck(checkSdu);
+
+    for (int i = 0; i < sduCount; i++)
+    {
+        if (sim_node_dataReq(src, sdu, sduLen, sim_node_getId(dst)) == 0)
+            q.accepted++;
+        else
+            refused++;
+    }
+
+    sim_time_t t = sim_runUntil(queueDone, &q, 600000000);
+    const sim_nodeStats_t* rx = sim_node_getStats(dst);
+
+    printf("SDUs requested    : %i (%lu accepted, %i refused)\n", sduCount, (unsigned long)q.accepted, refused);
+    printf("SDUs delivered    : %lu (%lu corrupted)\n", (unsigned long)rx->sduRcvd, (unsigned long)rx->sduBad);
+    printf("L2 confirmations  : %lu ok, %lu failed\n", (unsigned long)q.tx->cnfOk, (unsigned long)q.tx->cnfFail);
+    printf("elapsed           : %.1f ms (simulated)\n", (sim_clock_now() - start)/1000.0);
+    printPhyTotals();
+
+    return (checkNodes() || t == SIM_TIME_NEVER || rx->sduRcvd != q.accepted) ? 1 : 0;
+}
+
+typedef struct {
+    const sim_nodeStats_t* stats;
+    uint32_t rcvd;
+} chat_t;
+
+static uint8_t chatRcvd(void* arg)
+{
+    chat_t* c = (chat_t*)arg;
+    return c->stats->sduRcvd + c->stats->sduBad > c->rcvd;
+}
+
+static uint8_t chatConfirmed(void* arg)
+{
+    chat_t* c = (chat_t*)arg;
+    return c->stats->cnfOk + c->stats->cnfFail == (uint32_t)sduCount;
+}
+
+//SDUs queued for a busy neighbor must not hold back one for an idle neighbor behind them
+static int scenario_burst(void)
+{
+    int src = addNode(1);
+    int dst[2];
+    uint8_t sdu[255];
+    chat_t c;
+    queue_t q;
+    sim_time_t start, other, all;
+    int burst = sduCount, refused = 0;
+
+    //the SDU to user 3 must fit in the L2 transmit queue behind the others
+    if (burst > L2_TXQ_MAXSDUS - 1)
+        burst = L2_TXQ_MAXSDUS - 1;
+    if (burst > L2_TXQ_BYTES/sduLen - 1)
+        burst = L2_TXQ_BYTES/sduLen - 1;
+
+    dst[0] = addNode(2);
+    dst[1] = addNode(3);
+    fillSdu(sdu, sim_node_getId(src));
+    sim_node_setDataCheck(checkSdu);
+
+    q.tx = sim_node_getStats(src);
+    q.accepted = 0;
+    c.stats = sim_node_getStats(dst[1]);
+    c.rcvd = 0;
+
+    start = sim_clock_now();
+    for (int i = 0; i <= burst; i++)
+    {
+        if (sim_node_dataReq(src, sdu, sduLen, sim_node_getId(dst[i < burst ? 0 : 1])) == 0)
+            q.accepted++;
+        else
+            refused++;
+    }
+
+    other = sim_runUntil(chatRcvd, &c, 600000000);
+    all = sim_runUntil(queueDone, &q, 600000000);
+
+    printf("SDUs requested    : %i to user 2, 1 to user 3 (%lu accepted, %i refused)\n", burst, (unsigned long)q.accepted, refused);
+    printStep("user 3 served", other);
+    printStep("all confirmed", all == SIM_TIME_NEVER ? all : sim_clock_now() - start);
+    printPhyTotals();
+
+    return (checkNodes() || refused || other == SIM_TIME_NEVER || all == SIM_TIME_NEVER || q.tx->cnfFail) ? 1 : 0;
+}
+
+//request/reply unicast between two users : every SDU is answered as soon as it is delivered
+//so the ACK of its last segment can ride on the first segment of the reply
+static int scenario_chat(void)
+{
+    int node[2];
+    uint8_t sdu[2][255];
+    chat_t c[2];
+    sim_time_t start = sim_clock_now();
+    uint32_t rcvdBytes = 0;
+    int failed = 0;
+
+    node[0] = addNode(1);
+    node[1] = addNode(2);
+    sim_node_setDataCheck(checkSdu);
+
+    for (int i = 0; i < 2; i++)
+    {
+        c[i].stats = sim_node_getStats(node[i]);
+        c[i].rcvd = 0;
+        fillSdu(sdu[i], sim_node_getId(node[i]));
+    }
+
+    for (int n = 0; n < 2*sduCount && !failed; n++)
+    {
+        int from = n % 2;
+        chat_t* to = &c[1 - from];
+
+        sim_node_dataReq(node[from], sdu[from], sduLen, sim_node_getId(node[1 - from]));
+        if (sim_runUntil(chatRcvd, to, 600000000) == SIM_TIME_NEVER)
+            failed = 1;
+        to->rcvd++;
+    }
+
+    //the last reply is confirmed once its ACK is in
+    if (!failed && sim_runUntil(chatConfirmed, &c[1], 600000000) == SIM_TIME_NEVER)
+        failed = 1;
+    sim_time_t elapsed = sim_clock_now() - start;
+
+    for (int i = 0; i < 2; i++)
+    {
+        failed += c[i].stats->cnfFail;
+        rcvdBytes += c[i].stats->sduRcvdBytes;
+    }
+
+    printf("SDUs sent         : %i (%i failed)\n", 2*sduCount, failed);
+    printf("SDUs delivered    : %lu (%lu corrupted)\n", (unsigned long)(c[0].stats->sduRcvd + c[1].stats->sduRcvd),
+           (unsigned long)(c[0].stats->sduBad + c[1].stats->sduBad));
+    printf("elapsed           : %.1f ms (simulated)\n", elapsed/1000.0);
+    printf("goodput           : %.1f bytes/s\n", elapsed ? rcvdBytes*1000000.0/elapsed : 0.0);
+    printFramesPerKB(rcvdBytes);
+    printPhyTotals();
+
+    return (checkNodes() || failed) ? 1 : 0;
+}
+
+//booth experience group chat : every message reaches the other members in one broadcast frame
+//from the booth, relayed when a member wrote it
+static int scenario_group(void)
+{
+    int booth = addNode(BOOTH_ID_BASE);
+    int user[8];
+    sim_phyStats_t before, after;
+    char text[64], pattern[64];
+    int members = numPeers < 8 ? numPeers : 8;
+    int sent = 0, deliveries = 0, missed = 0;
+
+    sim_run(1500000);   //let the booth beacon at least once
+
+    for (int i = 0; i < members; i++)
+    {
+        user[i] = addNode(i + 1);
+        if (joinBooth(user[i], 0) == SIM_TIME_NEVER)
+        {
+            printf("user %i could not join the booth\n", i + 1);
+            return 1;
+        }
+    }
+    sim_run(1000000);
+
+    sim_medium_getTotals(&before);
+    for (int round = 0; round < sduCount; round++)
+    {
+        //author 0 is the booth, then every member in turn
+        for (int from = 0; from <= members; from++)
+        {
+            if (from == 0)
+            {
+                snprintf(text, sizeof(text), "g round %i from the booth\n", round);
+                snprintf(pattern, sizeof(pattern), "[BROADCAST from Booth %i]: round %i", BOOTH_ID_BASE, round);
+                sim_node_type(booth, text);
+            }
+            else
+            {
+                snprintf(text, sizeof(text), "round %i from user %i\n", round, from);
+                snprintf(pattern, sizeof(pattern), "[BROADCAST from User %i]: round %i", from, round);
+                sim_node_type(user[from - 1], text);
+            }
+            sent++;
+
+            for (int i = 0; i < members; i++)
+            {
+                if (i + 1 == from)
+                    continue;
+                if (sim_node_expect(user[i], pattern, 5000000) == SIM_TIME_NEVER)
+                    missed++;
+                else
+                    deliveries++;
+            }
+        }
+    }
+    sim_medium_getTotals(&after);
+
+    uint32_t nacks = 0, suppressed = 0, repaired = 0, lost = 0;
+    for (int i = 0; i < sim_node_count(); i++)
+    {
+        uint32_t n, s, r, l;
+
+        sim_node_getMcastStats(i, &n, &s, &r, &l);
+        nacks += n;
+        suppressed += s;
+        repaired += r;
+        lost += l;
+    }
+
+    printf("group members     : %i\n", members);
+    printf("messages sent     : %i\n", sent);
+    printf("deliveries        : %i (%i missed, %.1f %% delivered)\n", deliveries, missed,
+           deliveries + missed ? deliveries*100.0/(deliveries + missed) : 0.0);
+    printf("frames per message: %.2f (%.2f per delivery)\n", sent ? (after.txFrames - before.txFrames)/(double)sent : 0.0,
+           deliveries ? (after.txFrames - before.txFrames)/(double)deliveries : 0.0);
+    printf("L2 broadcast NACKs: %lu sent, %lu held back, %lu PDUs repeated, %lu given up\n",
+           (unsigned long)nacks, (unsigned long)suppressed, (unsigned long)repaired, (unsigned long)lost);
+    printPhyTotals();
+
+    return (checkNodes() || missed) ? 1 : 0;
+}
+
+//<peers> booths, user 1 scans <count> times : time from 's' to the booth found
+//booth i is heard 4 dB weaker than booth i+1, so the strongest one has the highest ID
+static int scenario_scan(void)
+{
+    int booths = numPeers < SIM_MAX_NODES - 1 ? numPeers : SIM_MAX_NODES - 1;
+    int user;
+    char best[32];
+    sim_time_t t, total = 0, worst = 0;
+    int found = 0, strongest = 0;
+
+    for (int i = 0; i < booths; i++)
+        addNode(BOOTH_ID_BASE + i);
+    user = addNode(1);
+    for (int i = 0; i < booths; i++)
+        sim_medium_setLink(i, user, -60 - 4*(booths - 1 - i), 8, lossRate);
+    snprintf(best, sizeof(best), "Best Booth ID: %i\n", BOOTH_ID_BASE + booths - 1);
+
+    sim_run(1500000);   //let every booth beacon at least once
+
+    for (int round = 0; round < sduCount; round++)
+    {
+        sim_run((500 + (round*373)%1000)*1000);  //the scan starts anywhere in the beacon period
+
+        sim_node_type(user, "s");
+        if ((t = sim_node_expect(user, "BOOTH FOUND", 3000000)) == SIM_TIME_NEVER)
+            continue;
+
+        found++;
+        total += t;
+        if (t > worst)
+            worst = t;
+        if (sim_node_expect(user, best, 1000) != SIM_TIME_NEVER)
+            strongest++;
+    }
+
+    printf("booths            : %i\n", booths);
+    printf("scans             : %i (%i found a booth, %i the strongest one)\n", sduCount, found, strongest);
+    printStep("average scan", found ? total/found : SIM_TIME_NEVER);
+    printStep("longest scan", found ? worst : SIM_TIME_NEVER);
+    printPhyTotals();
+
+    //without losses, ending the scan early must not miss the strongest booth
+    return (checkNodes() || found != sduCount || (lossRate == 0 && strongest != found)) ? 1 : 0;
+}
+
+//scan with 1, 5 and 10 booths : the stacks cannot be reset, so every size runs in a child
+//process with a fresh simulation
+static int scenario_sweep(void)
+{
+    static const int sizes[3] = {1, 5, 10};
+    int failed = 0;
+
+    for (int i = 0; i < 3; i++)
+    {
+        int status;
+        pid_t pid;
+
+        printf("--- %i booth(s) ---\n", sizes[i]);
+        fflush(stdout);
+        if ((pid = fork()) == 0)
+        {
+            numPeers = sizes[i];
+            exit(scenario_scan());
+        }
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            failed++;
+    }
+
+    return failed ? 1 : 0;
+}
+
+//<peers> booths of 5 users, every user hears booth i 4 dB weaker than booth i-1
+//users come one by one until the booths are full, each scans and connects (again after a reject)
+static int scenario_crowd(void)
+{
+    int booths = numPeers < 1 ? 1 : numPeers > 8 ? 8 : numPeers;
+    int users = SIM_MAX_NODES - booths < booths*5 ? SIM_MAX_NODES - booths : booths*5;
+    int user;
+    sim_time_t t, joinTime, total = 0, worst = 0;
+    int joined = 0, firstTry = 0, attempts = 0;
+
+    for (int i = 0; i < booths; i++)
+        addNode(BOOTH_ID_BASE + i);
+
+    sim_run(1500000);   //let every booth beacon at least once
+
+    for (int u = 0; u < users; u++)
+    {
+        user = addNode(u + 1);
+        for (int i = 0; i < booths; i++)
+            sim_medium_setLink(i, user, -60 - 4*i, 8, lossRate);
+
+        joinTime = 0;
+        for (int attempt = 1; attempt <= 5; attempt++)
+        {
+            attempts++;
+            sim_node_type(user, "s");
+            if ((t = sim_node_expect(user, "BOOTH FOUND", 3000000)) == SIM_TIME_NEVER)
+            {
+                joinTime += 3000000;
+                continue;
+            }
+            joinTime += t;
+
+            //a reject or no response moves on to the next booth of the scan by itself
+            sim_node_type(user, "y");
+            if ((t = sim_node_expect(user, "Connected!", 15000000)) != SIM_TIME_NEVER)
+            {
+                joinTime += t;
+                joined++;
+                firstTry += (attempt == 1);
+                total += joinTime;
+                if (joinTime > worst)
+                    worst = joinTime;
+                break;
+            }
+            joinTime += 15000000;
+        }
+    }
+
+    printf("booths            : %i (%i slots)\n", booths, booths*5);
+    printf("users             : %i (%i joined, %i at the first attempt, %.2f attempts each)\n",
+           users, joined, firstTry, users ? attempts/(double)users : 0.0);
+    printStep("average join", joined ? total/joined : SIM_TIME_NEVER);
+    printStep("longest join", joined ? worst : SIM_TIME_NEVER);
+    printHandshakes();
+    printPhyTotals();
+
+    return (checkNodes() || joined != users) ? 1 : 0;
+}
+
+//<peers> booths of 5 users, every user hears booth i 4 dB weaker than booth i-1
+//a user arrives every 100 ms, so several pick a booth from the same beacons before it fills up
+static int scenario_rush(void)
+{
+    enum { ARRIVING, SCANNING, CONNECTING, JOINED };
+    int booths = numPeers < 1 ? 1 : numPeers > 8 ? 8 : numPeers;
+    int users = SIM_MAX_NODES - booths < booths*5 ? SIM_MAX_NODES - booths : booths*5;
+    int node[SIM_MAX_NODES], state[SIM_MAX_NODES], scans[SIM_MAX_NODES];
+    sim_time_t arrival[SIM_MAX_NODES], since[SIM_MAX_NODES];
+    sim_time_t start, now, t, total = 0, worst = 0;
+    int joined = 0, firstScan = 0, scanCnt = 0;
+
+    for (int i = 0; i < booths; i++)
+        addNode(BOOTH_ID_BASE + i);
+    for (int u = 0; u < users; u++)
+    {
+        node[u] = addNode(u + 1);
+        for (int i = 0; i < booths; i++)
+            sim_medium_setLink(i, node[u], -60 - 4*i, 8, lossRate);
+        state[u] = ARRIVING;
+        scans[u] = 0;
+    }
+
+    sim_run(1500000);   //let every booth beacon at least once
+    start = sim_clock_now();
+
+    while (joined < users && sim_clock_now() - start < 120000000)
+    {
+        sim_run(5000);
+        now = sim_clock_now();
+
+        for (int u = 0; u < users; u++)
+        {
+            //a scan that found nothing, a connection with no booth left to try or stuck : scan again
+            if ((state[u] == ARRIVING && now - start >= (sim_time_t)u*100000) ||
+                (state[u] == SCANNING && sim_node_expect(node[u], "SCAN COMPLETE", 0) != SIM_TIME_NEVER) ||
+                (state[u] == CONNECTING && (sim_node_expect(node[u], "scan again", 0) != SIM_TIME_NEVER ||
+                                            now - since[u] > 15000000)))
+            {
+                if (state[u] == ARRIVING)
+                    arrival[u] = now;
+                sim_node_type(node[u], "s");
+                state[u] = SCANNING;
+                since[u] = now;
+                scans[u]++;
+                scanCnt++;
+            }
+            else if (state[u] == SCANNING && sim_node_expect(node[u], "BOOTH FOUND", 0) != SIM_TIME_NEVER)
+            {
+                sim_node_type(node[u], "y");
+                state[u] = CONNECTING;
+                since[u] = now;
+            }
+            else if (state[u] != ARRIVING && state[u] != JOINED && sim_node_expect(node[u], "Connected!", 0) != SIM_TIME_NEVER)
+            {
+                state[u] = JOINED;
+                joined++;
+                firstScan += (scans[u] == 1);
+                t = now - arrival[u];
+                total += t;
+                if (t > worst)
+                    worst = t;
+            }
+        }
+    }
+
+    printf("booths            : %i (%i slots)\n", booths, booths*5);
+    printf("users             : %i (%i joined, %i with one scan, %.2f scans each)\n",
+           users, joined, firstScan, users ? scanCnt/(double)users : 0.0);
+    printStep("average join", joined ? total/joined : SIM_TIME_NEVER);
+    printStep("longest join", joined ? worst : SIM_TIME_NEVER);
+    printHandshakes();
+    printPhyTotals();
+
+    return (checkNodes() || joined != users) ? 1 : 0;
+}
+
+//the user is in the group, the booth writes to it right away : time until the user has it
+static sim_time_t firstGroupMessage(int booth, int user, uint8_t boothId)
+{
+    char pattern[48];
+
+    snprintf(pattern, sizeof(pattern), "[BROADCAST from Booth %i]: welcome", boothId);
+    sim_node_type(booth, "g welcome\n");
+
+    return sim_node_expect(user, pattern, 10000000);
+}
+
+//two booths out of each other's range, each with its own user : user 1 goes through scan ->
+//connect -> experience, user 2 through scan -> join, one after the other
+static int scenario_entry(void)
+{
+    int booth[2], user[2];
+    sim_time_t join[2], first[2];
+    static const char* const names[2] = {"two-step join", "one-step join"};
+
+    for (int i = 0; i < 2; i++)
+        booth[i] = addNode(BOOTH_ID_BASE + i);
+    for (int i = 0; i < 2; i++)
+        user[i] = addNode(i + 1);
+    sim_medium_setLink(booth[0], booth[1], -140, -20, 1.0f);
+    sim_medium_setLink(booth[0], user[1], -140, -20, 1.0f);
+    sim_medium_setLink(booth[1], user[0], -140, -20, 1.0f);
+    sim_medium_setLink(user[0], user[1], -140, -20, 1.0f);
+
+    sim_run(1500000);   //let the booths beacon at least once
+
+    for (int i = 0; i < 2; i++)
+    {
+        join[i] = i == 0 ? joinBooth(user[i], 0) : enterBooth(user[i]);
+        if (join[i] == SIM_TIME_NEVER)
+        {
+            printStep(names[i], SIM_TIME_NEVER);
+            return 1;
+        }
+
+        //the broadcast may be given up on, like any group message
+        if ((first[i] = firstGroupMessage(booth[i], user[i], BOOTH_ID_BASE + i)) == SIM_TIME_NEVER)
+            printf("%-18s: %.1f ms to the group, first message lost\n", names[i], join[i]/1000.0);
+        else
+            printf("%-18s: %.1f ms to the group, first message after %.1f ms\n", names[i], join[i]/1000.0, (join[i] + first[i])/1000.0);
+    }
+    printHandshakes();
+    printPhyTotals();
+
+    return (checkNodes() || first[0] == SIM_TIME_NEVER || first[1] == SIM_TIME_NEVER) ? 1 : 0;
+}
+
+//booth %i full with users 1-5, users 6-8 wait in line (user 8 with a join request), then
+//the booth disconnects users 1-3 ten seconds apart : the first one waiting gets in each time
+static int scenario_line(void)
+{
+    int booth = addNode(BOOTH_ID_BASE);
+    int user[8];
+    static const char* const keys[3] = {"y", "y", "e"};
+    static const char* const admitted[3] = {"Connected!", "Connected!", "BOOTH EXPERIENCE STARTED"};
+    char pattern[48];
+    uint32_t waitFrames = 0;
+    sim_time_t t, total = 0, worst = 0;
+    int inOrder = 0, queued = 0;
+
+    sim_run(1500000);   //let the booth beacon at least once
+
+    for (int i = 0; i < 8; i++)
+    {
+        user[i] = addNode(i + 1);
+        if (i < 5)
+        {
+            if (joinBooth(user[i], 0) == SIM_TIME_NEVER)
+            {
+                printf("user %i could not join the booth\n", i + 1);
+                return 1;
+            }
+            continue;
+        }
+
+        //scan again when the beacons were lost, or were older than the last users and the
+        //booth rejected the user to have it look for another one, like the user would
+        snprintf(pattern, sizeof(pattern), "waiting in line (position %i)", queued + 1);
+        for (int retry = 0; retry < 10; retry++)
+        {
+            int matched;
+
+            sim_node_type(user[i], "s");
+            if (sim_node_expect(user[i], "BOOTH FOUND", 5000000) == SIM_TIME_NEVER)
+                continue;
+            sim_node_type(user[i], keys[i - 5]);
+            if (sim_node_expectEither(user[i], pattern, "scan again", &matched, 30000000) != SIM_TIME_NEVER && !matched)
+            {
+                queued++;
+                break;
+            }
+        }
+    }
+
+    for (int i = 5; i < 8; i++)
+        waitFrames -= sim_medium_getStats(user[i])->txFrames;
+
+    for (int i = 0; i < 3; i++)
+    {
+        sim_run(10000000);  //waiting users stay quiet
+
+        snprintf(pattern, sizeof(pattern), "d %i\n", i + 1);
+        sim_node_type(booth, pattern);
+        if ((t = sim_node_expect(user[5 + i], admitted[i], 30000000)) == SIM_TIME_NEVER)
+            continue;
+
+        //nobody behind got in before
+        if (i < 2 && sim_node_expect(user[6 + i], admitted[i + 1], 0) != SIM_TIME_NEVER)
+            continue;
+        inOrder++;
+        total += t;
+        if (t > worst)
+            worst = t;
+    }
+
+    for (int i = 5; i < 8; i++)
+        waitFrames += sim_medium_getStats(user[i])->txFrames;
+
+    printf("waiting users     : 3 (%i queued, %i let in in order)\n", queued, inOrder);
+    printStep("average admission", inOrder ? total/inOrder : SIM_TIME_NEVER);
+    printStep("longest admission", inOrder ? worst : SIM_TIME_NEVER);
+    printf("frames while in line: %lu (by the waiting users)\n", (unsigned long)waitFrames);
+    printHandshakes();
+    printPhyTotals();
+
+    return (checkNodes() || queued != 3 || inOrder != 3) ? 1 : 0;
+}
+
+//<peers> booths and nobody around for a minute, then user 1 scans <count> times a few seconds
+//apart, then quiet again : booths send nothing but beacons here, so their PHY counters are their beacon load
+static int scenario_hall(void)
+{
+    int booths = numPeers < 1 ? 1 : numPeers > SIM_MAX_NODES - 1 ? SIM_MAX_NODES - 1 : numPeers;
+    uint32_t quietFrames[SIM_MAX_NODES];
+    sim_time_t t, elapsed, airtime = 0, total = 0, worst = 0;
+    int user, found = 0;
+
+    for (int i = 0; i < booths; i++)
+        addNode(BOOTH_ID_BASE + i);
+
+    sim_run(60000000);
+    for (int i = 0; i < booths; i++)
+        quietFrames[i] = sim_medium_getStats(i)->txFrames;
+
+    user = addNode(1);
+    for (int round = 0; round < sduCount; round++)
+    {
+        sim_run((2000 + (round*3730)%7000)*1000);
+
+        sim_node_type(user, "s");
+        if ((t = sim_node_expect(user, "BOOTH FOUND", 3000000)) == SIM_TIME_NEVER)
+            continue;
+
+        found++;
+        total += t;
+        if (t > worst)
+            worst = t;
+    }
+    sim_run(60000000);
+    elapsed = sim_clock_now();
+
+    printf("booths            : %i, %.1f s\n", booths, elapsed/1000000.0);
+    for (int i = 0; i < booths; i++)
+    {
+        const sim_phyStats_t* stats = sim_medium_getStats(i);
+
+        printf("booth %-12i: %lu beacons (%lu in the quiet first 60 s), %.1f ms airtime, %.2f %% of the channel\n",
+               BOOTH_ID_BASE + i, (unsigned long)stats->txFrames, (unsigned long)quietFrames[i],
+               stats->txAirtime/1000.0, stats->txAirtime*100.0/elapsed);
+        airtime += stats->txAirtime;
+    }
+    printf("all booths        : %.2f %% of the channel\n", airtime*100.0/elapsed);
+    printf("scans             : %i (%i found a booth)\n", sduCount, found);
+    printStep("average scan", found ? total/found : SIM_TIME_NEVER);
+    printStep("longest scan", found ? worst : SIM_TIME_NEVER);
+    printPhyTotals();
+
+    return (checkNodes() || found != sduCount) ? 1 : 0;
+}
+
+int main(int argc, char* argv[])
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "vrs:p:l:c:w:m:a:n:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'v':
+                sim_setVerbose(1);
+                break;
+            case 'r':
+                sim_clock_setRealtime(1);
+                break;
+            case 's':
+                sim_medium_setSeed(strtoul(optarg, NULL, 0));
+                break;
+            case 'p':
+                lossRate = atof(optarg);
+                break;
+            case 'l':
+                sduLen = atoi(optarg);
+                if (sduLen < 1 || sduLen > 255)
+                    sduLen = 255;
+                break;
+            case 'c':
+                sduCount = atoi(optarg);
+                break;
+            case 'w':
+                arqWindow = atoi(optarg);
+                break;
+            case 'm':
+                mss = atoi(optarg);
+                break;
+            case 'a':
+                ackDelay = atoi(optarg);
+                break;
+            case 'n':
+                numPeers = atoi(optarg);
+                break;
+            default:
+                usage();
+                return 2;
+        }
+    }
+
+    if (optind >= argc)
+    {
+        usage();
+        return 2;
+    }
+
+    sim_medium_setLossRate(lossRate);
+
+    if (strcmp(argv[optind], "join") == 0)
+        return scenario_join();
+    else if (strcmp(argv[optind], "bulk") == 0)
+        return scenario_bulk();
+    else if (strcmp(argv[optind], "fanout") == 0)
+        return scenario_fanout();
+    else if (strcmp(argv[optind], "fanin") == 0)
+        return scenario_fanin();
+    else if (strcmp(argv[optind], "inbox") == 0)
+        return scenario_inbox();
+    else if (strcmp(argv[optind], "queue") == 0)
+        return scenario_queue();
+    else if (strcmp(argv[optind], "burst") == 0)
+        return scenario_burst();
+    else if (strcmp(argv[optind], "chat") == 0)
+        return scenario_chat();
+    else if (strcmp(argv[optind], "group") == 0)
+        return scenario_group();
+    else if (strcmp(argv[optind], "scan") == 0)
+        return scenario_scan();
+    else if (strcmp(argv[optind], "sweep") == 0)
+        return scenario_sweep();
+    else if (strcmp(argv[optind], "crowd") == 0)
+        return scenario_crowd();
+    else if (strcmp(argv[optind], "rush") == 0)
+        return scenario_rush();
+    else if (strcmp(argv[optind], "line") == 0)
+        return scenario_line();
+    else if (strcmp(argv[optind], "entry") == 0)
+        return scenario_entry();
+    else if (strcmp(argv[optind], "hall") == 0)
+        return scenario_hall();
+
+    usage();
+    return 2;
+}
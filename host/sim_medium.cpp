@@ -0,0 +1,229 @@
+#include "mbed.h"
+#include "sim_medium.h"
+
+//PHYMAC error codes, kept in sync with ../PHYMAC_layer.h
+#define PHYMAC_ERR_NONE             0
+#define PHYMAC_ERR_WRONGSTATE       1
+#define PHYMAC_ERR_HWERROR          2
+#define PHYMAC_ERR_SIZE             3
+
+typedef struct {
+    uint8_t active;
+    uint8_t id;
+    void (*dataCnfFunc)(int);
+    void (*dataIndFunc)(uint8_t, uint8_t*, uint8_t, uint8_t);
+    sim_time_t txEnd;
+    int16_t rssi;
+    int8_t snr;
+    sim_phyStats_t stats;
+} sim_phy_t;
+
+typedef struct {
+    uint8_t used;
+    int src;
+    uint8_t dest;
+    sim_time_t start;
+    sim_time_t end;
+    uint8_t size;
+    uint8_t data[SIM_PHY_MAX_PDUSIZE];
+} sim_frame_t;
+
+typedef struct {
+    uint8_t configured;
+    int16_t rssi;
+    int8_t snr;
+    float loss;
+} sim_link_t;
+
+static sim_phy_t phy[SIM_MAX_NODES];
+static sim_frame_t frames[SIM_PHY_FRAMES];
+static uint8_t nextFrame = 0;
+static sim_link_t links[SIM_MAX_NODES][SIM_MAX_NODES];
+
+static float defaultLoss = 0;
+static uint32_t prngState = 0x2545F491;
+
+
+//channel randomness, independent of the rand() stream used by the stack
+static float prng(void)
+{
+    prngState ^= prngState << 13;
+    prngState ^= prngState >> 17;
+    prngState ^= prngState << 5;
+
+    return (prngState >> 8) / (float)(1 << 24);
+}
+
+static sim_link_t* getLink(int a, int b)
+{
+    static sim_link_t def;
+
+    if (links[a][b].configured)
+        return &links[a][b];
+
+    def.rssi = SIM_PHY_DEFAULT_RSSI;
+    def.snr = SIM_PHY_DEFAULT_SNR;
+    def.loss = defaultLoss;
+
+    return &def;
+}
+
+//1 if any other frame overlapped f on the channel; this covers collisions as
+//well as a receiver that was transmitting itself
+static uint8_t isCorrupted(sim_frame_t* f)
+{
+    for (int i = 0; i < SIM_PHY_FRAMES; i++)
+    {
+        sim_frame_t* o = &frames[i];
+
+        if (!o->used || o == f)
+            continue;
+        if (o->start < f->end && f->start < o->end)
+            return 1;
+    }
+
+    return 0;
+}
+
+static void txEndHandler(void* arg)
+{
+    sim_frame_t* f = (sim_frame_t*)arg;
+    uint8_t br = (f->dest == SIM_PHY_BROADCAST_ID);
+
+    for (int i = 0; i < SIM_MAX_NODES; i++)
+    {
+        if (i == f->src || !phy[i].active || (!br && phy[i].id != f->dest))
+            continue;
+
+        sim_link_t* link = getLink(f->src, i);
+
+        if (isCorrupted(f))
+        {
+            phy[i].stats.rxCollided++;
+            continue;
+        }
+        if (link->loss > 0 && prng() < link->loss)
+        {
+            phy[i].stats.rxLost++;
+            continue;
+        }
+
+        phy[i].rssi = link->rssi;
+        phy[i].snr = link->snr;
+        phy[i].stats.rxFrames++;
+
+        int prev = sim_node_enter(i);
+        phy[i].dataIndFunc(phy[f->src].id, f->data, f->size, br);
+        sim_node_leave(prev);
+    }
+
+    phy[f->src].dataCnfFunc(PHYMAC_ERR_NONE);
+}
+
+
+void sim_medium_init(int node, uint8_t id, void (*dataCnfFunc)(int), void (*dataIndFunc)(uint8_t, uint8_t*, uint8_t, uint8_t))
+{
+    phy[node].active = 1;
+    phy[node].id = id;
+    phy[node].dataCnfFunc = dataCnfFunc;
+    phy[node].dataIndFunc = dataIndFunc;
+}
+
+int sim_medium_dataReq(int node, uint8_t* dataPtr, uint8_t size, uint8_t destId)
+{
+    sim_phy_t* p = &phy[node];
+    sim_time_t now = sim_clock_now();
+
+    if (!p->active)
+        return PHYMAC_ERR_HWERROR;
+    if (size == 0 || size > SIM_PHY_MAX_PDUSIZE)
+        return PHYMAC_ERR_SIZE;
+    if (now < p->txEnd)
+        return PHYMAC_ERR_WRONGSTATE;
+
+    //reuse the oldest slot; by then its transmission has long ended
+    sim_frame_t* f = &frames[nextFrame];
+    nextFrame = (nextFrame + 1) % SIM_PHY_FRAMES;
+
+    f->used = 1;
+    f->src = node;
+    f->dest = destId;
+    f->size = size;
+    f->start = now;
+    f->end = now + SIM_PHY_PREAMBLE_US + (sim_time_t)size*SIM_PHY_BYTE_US;
+    memcpy(f->data, dataPtr, size);
+
+    p->txEnd = f->end;
+    p->stats.txFrames++;
+    p->stats.txBytes += size;
+    p->stats.txAirtime += f->end - f->start;
+
+    sim_sched_add(f->end, node, txEndHandler, f);
+
+    return PHYMAC_ERR_NONE;
+}
+
+int16_t sim_medium_getDataRssi(int node)
+{
+    return phy[node].rssi;
+}
+
+int8_t sim_medium_getDataSnr(int node)
+{
+    return phy[node].snr;
+}
+
+int sim_medium_configSrcId(int node, uint8_t id)
+{
+    if (!phy[node].active)
+        return PHYMAC_ERR_HWERROR;
+    if (phy[node].txEnd > sim_clock_now())
+        return PHYMAC_ERR_WRONGSTATE;
+
+    phy[node].id = id;
+    return PHYMAC_ERR_NONE;
+}
+
+
+void sim_medium_setSeed(uint32_t seed)
+{
+    prngState = seed ? seed : 0x2545F491;
+}
+
+void sim_medium_setLossRate(float loss)
+{
+    defaultLoss = loss;
+}
+
+void sim_medium_setLink(int a, int b, int16_t rssi, int8_t snr, float loss)
+{
+    sim_link_t link;
+
+    link.configured = 1;
+    link.rssi = rssi;
+    link.snr = snr;
+    link.loss = loss;
+
+    links[a][b] = link;
+    links[b][a] = link;
+}
+
+const sim_phyStats_t* sim_medium_getStats(int node)
+{
+    return &phy[node].stats;
+}
+
+void sim_medium_getTotals(sim_phyStats_t* total)
+{
+    memset(total, 0, sizeof(sim_phyStats_t));
+
+    for (int i = 0; i < SIM_MAX_NODES; i++)
+    {
+        total->txFrames += phy[i].stats.txFrames;
+        total->txBytes += phy[i].stats.txBytes;
+        total->txAirtime += phy[i].stats.txAirtime;
+        total->rxFrames += phy[i].stats.rxFrames;
+        total->rxLost += phy[i].stats.rxLost;
+        total->rxCollided += phy[i].stats.rxCollided;
+    }
+}
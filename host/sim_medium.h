@@ -0,0 +1,49 @@
+/* Shared radio medium behind the simulated PHYMAC_layer.h API.
+ *
+ * Frames occupy the channel for an airtime derived from their size and are
+ * delivered to the addressed node (or every node for L2 broadcast ID 255)
+ * when the transmission ends. A frame is missed by a receiver that was
+ * transmitting itself, that heard another overlapping frame (collision) or
+ * that loses it to the configured per-link loss rate.
+ */
+#ifndef SIM_MEDIUM_H
+#define SIM_MEDIUM_H
+
+#include <stdint.h>
+#include "sim.h"
+
+#define SIM_PHY_MAX_PDUSIZE         50
+#define SIM_PHY_BROADCAST_ID        255
+#define SIM_PHY_FRAMES              128     //frames remembered for overlap checks
+
+#define SIM_PHY_PREAMBLE_US         12000   //fixed airtime per frame
+#define SIM_PHY_BYTE_US             1500    //airtime per payload byte
+#define SIM_PHY_DEFAULT_RSSI        (-60)
+#define SIM_PHY_DEFAULT_SNR         8
+
+typedef struct {
+    uint32_t txFrames;
+    uint32_t txBytes;
+    sim_time_t txAirtime;
+    uint32_t rxFrames;
+    uint32_t rxLost;        //dropped by the loss model
+    uint32_t rxCollided;    //overlapping frames or half-duplex
+} sim_phyStats_t;
+
+
+//PHYMAC API of one node (called through sim_node.cpp)
+void sim_medium_init(int node, uint8_t id, void (*dataCnfFunc)(int), void (*dataIndFunc)(uint8_t, uint8_t*, uint8_t, uint8_t));
+int sim_medium_dataReq(int node, uint8_t* dataPtr, uint8_t size, uint8_t destId);
+int16_t sim_medium_getDataRssi(int node);
+int8_t sim_medium_getDataSnr(int node);
+int sim_medium_configSrcId(int node, uint8_t id);
+
+//channel configuration
+void sim_medium_setSeed(uint32_t seed);
+void sim_medium_setLossRate(float loss);
+void sim_medium_setLink(int a, int b, int16_t rssi, int8_t snr, float loss);
+
+const sim_phyStats_t* sim_medium_getStats(int node);
+void sim_medium_getTotals(sim_phyStats_t* total);
+
+#endif
@@ -0,0 +1,141 @@
+/* Per-node glue, compiled once per stack copy: binds the copy's PHYMAC API to
+ * its slot on the shared medium, provides the console that main.cpp owns on
+ * target and registers the copy's entry points with the simulator core. */
+#include "mbed.h"
+#include "sim.h"
+#include "sim_medium.h"
+#include "sim_node.h"
+
+namespace SIM_NODE_NS {
+#include "../PHYMAC_layer.h"
+#include "../L2_FSMmain.h"
+#include "../L2_FSMevent.h"
+#include "../L2_LLinterface.h"
+#include "../L2_peer.h"
+#include "../L2_reasm.h"
+#include "../L2_mcast.h"
+#include "../L3_FSMmain.h"
+#include "../L3_LLinterface.h"
+#include "../L3_request.h"
+#include "../scheduler.h"
+#include "../timerwheel.h"
+
+//serial port interface (defined in main.cpp on target)
+Serial pc(USBTX, USBRX);
+
+
+//PHYMAC API ---------------------------------------------------
+int phymac_dataReq(uint8_t* dataPtr, uint8_t size, uint8_t destId)
+{
+    return sim_medium_dataReq(SIM_NODE_INDEX, dataPtr, size, destId);
+}
+
+void phymac_init(uint8_t id, void (*dataCnfFunc)(int), void (*dataIndFunc)(uint8_t, uint8_t*, uint8_t, uint8_t))
+{
+    sim_medium_init(SIM_NODE_INDEX, id, dataCnfFunc, dataIndFunc);
+}
+
+int16_t phymac_getDataRssi(void)
+{
+    return sim_medium_getDataRssi(SIM_NODE_INDEX);
+}
+
+int8_t phymac_getDataSnr(void)
+{
+    return sim_medium_getDataSnr(SIM_NODE_INDEX);
+}
+
+int phymac_configSrcId(uint8_t id)
+{
+    return sim_medium_configSrcId(SIM_NODE_INDEX, id);
+}
+
+
+//L2 -> L3 primitives, observed before L3_LLinterface.cpp handles them
+//(the Makefile renames the originals to sim_wrapped_*)
+void sim_wrapped_L3_LLI_dataInd(uint8_t* dataPtr, uint8_t srcId, uint8_t size, int8_t snr, int16_t rssi);
+void sim_wrapped_L3_LLI_dataCnf(uint8_t res, uint8_t destId, uint8_t sduId);
+
+void L3_LLI_dataInd(uint8_t* dataPtr, uint8_t srcId, uint8_t size, int8_t snr, int16_t rssi)
+{
+    sim_node_onDataInd(SIM_NODE_INDEX, srcId, dataPtr, size, L3_LLI_checkMsgPending());
+    sim_wrapped_L3_LLI_dataInd(dataPtr, srcId, size, snr, rssi);
+}
+
+void L3_LLI_dataCnf(uint8_t res, uint8_t destId, uint8_t sduId)
+{
+    sim_node_onDataCnf(SIM_NODE_INDEX, res);
+    sim_wrapped_L3_LLI_dataCnf(res, destId, sduId);
+}
+
+
+//entry points -------------------------------------------------
+static void init(uint8_t id)
+{
+    //same ID for both layers, as entered twice at the console on target
+    timerwheel_init();
+    L2_initFSM(id);
+    L3_initFSM(id);
+    sched_init();
+}
+
+static void run(void)
+{
+    sched_run();
+}
+
+static int dataReq(uint8_t* sdu, uint8_t len, uint8_t destId)
+{
+    return L3_LLI_dataReqFunc(sdu, len, destId);
+}
+
+static void getReasmStats(uint32_t* completed, uint32_t* evicted, uint32_t* timedOut)
+{
+    const L2_reasmStats_t* stats = L2_reasm_getStats();
+
+    *completed = stats->completed;
+    *evicted = stats->evicted;
+    *timedOut = stats->timedOut;
+}
+
+static void getEventStats(uint32_t* handled, uint32_t* totalPasses, uint32_t* maxPasses)
+{
+    const L2_eventStats_t* stats = L2_event_getStats();
+
+    *handled = stats->handled;
+    *totalPasses = stats->totalPasses;
+    *maxPasses = stats->maxPasses;
+}
+
+static uint32_t getWakeups(void)
+{
+    return sched_getStats()->wakeups;
+}
+
+static void getMcastStats(uint32_t* nacksSent, uint32_t* nacksSuppressed, uint32_t* repaired, uint32_t* lost)
+{
+    const L2_mcastStats_t* stats = L2_mcast_getStats();
+
+    *nacksSent = stats->nacksSent;
+    *nacksSuppressed = stats->nacksSuppressed;
+    *repaired = stats->repaired;
+    *lost = stats->lost;
+}
+
+static void getReqStats(uint32_t* completed, uint32_t* failed, uint32_t* resent, uint32_t* totalTime, uint32_t* maxTime)
+{
+    const L3_reqStats_t* stats = L3_req_getStats();
+
+    *completed = stats->completed;
+    *failed = stats->failed;
+    *resent = stats->resent;
+    *totalTime = stats->totalTime;
+    *maxTime = stats->maxTime;
+}
+
+static const sim_nodeOps_t ops = {init, run, dataReq, L2_configArqWindow, L2_configMss, L2_configAckDelay, L2_peer_getSrtt, L2_peer_getRto, getReasmStats, L2_getTxCopiedBytes, L2_LLI_getRxOverflow, L3_getDroppedMsgs, getEventStats, getWakeups, getMcastStats, getReqStats};
+
+static struct registrar {
+    registrar() { sim_node_register(SIM_NODE_INDEX, &ops); }
+} reg;
+}
@@ -0,0 +1,13 @@
+/* Naming of the per-node stack copies (see sim_unit.cpp, sim_node.cpp). */
+#ifndef SIM_NODE_H
+#define SIM_NODE_H
+
+#ifndef SIM_NODE_INDEX
+#error "SIM_NODE_INDEX must be set by the host Makefile"
+#endif
+
+#define SIM_CAT_(a, b)              a ## b
+#define SIM_CAT(a, b)               SIM_CAT_(a, b)
+#define SIM_NODE_NS                 SIM_CAT(simnode, SIM_NODE_INDEX)
+
+#endif
@@ -0,0 +1,9 @@
+/* Compiles one stack source (SIM_UNIT_SRC) into the namespace of stack copy
+ * SIM_NODE_INDEX. The host Makefile builds every stack source once per node,
+ * so each simulated node owns its file-scope state. */
+#include "mbed.h"
+#include "sim_node.h"
+
+namespace SIM_NODE_NS {
+#include SIM_UNIT_SRC
+}
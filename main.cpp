@@ -2,6 +2,8 @@
 #include "string.h"
 #include "L2_FSMmain.h"
 #include "L3_FSMmain.h"
+#include "scheduler.h"
+#include "timerwheel.h"
 
 //serial port interface
 Serial pc(USBTX, USBRX);
@@ -29,12 +31,13 @@ int main(void){
     
 
     //initialize lower layer stacks
+    timerwheel_init();
     L2_initFSM(input_thisId);
     L3_initFSM(input_destId);
+    sched_init();
     
     while(1)
     {
-        L2_FSMrun();
-        L3_FSMrun();
+        sched_run();
     }
 }
\ No newline at end of file
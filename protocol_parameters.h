@@ -2,8 +2,53 @@
 #define DBGMSG_L3                       0 //debug print control
 
 #define L3_MAXDATASIZE                  1024
+#define L3_FSM_EVENTBUDGET              4 //events handled per L3_FSMrun call at most
+#define L3_BEACON_INTERVAL              1000 //ms, shortest booth beacon interval : at start, after a PROBE or a frame of a user without a session
+#define L3_BEACON_MAXINTERVAL           16000 //ms, the interval doubles after every beacon up to this while no one new shows up
+#define L3_SCAN_TIMEOUT                 1000 //ms a user listens for beacons after 's'
+#define L3_SCAN_RSSITHRESHOLD           (-70) //dBm : a booth heard at least this strong (and L3_SCAN_SNRTHRESHOLD) with room ends the scan after the PROBE replies
+#define L3_SCAN_SNRTHRESHOLD            5 //dB
+#define L3_SCAN_EXPECTEDBOOTHS          0 //booths heard that end the scan at once (0 : unknown, it ends once the PROBE replies stop)
+#define L3_PROBE_SLOTS                  16 //beacon slots after a PROBE, a booth answers in slot (ID % L3_PROBE_SLOTS)
+#define L3_PROBE_SLOTTIME               25 //ms per slot, about the airtime of a beacon
+#define L3_PROBE_WINDOW                 ((L3_PROBE_SLOTS + 1)*L3_PROBE_SLOTTIME) //ms from a PROBE to the end of the last reply
+#define L3_SCAN_QUIETTIME               (3*L3_PROBE_SLOTTIME) //ms without a reply that ends a scan which heard a good booth (two empty slots)
+#define L3_PROBE_RETRY                  500 //ms without any booth heard before the PROBE is sent again
+#define L3_REQ_MAXPENDING               4 //control requests (CONN_REQ, EXPERIENCE_REQ, a booth's admissions) waiting for their response at once
+#define L3_REQ_TIMEOUT                  2000 //ms a request waits for its response before it is sent again
+#define L3_HOLD_MAXMSGS                 4 //responses and ADMIT_ACKs refused by a full L2 transmit queue, sent again after a DATA_CNF
+#define L3_REQ_MAXTRIES                 3 //tries L2 delivered, or held past L3_REQ_CNFWAIT, before the request is given up
+#define L3_REQ_CNFWAIT                  ((L2_ARQ_MAXRETRANSMISSION + 1)*L2_ARQ_MAXRTO) //ms L2 may spend on a copy before its DATA_CNF (every try at the longest RTO)
+#define L3_SELECT_SLOTWEIGHT            1 //dB a free connection or experience slot of a booth is worth
+#define L3_SELECT_QUEUEWEIGHT           2 //dB a user waiting at a booth costs
+#define L3_SELECT_FULLPENALTY           100 //dB off a booth with no connection slot left
+#define L3_SESSION_MAXRECORDS           32 //users a booth keeps track of (connected or waiting)
 
 
 #define L2_ARQ_MAXRETRANSMISSION        10
-#define L2_ARQ_MAXWAITTIME              5
-#define L2_ARQ_MINWAITTIME              2
\ No newline at end of file
+#define L2_ARQ_INITRTO                  1000 //RTO until the first RTT sample (ms)
+#define L2_ARQ_MINRTO                   100 //ms
+#define L2_ARQ_MAXRTO                   4000 //ms, cap of the exponential backoff
+#define L2_ARQ_ACKDELAY                 20 //ms an ACK waits to piggyback on a DATA PDU (0 : none, at most L2_ARQ_MINRTO/2)
+#define L2_ARQ_WINDOWSIZE               4 //max outstanding segments (1 : stop-and-wait, 9..16 : one BLOCKACK per burst)
+
+#define L2_MSS                          46 //largest DATA payload accepted from a neighbor, advertised in ACKs
+#define L2_FSM_EVENTBUDGET              8 //events handled per L2_FSMrun call at most
+#define L2_LLI_RXQSIZE                  4 //received frames waiting for the L2 FSM (power of 2)
+#define L2_MAXPEERS                     8 //neighbors with L2 state
+#define L2_TXQ_MAXSDUS                  12 //SDUs accepted from L3 and not confirmed yet
+#define L2_TXQ_BYTES                    1536 //payload bytes of those SDUs, segmented in place
+#define L2_REASM_MAXENTRIES             4 //segmented SDUs reassembled at once (255 bytes each)
+#define L2_REASM_TIMEOUT                30000 //ms without a segment before a partial SDU is dropped
+
+#define L2_MCAST_MAXSOURCES             2 //broadcast senders (booths) whose PDUs are put back in order
+#define L2_MCAST_WINDOW                 8 //broadcast PDUs held behind a hole (8 at most : one NACK map)
+#define L2_MCAST_HISTORY                16 //broadcast PDUs the sender keeps for NACKs (power of 2)
+#define L2_MCAST_NACKDELAY              50 //ms from a hole to its NACK, plus up to L2_MCAST_NACKJITTER
+#define L2_MCAST_NACKJITTER             300 //random spread, so that the first NACK is overheard before the others
+#define L2_MCAST_NACKRETRY              500 //ms a NACK waits for the repair before it is sent again
+#define L2_MCAST_MAXNACKS               3 //NACKs for one hole before it is given up
+#define L2_MCAST_REPAIRHOLDOFF          150 //ms a repeated PDU is not repeated again for other NACKs
+
+#define TIMERWHEEL_SLOTS                32 //1 ms slots : timers due within this many ms are found without a full search
+#define TIMERWHEEL_MAXTIMERS            (2*L2_MAXPEERS + L2_MCAST_MAXSOURCES + 3 + L3_REQ_MAXPENDING + 4) //L2 ARQ, ACK and NACK timers, L3 beacon, scan, probe and request timers, 4 spare
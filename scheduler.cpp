@@ -0,0 +1,77 @@
+#include "mbed.h"
+#include "L2_FSMmain.h"
+#include "L2_FSMevent.h"
+#include "L3_FSMmain.h"
+#include "L3_FSMevent.h"
+#include "scheduler.h"
+
+//main loop : interrupts (PHY, timers, serial) post events, both FSMs run them to completion,
+//and the core sleeps once a whole pass finds nothing to do
+static sched_stats_t schedStats;
+static uint32_t startTime;
+static uint32_t sleepStart;
+static uint8_t asleep = 0;
+
+
+void sched_init(void)
+{
+    memset(&schedStats, 0, sizeof(schedStats));
+    startTime = us_ticker_read();
+    asleep = 0;
+
+    //UART RX and the PHY need the clocks that deep sleep stops
+    sleep_manager_lock_deep_sleep();
+}
+
+//one pass of the main loop
+void sched_run(void)
+{
+    uint32_t posts = L2_event_getPostCount() + L3_event_getPostCount();
+    uint32_t wakeTime = us_ticker_read();
+    uint8_t woken = asleep;
+
+    if (asleep)
+    {
+        schedStats.sleptUs += wakeTime - sleepStart;
+        asleep = 0;
+    }
+
+    if (L2_FSMrun() + L3_FSMrun() > 0)
+    {
+        if (woken)
+        {
+            uint32_t dispatch = us_ticker_read() - wakeTime;
+
+            schedStats.wakeups++;
+            schedStats.dispatchTotalUs += dispatch;
+            if (dispatch > schedStats.dispatchMaxUs)
+                schedStats.dispatchMaxUs = dispatch;
+        }
+        return;
+    }
+
+    //an event posted since the pass started is handled first : the check runs with interrupts
+    //masked, and one that becomes pending after it makes sleep() return at once
+    core_util_critical_section_enter();
+    if (posts == L2_event_getPostCount() + L3_event_getPostCount())
+    {
+        schedStats.sleeps++;
+        sleepStart = us_ticker_read();
+        asleep = 1;
+        sleep();
+    }
+    core_util_critical_section_exit();
+}
+
+//share of the time since sched_init spent asleep
+uint8_t sched_getIdlePercent(void)
+{
+    uint32_t elapsed = us_ticker_read() - startTime;
+
+    return elapsed ? (uint8_t)((uint64_t)schedStats.sleptUs*100/elapsed) : 0;
+}
+
+const sched_stats_t* sched_getStats(void)
+{
+    return &schedStats;
+}
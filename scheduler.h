@@ -0,0 +1,19 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "mbed.h"
+
+typedef struct {
+    uint32_t sleeps;
+    uint32_t sleptUs;           //time spent in sleep()
+    uint32_t wakeups;           //sleeps ended by an event the FSMs handled
+    uint32_t dispatchTotalUs;   //wake-up to the end of the first pass that handled it
+    uint32_t dispatchMaxUs;
+} sched_stats_t;
+
+void sched_init(void);
+void sched_run(void);
+uint8_t sched_getIdlePercent(void);
+const sched_stats_t* sched_getStats(void);
+
+#endif
@@ -0,0 +1,214 @@
+#include "mbed.h"
+#include "timerwheel.h"
+#include "protocol_parameters.h"
+
+#if TIMERWHEEL_MAXTIMERS >= TIMERWHEEL_NONE
+#error "TIMERWHEEL_MAXTIMERS must leave TIMERWHEEL_NONE free"
+#endif
+
+#define TIMERWHEEL_TICK_US          1000
+
+//protocol timers of both layers, multiplexed on one hardware Timeout
+//a running timer is linked in the slot of its expiry tick (expiry % TIMERWHEEL_SLOTS) : start and stop
+//are O(1), and only the interrupt walks the slots elapsed since the last one before arming the next expiry
+typedef struct {
+    timerwheel_cb_t cb;
+    uint8_t arg;
+    uint8_t running;
+    uint8_t prev;
+    uint8_t next;
+    uint32_t expiry;        //tick
+} timerwheel_entry_t;
+
+static timerwheel_entry_t timers[TIMERWHEEL_MAXTIMERS];
+static uint8_t timerCnt = 0;
+static uint8_t runningCnt = 0;
+static uint8_t slotHead[TIMERWHEEL_SLOTS];
+
+static uint32_t curTick;
+static uint32_t curTickUs;      //us ticker value at the start of curTick
+static uint32_t doneTick;       //last tick whose slot was walked
+static Timeout hwTimer;
+static uint8_t armed = 0;
+static uint32_t armedTick;
+
+
+//brings curTick up to the us ticker, wrap-around safe
+static void timerwheel_advance(void)
+{
+    uint32_t ticks = (us_ticker_read() - curTickUs)/TIMERWHEEL_TICK_US;
+
+    curTick += ticks;
+    curTickUs += ticks*TIMERWHEEL_TICK_US;
+}
+
+static void timerwheel_link(uint8_t handle)
+{
+    uint8_t slot = timers[handle].expiry % TIMERWHEEL_SLOTS;
+
+    timers[handle].prev = TIMERWHEEL_NONE;
+    timers[handle].next = slotHead[slot];
+    if (slotHead[slot] != TIMERWHEEL_NONE)
+        timers[slotHead[slot]].prev = handle;
+    slotHead[slot] = handle;
+    timers[handle].running = 1;
+    runningCnt++;
+}
+
+static void timerwheel_unlink(uint8_t handle)
+{
+    timerwheel_entry_t* t = &timers[handle];
+
+    if (t->prev != TIMERWHEEL_NONE)
+        timers[t->prev].next = t->next;
+    else
+        slotHead[t->expiry % TIMERWHEEL_SLOTS] = t->next;
+    if (t->next != TIMERWHEEL_NONE)
+        timers[t->next].prev = t->prev;
+    t->running = 0;
+    runningCnt--;
+}
+
+void timerwheel_timeoutHandler(void);
+
+static void timerwheel_arm(uint32_t tick)
+{
+    int32_t wait = (int32_t)(curTickUs + (tick - curTick)*TIMERWHEEL_TICK_US - us_ticker_read());
+
+    armed = 1;
+    armedTick = tick;
+    hwTimer.attach_us(timerwheel_timeoutHandler, wait > 0 ? wait : 0);
+}
+
+//earliest expiry : the slots of the next revolution first, then every timer for the far ones
+static void timerwheel_armNext(void)
+{
+    uint32_t next = 0;
+    uint8_t found = 0;
+
+    for (uint32_t d = 0; d < TIMERWHEEL_SLOTS && !found; d++)
+    {
+        for (uint8_t h = slotHead[(curTick + d) % TIMERWHEEL_SLOTS]; h != TIMERWHEEL_NONE; h = timers[h].next)
+        {
+            if (timers[h].expiry == curTick + d)
+            {
+                next = curTick + d;
+                found = 1;
+                break;
+            }
+        }
+    }
+
+    if (!found)
+    {
+        for (uint8_t h = 0; h < timerCnt; h++)
+        {
+            if (timers[h].running && (!found || (int32_t)(timers[h].expiry - next) < 0))
+            {
+                next = timers[h].expiry;
+                found = 1;
+            }
+        }
+    }
+
+    if (found)
+        timerwheel_arm(next);
+    else
+    {
+        armed = 0;
+        hwTimer.detach();
+    }
+}
+
+//hardware timer : fires the timers of the slots elapsed since the last walk
+void timerwheel_timeoutHandler(void)
+{
+    uint32_t slots;
+
+    timerwheel_advance();
+    slots = curTick - doneTick + 1;
+    if (slots > TIMERWHEEL_SLOTS)
+        slots = TIMERWHEEL_SLOTS;
+
+    for (uint32_t i = 0; i < slots; i++)
+    {
+        uint8_t h = slotHead[(doneTick + i) % TIMERWHEEL_SLOTS];
+
+        while (h != TIMERWHEEL_NONE)
+        {
+            uint8_t next = timers[h].next;
+
+            if ((int32_t)(timers[h].expiry - curTick) <= 0)
+            {
+                timerwheel_unlink(h);
+                timers[h].cb(timers[h].arg);
+            }
+            h = next;
+        }
+    }
+    doneTick = curTick;
+
+    timerwheel_armNext();
+}
+
+
+void timerwheel_init(void)
+{
+    timerCnt = 0;
+    runningCnt = 0;
+    memset(slotHead, TIMERWHEEL_NONE, sizeof(slotHead));
+
+    curTick = doneTick = 0;
+    curTickUs = us_ticker_read();
+    armed = 0;
+    hwTimer.detach();
+}
+
+//handle of a new stopped timer, TIMERWHEEL_NONE if TIMERWHEEL_MAXTIMERS are taken
+uint8_t timerwheel_create(timerwheel_cb_t cb, uint8_t arg)
+{
+    if (timerCnt == TIMERWHEEL_MAXTIMERS)
+        return TIMERWHEEL_NONE;
+
+    timers[timerCnt].cb = cb;
+    timers[timerCnt].arg = arg;
+    timers[timerCnt].running = 0;
+    return timerCnt++;
+}
+
+//(re)starts the timer : it fires between waitTime_ms and waitTime_ms+1 ms from now
+void timerwheel_start(uint8_t handle, uint32_t waitTime_ms)
+{
+    core_util_critical_section_enter();
+
+    if (timers[handle].running)
+        timerwheel_unlink(handle);
+
+    timerwheel_advance();
+    timers[handle].expiry = curTick + waitTime_ms + (us_ticker_read() != curTickUs);
+    timerwheel_link(handle);
+
+    //a stop leaves the hardware timer armed : firing early for nothing is cheaper than a search
+    if (!armed || (int32_t)(timers[handle].expiry - armedTick) < 0)
+        timerwheel_arm(timers[handle].expiry);
+
+    core_util_critical_section_exit();
+}
+
+void timerwheel_stop(uint8_t handle)
+{
+    core_util_critical_section_enter();
+    if (timers[handle].running)
+        timerwheel_unlink(handle);
+    core_util_critical_section_exit();
+}
+
+uint8_t timerwheel_isRunning(uint8_t handle)
+{
+    return timers[handle].running;
+}
+
+uint8_t timerwheel_getRunningCount(void)
+{
+    return runningCnt;
+}
@@ -0,0 +1,18 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include "mbed.h"
+
+#define TIMERWHEEL_NONE             0xFF
+
+//called in interrupt context when a timer expires, with the argument given at creation
+typedef void (*timerwheel_cb_t)(uint8_t arg);
+
+void timerwheel_init(void);
+uint8_t timerwheel_create(timerwheel_cb_t cb, uint8_t arg);
+void timerwheel_start(uint8_t handle, uint32_t waitTime_ms);
+void timerwheel_stop(uint8_t handle);
+uint8_t timerwheel_isRunning(uint8_t handle);
+uint8_t timerwheel_getRunningCount(void);
+
+#endif